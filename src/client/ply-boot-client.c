@@ -28,14 +28,23 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include "ply-array.h"
+#include "ply-buffer.h"
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-utils.h"
 
+/* Caps on how much gets written or read in one wakeup, so a long queue
+ * of requests can't starve the rest of the event loop
+ */
+#define MAX_PIPELINED_REQUEST_BYTES (64 * 1024)
+#define MAX_REPLY_BYTES_PER_WAKEUP (64 * 1024)
+#define MAX_REPLY_SIZE (512 * 1024)
+
 struct _ply_boot_client
 {
         ply_event_loop_t                    *loop;
@@ -43,12 +52,18 @@ struct _ply_boot_client
         ply_fd_watch_t                      *daemon_has_reply_watch;
         ply_list_t                          *requests_to_send;
         ply_list_t                          *requests_waiting_for_replies;
+        ply_buffer_t                        *replies;
         int                                  socket_fd;
+        int                                  update_socket_fd;
+        uint32_t                             next_request_id;
 
         ply_boot_client_disconnect_handler_t disconnect_handler;
         void                                *disconnect_handler_user_data;
 
         uint32_t                             is_connected : 1;
+        uint32_t                             is_negotiating : 1;
+        uint32_t                             has_negotiated : 1;
+        uint32_t                             uses_extended_protocol : 1;
 };
 
 typedef struct
@@ -56,6 +71,7 @@ typedef struct
         ply_boot_client_t                 *client;
         char                              *command;
         char                              *argument;
+        uint32_t                           id;
         ply_boot_client_response_handler_t handler;
         ply_boot_client_response_handler_t failed_handler;
         void                              *user_data;
@@ -63,6 +79,7 @@ typedef struct
 
 static void ply_boot_client_cancel_request (ply_boot_client_t         *client,
                                             ply_boot_client_request_t *request);
+static void ply_boot_client_watch_for_daemon_to_take_requests (ply_boot_client_t *client);
 
 ply_boot_client_t *
 ply_boot_client_new (void)
@@ -74,6 +91,9 @@ ply_boot_client_new (void)
         client->daemon_has_reply_watch = NULL;
         client->requests_to_send = ply_list_new ();
         client->requests_waiting_for_replies = ply_list_new ();
+        client->replies = ply_buffer_new ();
+        client->next_request_id = 1;
+        client->update_socket_fd = -1;
         client->loop = NULL;
         client->is_connected = false;
         client->disconnect_handler = NULL;
@@ -161,6 +181,10 @@ ply_boot_client_free (ply_boot_client_t *client)
 
         ply_list_free (client->requests_to_send);
         ply_list_free (client->requests_waiting_for_replies);
+        ply_buffer_free (client->replies);
+
+        if (client->update_socket_fd >= 0)
+                close (client->update_socket_fd);
 
         free (client);
 }
@@ -245,79 +269,125 @@ ply_boot_client_cancel_request (ply_boot_client_t         *client,
         ply_boot_client_request_free (request);
 }
 
+static uint32_t
+read_uint32 (const uint8_t *bytes)
+{
+        return (bytes[0] << 0) |
+               (bytes[1] << 8) |
+               (bytes[2] << 16) |
+               ((uint32_t) bytes[3] << 24);
+}
+
 static void
-ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
+append_uint32 (ply_buffer_t *buffer,
+               uint32_t      value)
 {
-        ply_list_node_t *request_node;
-        ply_boot_client_request_t *request;
-        bool processed_reply;
-        uint8_t byte[2] = "";
-        uint32_t size;
+        uint8_t bytes[4];
 
-        assert (client != NULL);
+        bytes[0] = (value >> 0) & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = (value >> 16) & 0xFF;
+        bytes[3] = (value >> 24) & 0xFF;
 
-        processed_reply = false;
-        if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
-                ply_error ("received unexpected response from boot status daemon");
+        ply_buffer_append_bytes (buffer, bytes, sizeof(bytes));
+}
+
+static void
+ply_boot_client_stop_watching_for_replies_if_idle (ply_boot_client_t *client)
+{
+        if (ply_list_get_length (client->requests_waiting_for_replies) != 0)
                 return;
+
+        if (client->daemon_has_reply_watch != NULL) {
+                assert (client->loop != NULL);
+                ply_event_loop_stop_watching_fd (client->loop,
+                                                 client->daemon_has_reply_watch);
+                client->daemon_has_reply_watch = NULL;
         }
+}
 
-        request_node = ply_list_get_first_node (client->requests_waiting_for_replies);
-        assert (request_node != NULL);
+/* Requests in the original framing go out without an id.  Requests in
+ * the extended framing are held back until none of those are left
+ * waiting, so the first request waiting says how its reply is framed.
+ */
+static bool
+ply_boot_client_is_waiting_for_original_replies (ply_boot_client_t *client)
+{
+        ply_list_node_t *node;
+        ply_boot_client_request_t *request;
 
-        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
-        assert (request != NULL);
+        node = ply_list_get_first_node (client->requests_waiting_for_replies);
+
+        if (node == NULL)
+                return false;
+
+        request = (ply_boot_client_request_t *) ply_list_node_get_data (node);
+
+        return request->id == 0;
+}
+
+static ply_list_node_t *
+ply_boot_client_find_request_waiting_for_reply (ply_boot_client_t *client,
+                                                uint32_t           request_id)
+{
+        ply_list_node_t *node;
+
+        node = ply_list_get_first_node (client->requests_waiting_for_replies);
+
+        /* Replies to the original framing carry no id and come back in the
+         * order the requests were sent
+         */
+        if (ply_boot_client_is_waiting_for_original_replies (client))
+                return node;
+
+        while (node != NULL) {
+                ply_boot_client_request_t *request;
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (node);
 
-        if (!ply_read (client->socket_fd, byte, sizeof(uint8_t)))
-                goto out;
+                if (request->id == request_id)
+                        return node;
+
+                node = ply_list_get_next_node (client->requests_waiting_for_replies, node);
+        }
 
-        if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK, sizeof(uint8_t)) == 0) {
+        return NULL;
+}
+
+static bool
+ply_boot_client_handle_reply (ply_boot_client_t         *client,
+                              ply_boot_client_request_t *request,
+                              uint8_t                    response_type,
+                              const char                *payload,
+                              uint32_t                   size)
+{
+        if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK[0]) {
                 if (request->handler != NULL)
                         request->handler (request->user_data, client);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER, sizeof(uint8_t)) == 0) {
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER[0]) {
                 char *answer;
 
-                if (!ply_read_uint32 (client->socket_fd, &size))
-                        goto out;
-
                 answer = malloc ((size + 1) * sizeof(char));
-                if (size > 0) {
-                        if (!ply_read (client->socket_fd, answer, size)) {
-                                free (answer);
-                                goto out;
-                        }
-                }
+                if (size > 0)
+                        memcpy (answer, payload, size);
 
                 answer[size] = '\0';
                 if (request->handler != NULL)
                         ((ply_boot_client_answer_handler_t) request->handler)(request->user_data, answer, client);
                 free (answer);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS, sizeof(uint8_t)) == 0) {
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS[0]) {
                 ply_array_t *array;
                 char **answers;
-                char *answer;
-                char *p;
-                char *q;
-                uint8_t i;
-
-                array = NULL;
-                answers = NULL;
+                const char *p;
+                const char *q;
+                uint32_t i;
 
-                if (!ply_read_uint32 (client->socket_fd, &size))
-                        goto out;
-
-                assert (size > 0);
-
-                answer = malloc (size);
-
-                if (!ply_read (client->socket_fd, answer, size)) {
-                        free (answer);
-                        goto out;
-                }
+                if (size == 0)
+                        return false;
 
                 array = ply_array_new (PLY_ARRAY_ELEMENT_TYPE_POINTER);
 
-                p = answer;
+                p = payload;
                 q = p;
                 for (i = 0; i < size; i++, q++) {
                         if (*q == '\0') {
@@ -325,7 +395,6 @@ ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
                                 p = q + 1;
                         }
                 }
-                free (answer);
 
                 answers = (char **) ply_array_steal_pointer_elements (array);
                 ply_array_free (array);
@@ -334,121 +403,434 @@ ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
                         ((ply_boot_client_multiple_answers_handler_t) request->handler)(request->user_data, (const char *const *) answers, client);
 
                 ply_free_string_array (answers);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER, sizeof(uint8_t)) == 0) {
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER[0]) {
                 if (request->handler != NULL)
                         ((ply_boot_client_answer_handler_t) request->handler)(request->user_data, NULL, client);
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK[0]) {
+                if (request->failed_handler != NULL)
+                        request->failed_handler (request->user_data, client);
         } else {
-                goto out;
+                return false;
         }
 
-        processed_reply = true;
+        return true;
+}
 
-out:
-        if (!processed_reply)
-                if (request->failed_handler != NULL)
-                        request->failed_handler (request->user_data, client);
+/* Processes one reply at the start of bytes.  Returns the size of the
+ * reply, 0 if it hasn't been received completely yet, or -1 if the reply
+ * is malformed.
+ */
+static ssize_t
+ply_boot_client_process_reply (ply_boot_client_t *client,
+                               const uint8_t     *bytes,
+                               size_t             size)
+{
+        ply_list_node_t *request_node;
+        ply_boot_client_request_t *request;
+        size_t header_size, reply_size;
+        uint32_t request_id = 0;
+        uint32_t payload_size = 0;
+        uint8_t response_type;
+        bool uses_extended_protocol;
+
+        uses_extended_protocol = !ply_boot_client_is_waiting_for_original_replies (client);
+        header_size = uses_extended_protocol ? 4 : 0;
+
+        if (size < header_size + 1)
+                return 0;
+
+        if (uses_extended_protocol)
+                request_id = read_uint32 (bytes);
+
+        response_type = bytes[header_size];
+        header_size++;
+
+        if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER[0] ||
+            response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS[0]) {
+                if (size < header_size + 4)
+                        return 0;
+
+                payload_size = read_uint32 (bytes + header_size);
+                header_size += 4;
+
+                if (payload_size > MAX_REPLY_SIZE)
+                        return -1;
+        }
+
+        reply_size = header_size + payload_size;
+        if (size < reply_size)
+                return 0;
+
+        request_node = ply_boot_client_find_request_waiting_for_reply (client, request_id);
+
+        if (request_node == NULL) {
+                ply_error ("received unexpected response from boot status daemon");
+                return reply_size;
+        }
+
+        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+        assert (request != NULL);
 
         ply_list_remove_node (client->requests_waiting_for_replies, request_node);
 
+        if (!ply_boot_client_handle_reply (client, request, response_type,
+                                           (const char *) bytes + header_size,
+                                           payload_size)) {
+                ply_boot_client_cancel_request (client, request);
+                return -1;
+        }
+
+        ply_boot_client_request_free (request);
+
+        return reply_size;
+}
+
+static void
+ply_boot_client_fail_first_request_waiting_for_reply (ply_boot_client_t *client)
+{
+        ply_list_node_t *request_node;
+        ply_boot_client_request_t *request;
+
+        request_node = ply_list_get_first_node (client->requests_waiting_for_replies);
+
+        if (request_node == NULL)
+                return;
+
+        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+        ply_list_remove_node (client->requests_waiting_for_replies, request_node);
+        ply_boot_client_cancel_request (client, request);
+}
+
+static void
+ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
+{
+        const uint8_t *bytes;
+        size_t size, offset;
+        ssize_t reply_size = 0;
+        bool is_connected;
+
+        assert (client != NULL);
+
         if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
-                if (client->daemon_has_reply_watch != NULL) {
-                        assert (client->loop != NULL);
-                        ply_event_loop_stop_watching_fd (client->loop,
-                                                         client->daemon_has_reply_watch);
-                        client->daemon_has_reply_watch = NULL;
-                }
+                ply_error ("received unexpected response from boot status daemon");
+                return;
         }
+
+        is_connected = ply_buffer_append_from_socket (client->replies,
+                                                      client->socket_fd,
+                                                      MAX_REPLY_BYTES_PER_WAKEUP) >= 0;
+
+        /* The daemon answers a batch of pipelined requests in one write,
+         * so there may be any number of replies in the buffer
+         */
+        bytes = (const uint8_t *) ply_buffer_get_bytes (client->replies);
+        size = ply_buffer_get_size (client->replies);
+        offset = 0;
+        while (offset < size &&
+               ply_list_get_length (client->requests_waiting_for_replies) > 0) {
+                reply_size = ply_boot_client_process_reply (client,
+                                                            bytes + offset,
+                                                            size - offset);
+                if (reply_size <= 0)
+                        break;
+
+                offset += reply_size;
+        }
+
+        if (reply_size < 0) {
+                /* There's no way to find the start of the next reply in
+                 * the stream, so give up on the connection
+                 */
+                ply_trace ("received malformed reply from boot status daemon, disconnecting");
+                ply_buffer_clear (client->replies);
+                ply_boot_client_cancel_requests (client);
+                ply_boot_client_disconnect (client);
+
+                if (client->disconnect_handler != NULL)
+                        client->disconnect_handler (client->disconnect_handler_user_data,
+                                                    client);
+                return;
+        } else {
+                ply_buffer_remove_bytes (client->replies, offset);
+
+                if (offset == 0 && !is_connected)
+                        ply_boot_client_fail_first_request_waiting_for_reply (client);
+        }
+
+        /* Requests held back for the last replies in the original framing
+         * can go out now
+         */
+        if (client->uses_extended_protocol &&
+            ply_list_get_length (client->requests_to_send) > 0 &&
+            !ply_boot_client_is_waiting_for_original_replies (client))
+                ply_boot_client_watch_for_daemon_to_take_requests (client);
+
+        ply_boot_client_stop_watching_for_replies_if_idle (client);
 }
 
-static char *
-ply_boot_client_get_request_string (ply_boot_client_t         *client,
-                                    ply_boot_client_request_t *request,
-                                    size_t                    *request_size)
+/* Appends the request to buffer in the framing the daemon understands,
+ * returning false if its argument doesn't fit
+ */
+static bool
+ply_boot_client_append_request (ply_boot_client_t         *client,
+                                ply_boot_client_request_t *request,
+                                ply_buffer_t              *buffer)
 {
-        char *request_string;
+        uint8_t header[3];
+        size_t argument_size = 0;
 
         assert (client != NULL);
         assert (request != NULL);
-        assert (request_size != NULL);
-
         assert (request->command != NULL);
 
+        if (request->argument != NULL)
+                argument_size = strlen (request->argument) + 1;
+
+        if (client->uses_extended_protocol) {
+                if (argument_size > PLY_BOOT_PROTOCOL_MAX_ARGUMENT_SIZE) {
+                        ply_trace ("argument for '%s' request is too long", request->command);
+                        return false;
+                }
+
+                request->id = client->next_request_id++;
+
+                header[0] = request->command[0];
+                header[1] = PLY_BOOT_PROTOCOL_EXTENDED_ARGUMENT_MARKER;
+                ply_buffer_append_bytes (buffer, header, 2);
+                append_uint32 (buffer, request->id);
+                append_uint32 (buffer, argument_size);
+                if (argument_size > 0)
+                        ply_buffer_append_bytes (buffer, request->argument, argument_size);
+
+                return true;
+        }
+
         if (request->argument == NULL) {
-                request_string = strdup (request->command);
-                *request_size = strlen (request_string) + 1;
-                return request_string;
+                ply_buffer_append_bytes (buffer, request->command,
+                                         strlen (request->command) + 1);
+                return true;
         }
 
-        assert (strlen (request->argument) <= UCHAR_MAX);
+        if (argument_size > UCHAR_MAX) {
+                ply_trace ("argument for '%s' request is too long for this daemon", request->command);
+                return false;
+        }
 
-        request_string = NULL;
-        asprintf (&request_string, "%s\002%c%s", request->command,
-                  (char) (strlen (request->argument) + 1), request->argument);
-        *request_size = strlen (request_string) + 1;
+        header[0] = request->command[0];
+        header[1] = PLY_BOOT_PROTOCOL_ARGUMENT_MARKER;
+        header[2] = argument_size;
+        ply_buffer_append_bytes (buffer, header, 3);
+        ply_buffer_append_bytes (buffer, request->argument, argument_size);
 
-        return request_string;
+        return true;
+}
+
+static void
+ply_boot_client_watch_for_replies (ply_boot_client_t *client)
+{
+        if (client->daemon_has_reply_watch != NULL)
+                return;
+
+        client->daemon_has_reply_watch =
+                ply_event_loop_watch_fd (client->loop, client->socket_fd,
+                                         PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                         (ply_event_handler_t)
+                                         ply_boot_client_process_incoming_replies,
+                                         NULL, client);
 }
 
+/* Sends every request in the list with one write, moving them to the
+ * list of requests waiting for replies
+ */
 static bool
-ply_boot_client_send_request (ply_boot_client_t         *client,
-                              ply_boot_client_request_t *request)
+ply_boot_client_send_requests (ply_boot_client_t *client,
+                               ply_list_t        *requests)
 {
-        char *request_string;
-        size_t request_size;
+        ply_buffer_t *buffer;
+        ply_list_node_t *node;
+        bool was_sent;
 
         assert (client != NULL);
-        assert (request != NULL);
 
-        request_string = ply_boot_client_get_request_string (client, request,
-                                                             &request_size);
-        if (!ply_write (client->socket_fd, request_string, request_size)) {
-                free (request_string);
-                ply_boot_client_cancel_request (client, request);
-                return false;
+        buffer = ply_buffer_new ();
+
+        node = ply_list_get_first_node (requests);
+        while (node != NULL) {
+                ply_list_node_t *next_node;
+                ply_boot_client_request_t *request;
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (node);
+                next_node = ply_list_get_next_node (requests, node);
+
+                if (!ply_boot_client_append_request (client, request, buffer)) {
+                        ply_boot_client_cancel_request (client, request);
+                        ply_list_remove_node (requests, node);
+                }
+
+                node = next_node;
         }
-        free (request_string);
-
-        if (client->daemon_has_reply_watch == NULL) {
-                assert (ply_list_get_length (client->requests_waiting_for_replies) == 0);
-                client->daemon_has_reply_watch =
-                        ply_event_loop_watch_fd (client->loop, client->socket_fd,
-                                                 PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
-                                                 (ply_event_handler_t)
-                                                 ply_boot_client_process_incoming_replies,
-                                                 NULL, client);
+
+        was_sent = ply_write (client->socket_fd,
+                              ply_buffer_get_bytes (buffer),
+                              ply_buffer_get_size (buffer));
+        ply_buffer_free (buffer);
+
+        while ((node = ply_list_get_first_node (requests)) != NULL) {
+                ply_boot_client_request_t *request;
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (node);
+                ply_list_remove_node (requests, node);
+
+                if (was_sent)
+                        ply_list_append_data (client->requests_waiting_for_replies, request);
+                else
+                        ply_boot_client_cancel_request (client, request);
         }
-        return true;
+
+        if (ply_list_get_length (client->requests_waiting_for_replies) > 0)
+                ply_boot_client_watch_for_replies (client);
+
+        return was_sent;
+}
+
+static void ply_boot_client_process_pending_requests (ply_boot_client_t *client);
+
+static void
+ply_boot_client_watch_for_daemon_to_take_requests (ply_boot_client_t *client)
+{
+        if (client->daemon_can_take_request_watch != NULL)
+                return;
+
+        client->daemon_can_take_request_watch =
+                ply_event_loop_watch_fd (client->loop, client->socket_fd,
+                                         PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA,
+                                         (ply_event_handler_t)
+                                         ply_boot_client_process_pending_requests,
+                                         NULL, client);
+}
+
+static void
+ply_boot_client_stop_watching_for_daemon_to_take_requests (ply_boot_client_t *client)
+{
+        if (client->daemon_can_take_request_watch == NULL)
+                return;
+
+        assert (client->loop != NULL);
+
+        ply_event_loop_stop_watching_fd (client->loop,
+                                         client->daemon_can_take_request_watch);
+        client->daemon_can_take_request_watch = NULL;
+}
+
+static void
+ply_boot_client_finish_negotiation (ply_boot_client_t *client,
+                                    bool               uses_extended_protocol)
+{
+        client->is_negotiating = false;
+        client->has_negotiated = true;
+        client->uses_extended_protocol = uses_extended_protocol;
+
+        ply_trace ("daemon %s pipelined requests",
+                   uses_extended_protocol ? "supports" : "doesn't support");
+
+        if (ply_list_get_length (client->requests_to_send) > 0 &&
+            client->loop != NULL && client->socket_fd >= 0)
+                ply_boot_client_watch_for_daemon_to_take_requests (client);
+}
+
+static void
+ply_boot_client_on_negotiated (ply_boot_client_t *client,
+                               const char        *version)
+{
+        ply_boot_client_finish_negotiation (client,
+                                            version != NULL && atoi (version) >= 2);
+}
+
+static void
+ply_boot_client_on_negotiation_failed (ply_boot_client_t *client)
+{
+        ply_boot_client_finish_negotiation (client, false);
+}
+
+static bool
+ply_boot_client_request_fits_original_framing (ply_boot_client_request_t *request)
+{
+        return request->argument == NULL || strlen (request->argument) + 1 <= UCHAR_MAX;
 }
 
 static void
 ply_boot_client_process_pending_requests (ply_boot_client_t *client)
 {
+        ply_list_t *requests;
         ply_list_node_t *request_node;
         ply_boot_client_request_t *request;
+        size_t size = 0;
 
         assert (ply_list_get_length (client->requests_to_send) != 0);
         assert (client->daemon_can_take_request_watch != NULL);
 
-        request_node = ply_list_get_first_node (client->requests_to_send);
-        assert (request_node != NULL);
+        /* Replies can't be told apart if both framings are in flight, so
+         * wait for the answers to what has already been sent
+         */
+        if (client->is_negotiating ||
+            (client->uses_extended_protocol &&
+             ply_boot_client_is_waiting_for_original_replies (client))) {
+                ply_boot_client_stop_watching_for_daemon_to_take_requests (client);
+                return;
+        }
 
-        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
-        assert (request != NULL);
+        requests = ply_list_new ();
 
-        ply_list_remove_node (client->requests_to_send, request_node);
+        /* Ask which framing the daemon understands once there is more than
+         * one request to send, or one that doesn't fit the original framing.
+         * Daemons that predate the question answer it with a NAK.  The
+         * requests behind it go out in the original framing in the same
+         * write, rather than waiting for the answer.
+         */
+        request_node = ply_list_get_first_node (client->requests_to_send);
+        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+        if (!client->has_negotiated &&
+            (ply_list_get_length (client->requests_to_send) > 1 ||
+             !ply_boot_client_request_fits_original_framing (request))) {
+                client->is_negotiating = true;
+                ply_list_append_data (requests,
+                                      ply_boot_client_request_new (client,
+                                                                   PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEGOTIATE,
+                                                                   PLY_BOOT_PROTOCOL_VERSION,
+                                                                   (ply_boot_client_response_handler_t)
+                                                                   ply_boot_client_on_negotiated,
+                                                                   (ply_boot_client_response_handler_t)
+                                                                   ply_boot_client_on_negotiation_failed,
+                                                                   client));
+        }
 
-        if (ply_boot_client_send_request (client, request))
-                ply_list_append_data (client->requests_waiting_for_replies, request);
+        /* Pipeline as many queued requests as fit in one write
+         */
+        while (ply_list_get_length (client->requests_to_send) > 0 &&
+               size < MAX_PIPELINED_REQUEST_BYTES) {
+                request_node = ply_list_get_first_node (client->requests_to_send);
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+                assert (request != NULL);
+
+                /* Requests that need the extended framing wait for the answer */
+                if (client->is_negotiating &&
+                    !ply_boot_client_request_fits_original_framing (request))
+                        break;
+
+                ply_list_remove_node (client->requests_to_send, request_node);
+                ply_list_append_data (requests, request);
+
+                size += strlen (request->command) + 10;
+                if (request->argument != NULL)
+                        size += strlen (request->argument) + 1;
+        }
 
-        if (ply_list_get_length (client->requests_to_send) == 0) {
-                if (client->daemon_has_reply_watch != NULL) {
-                        assert (client->loop != NULL);
+        ply_boot_client_send_requests (client, requests);
+        ply_list_free (requests);
 
-                        ply_event_loop_stop_watching_fd (client->loop,
-                                                         client->daemon_can_take_request_watch);
-                        client->daemon_can_take_request_watch = NULL;
-                }
-        }
+        if (client->is_negotiating ||
+            ply_list_get_length (client->requests_to_send) == 0)
+                ply_boot_client_stop_watching_for_daemon_to_take_requests (client);
 }
 
 static void
@@ -462,18 +844,10 @@ ply_boot_client_queue_request (ply_boot_client_t                 *client,
         assert (client != NULL);
         assert (client->loop != NULL);
         assert (request_command != NULL);
-        assert (request_argument == NULL || strlen (request_argument) <= UCHAR_MAX);
-
-        if (client->daemon_can_take_request_watch == NULL &&
-            client->socket_fd >= 0) {
-                assert (ply_list_get_length (client->requests_to_send) == 0);
-                client->daemon_can_take_request_watch =
-                        ply_event_loop_watch_fd (client->loop, client->socket_fd,
-                                                 PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA,
-                                                 (ply_event_handler_t)
-                                                 ply_boot_client_process_pending_requests,
-                                                 NULL, client);
-        }
+        assert (request_argument == NULL || strlen (request_argument) < PLY_BOOT_PROTOCOL_MAX_ARGUMENT_SIZE);
+
+        if (client->socket_fd >= 0 && !client->is_negotiating)
+                ply_boot_client_watch_for_daemon_to_take_requests (client);
 
         if (!client->is_connected) {
                 if (failed_handler != NULL)
@@ -539,6 +913,81 @@ ply_boot_client_system_update (ply_boot_client_t                 *client,
                                        progress, handler, failed_handler, user_data);
 }
 
+/* Sends a one-way request over the daemon's update socket.  The socket
+ * is non-blocking, so a daemon that falls behind makes this fail rather
+ * than stall the caller.
+ */
+static bool
+ply_boot_client_send_datagram (ply_boot_client_t *client,
+                               const char        *request_command,
+                               const char        *request_argument)
+{
+        uint8_t datagram[PLY_BOOT_PROTOCOL_MAX_UPDATE_DATAGRAM_SIZE];
+        size_t argument_size, datagram_size;
+
+        assert (client != NULL);
+        assert (request_command != NULL);
+        assert (request_argument != NULL);
+
+        argument_size = strlen (request_argument) + 1;
+        datagram_size = 10 + argument_size;
+
+        if (datagram_size > sizeof(datagram))
+                return false;
+
+        /* The daemon drops datagrams that don't come from root, without
+         * telling anyone, so other users have to wait for a reply
+         */
+        if (getuid () != 0)
+                return false;
+
+        if (client->update_socket_fd < 0) {
+                client->update_socket_fd =
+                        ply_connect_to_unix_datagram_socket (PLY_BOOT_PROTOCOL_TRIMMED_ABSTRACT_UPDATE_SOCKET_PATH,
+                                                             PLY_UNIX_SOCKET_TYPE_TRIMMED_ABSTRACT);
+
+                if (client->update_socket_fd < 0) {
+                        ply_trace ("could not connect to " PLY_BOOT_PROTOCOL_TRIMMED_ABSTRACT_UPDATE_SOCKET_PATH ": %m");
+                        return false;
+                }
+        }
+
+        datagram[0] = request_command[0];
+        datagram[1] = PLY_BOOT_PROTOCOL_EXTENDED_ARGUMENT_MARKER;
+        memset (datagram + 2, 0, 4);
+        datagram[6] = (argument_size >> 0) & 0xFF;
+        datagram[7] = (argument_size >> 8) & 0xFF;
+        datagram[8] = (argument_size >> 16) & 0xFF;
+        datagram[9] = (argument_size >> 24) & 0xFF;
+        memcpy (datagram + 10, request_argument, argument_size);
+
+        if (send (client->update_socket_fd, datagram, datagram_size,
+                  MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t) datagram_size) {
+                ply_trace ("could not send update datagram: %m");
+                return false;
+        }
+
+        return true;
+}
+
+bool
+ply_boot_client_update_daemon_without_reply (ply_boot_client_t *client,
+                                             const char        *status)
+{
+        return ply_boot_client_send_datagram (client,
+                                              PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE,
+                                              status);
+}
+
+bool
+ply_boot_client_system_update_without_reply (ply_boot_client_t *client,
+                                             const char        *progress)
+{
+        return ply_boot_client_send_datagram (client,
+                                              PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_UPDATE,
+                                              progress);
+}
+
 void
 ply_boot_client_tell_daemon_to_change_root (ply_boot_client_t                 *client,
                                             const char                        *root_dir,
@@ -770,6 +1219,32 @@ ply_boot_client_ask_daemon_has_active_vt (ply_boot_client_t                 *cli
                                        NULL, handler, failed_handler, user_data);
 }
 
+void
+ply_boot_client_ask_daemon_for_stats (ply_boot_client_t                 *client,
+                                      ply_boot_client_answer_handler_t   handler,
+                                      ply_boot_client_response_handler_t failed_handler,
+                                      void                              *user_data)
+{
+        assert (client != NULL);
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_GET_STATS,
+                                       NULL, (ply_boot_client_response_handler_t)
+                                       handler, failed_handler, user_data);
+}
+
+void
+ply_boot_client_ask_daemon_for_startup_trace (ply_boot_client_t                 *client,
+                                              ply_boot_client_answer_handler_t   handler,
+                                              ply_boot_client_response_handler_t failed_handler,
+                                              void                              *user_data)
+{
+        assert (client != NULL);
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_GET_STARTUP_TRACE,
+                                       NULL, (ply_boot_client_response_handler_t)
+                                       handler, failed_handler, user_data);
+}
+
 void
 ply_boot_client_tell_daemon_about_error (ply_boot_client_t                 *client,
                                          ply_boot_client_response_handler_t handler,
@@ -790,6 +1265,28 @@ ply_boot_client_flush (ply_boot_client_t *client)
         }
 }
 
+void
+ply_boot_client_wait_for_replies (ply_boot_client_t *client)
+{
+        assert (client != NULL);
+
+        while (client->is_connected &&
+               ply_boot_client_get_number_of_pending_requests (client) > 0) {
+                ply_event_loop_process_pending_events (client->loop);
+        }
+}
+
+/* Counts requests that are queued, sent and not yet answered
+ */
+int
+ply_boot_client_get_number_of_pending_requests (ply_boot_client_t *client)
+{
+        assert (client != NULL);
+
+        return ply_list_get_length (client->requests_to_send) +
+               ply_list_get_length (client->requests_waiting_for_replies);
+}
+
 void
 ply_boot_client_disconnect (ply_boot_client_t *client)
 {
@@ -43,6 +43,16 @@ typedef void (*ply_boot_client_disconnect_handler_t) (void              *user_da
                                                       ply_boot_client_t *client);
 
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+/* A client is a session with the daemon that can stay open for as long as
+ * the caller likes.  Connect once, attach to an event loop, and queue any
+ * number of requests.  Requests queued before the loop next runs are
+ * written together, and the daemon answers them together, so a burst of
+ * requests costs about one round trip.  Each request's handler or
+ * failed_handler runs once the daemon replies.  Use ply_boot_client_flush ()
+ * to wait until everything queued has been sent, or
+ * ply_boot_client_wait_for_replies () to wait until every reply has come
+ * back.
+ */
 ply_boot_client_t *ply_boot_client_new (void);
 
 void ply_boot_client_free (ply_boot_client_t *client);
@@ -68,6 +78,14 @@ void ply_boot_client_system_update (ply_boot_client_t                 *client,
                                     ply_boot_client_response_handler_t handler,
                                     ply_boot_client_response_handler_t failed_handler,
                                     void                              *user_data);
+/* Send the update over the daemon's datagram socket without waiting for
+ * a reply.  These return false if the daemon can't take the update that
+ * way, in which case it should be sent with the functions above.
+ */
+bool ply_boot_client_update_daemon_without_reply (ply_boot_client_t *client,
+                                                  const char        *status);
+bool ply_boot_client_system_update_without_reply (ply_boot_client_t *client,
+                                                  const char        *progress);
 void ply_boot_client_tell_daemon_to_change_root (ply_boot_client_t                 *client,
                                                  const char                        *chroot_dir,
                                                  ply_boot_client_response_handler_t handler,
@@ -148,7 +166,18 @@ void ply_boot_client_ask_daemon_has_active_vt (ply_boot_client_t
                                                ply_boot_client_response_handler_t handler,
                                                ply_boot_client_response_handler_t failed_handler,
                                                void                              *user_data);
+void ply_boot_client_ask_daemon_for_stats (ply_boot_client_t                 *client,
+                                           ply_boot_client_answer_handler_t   handler,
+                                           ply_boot_client_response_handler_t failed_handler,
+                                           void                              *user_data);
+/* The answer is the daemon's startup phases in Chrome trace event JSON */
+void ply_boot_client_ask_daemon_for_startup_trace (ply_boot_client_t                 *client,
+                                                   ply_boot_client_answer_handler_t   handler,
+                                                   ply_boot_client_response_handler_t failed_handler,
+                                                   void                              *user_data);
 void ply_boot_client_flush (ply_boot_client_t *client);
+void ply_boot_client_wait_for_replies (ply_boot_client_t *client);
+int ply_boot_client_get_number_of_pending_requests (ply_boot_client_t *client);
 void ply_boot_client_disconnect (ply_boot_client_t *client);
 void ply_boot_client_attach_to_event_loop (ply_boot_client_t *client,
                                            ply_event_loop_t  *loop);
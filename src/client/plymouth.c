@@ -22,19 +22,23 @@
 #include "config.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include "ply-boot-client.h"
+#include "ply-buffer.h"
 #include "ply-command-parser.h"
 #include "ply-event-loop.h"
+#include "ply-log-record.h"
 #include "ply-logger.h"
 #include "ply-utils.h"
 
@@ -405,6 +409,20 @@ on_multiple_password_answers (password_answer_state_t *answer_state,
         ply_event_loop_exit (answer_state->state->loop, 0);
 }
 
+static void
+on_stats_answer (state_t           *state,
+                 const char        *answer,
+                 ply_boot_client_t *client)
+{
+        if (answer == NULL) {
+                ply_event_loop_exit (state->loop, 1);
+                return;
+        }
+
+        printf ("%s", answer);
+        ply_event_loop_exit (state->loop, 0);
+}
+
 static void
 on_disconnect (state_t *state)
 {
@@ -727,6 +745,166 @@ on_reload_request (state_t    *state,
                                                on_failure, state);
 }
 
+static void
+show_log_record (const ply_log_record_t *record,
+                 bool                    should_show_plain_text,
+                 bool                   *is_at_start_of_line)
+{
+        const char *payload = record->payload;
+        size_t size = record->payload_size;
+
+        if (should_show_plain_text) {
+                if (record->source == PLY_LOG_RECORD_SOURCE_CONSOLE ||
+                    record->source == PLY_LOG_RECORD_SOURCE_DAEMON)
+                        fwrite (payload, 1, size, stdout);
+                return;
+        }
+
+        /* Console output comes in arbitrary chunks, so it only gets a
+         * timestamp where a new line starts.  Everything else is a
+         * message of its own.
+         */
+        if (record->source == PLY_LOG_RECORD_SOURCE_CONSOLE) {
+                while (size > 0) {
+                        const char *end_of_line;
+                        size_t line_size;
+
+                        if (*is_at_start_of_line)
+                                printf ("[%5llu.%06llu] %-9s ",
+                                        (unsigned long long) (record->timestamp / 1000000),
+                                        (unsigned long long) (record->timestamp % 1000000),
+                                        ply_log_record_source_to_string (record->source));
+
+                        end_of_line = memchr (payload, '\n', size);
+                        line_size = end_of_line != NULL ? (size_t) (end_of_line - payload) + 1 : size;
+
+                        fwrite (payload, 1, line_size, stdout);
+                        *is_at_start_of_line = end_of_line != NULL;
+
+                        payload += line_size;
+                        size -= line_size;
+                }
+                return;
+        }
+
+        if (!*is_at_start_of_line)
+                putchar ('\n');
+
+        while (size > 0 && payload[size - 1] == '\n') {
+                size--;
+        }
+
+        printf ("[%5llu.%06llu] %-9s %.*s\n",
+                (unsigned long long) (record->timestamp / 1000000),
+                (unsigned long long) (record->timestamp % 1000000),
+                ply_log_record_source_to_string (record->source),
+                (int) size, payload);
+        *is_at_start_of_line = true;
+}
+
+static bool
+show_log (const char *filename,
+          bool        should_show_plain_text)
+{
+        const uint8_t *data;
+        struct stat file_info;
+        size_t offset, number_of_skipped_bytes;
+        bool is_at_start_of_line = true;
+        int fd;
+
+        fd = open (filename, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+                ply_error ("plymouth: could not open %s: %m", filename);
+                return false;
+        }
+
+        if (fstat (fd, &file_info) < 0) {
+                ply_error ("plymouth: could not read %s: %m", filename);
+                close (fd);
+                return false;
+        }
+
+        if (file_info.st_size == 0) {
+                close (fd);
+                return true;
+        }
+
+        data = mmap (NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close (fd);
+
+        if (data == MAP_FAILED) {
+                ply_error ("plymouth: could not read %s: %m", filename);
+                return false;
+        }
+
+        offset = 0;
+        number_of_skipped_bytes = 0;
+        while (offset < (size_t) file_info.st_size) {
+                ply_log_record_t record;
+                ply_log_record_parse_result_t result;
+                size_t record_size;
+
+                result = ply_log_record_parse (data + offset, file_info.st_size - offset,
+                                               &record, &record_size);
+
+                if (result == PLY_LOG_RECORD_PARSE_RESULT_TRUNCATED)
+                        break;
+
+                if (result == PLY_LOG_RECORD_PARSE_RESULT_INVALID) {
+                        size_t skip;
+
+                        skip = ply_log_record_find_next (data + offset, file_info.st_size - offset);
+                        number_of_skipped_bytes += skip;
+                        offset += skip;
+                        continue;
+                }
+
+                show_log_record (&record, should_show_plain_text, &is_at_start_of_line);
+                offset += record_size;
+        }
+
+        if (!is_at_start_of_line && !should_show_plain_text)
+                putchar ('\n');
+
+        if (offset < (size_t) file_info.st_size)
+                ply_error ("plymouth: last %zu bytes of %s are an incomplete record",
+                           (size_t) file_info.st_size - offset, filename);
+
+        if (number_of_skipped_bytes > 0)
+                ply_error ("plymouth: skipped %zu bytes in %s that weren't records",
+                           number_of_skipped_bytes, filename);
+
+        munmap ((void *) data, file_info.st_size);
+        fflush (stdout);
+
+        return true;
+}
+
+static void
+on_show_log_request (state_t    *state,
+                     const char *command)
+{
+        char *filename;
+        bool should_show_plain_text;
+
+        filename = NULL;
+        should_show_plain_text = false;
+        ply_command_parser_get_command_options (state->command_parser,
+                                                command,
+                                                "file", &filename,
+                                                "plain", &should_show_plain_text,
+                                                NULL);
+
+        if (!show_log (filename != NULL ? filename : PLYMOUTH_LOG_DIRECTORY "/boot.log",
+                       should_show_plain_text))
+                ply_event_loop_exit (state->loop, 1);
+        else
+                ply_event_loop_exit (state->loop, 0);
+
+        free (filename);
+}
+
 static void
 on_update_root_fs_request (state_t    *state,
                            const char *command)
@@ -793,13 +971,22 @@ on_update_request (state_t    *state,
                                                 "status", &status,
                                                 NULL);
 
-        if (status != NULL) {
-                ply_boot_client_update_daemon (state->client, status,
-                                               (ply_boot_client_response_handler_t)
-                                               on_success,
-                                               (ply_boot_client_response_handler_t)
-                                               on_failure, state);
+        if (status == NULL)
+                return;
+
+        /* Status updates don't need a reply, so skip the round trip when
+         * the daemon takes them as datagrams
+         */
+        if (ply_boot_client_update_daemon_without_reply (state->client, status)) {
+                on_success (state);
+                return;
         }
+
+        ply_boot_client_update_daemon (state->client, status,
+                                       (ply_boot_client_response_handler_t)
+                                       on_success,
+                                       (ply_boot_client_response_handler_t)
+                                       on_failure, state);
 }
 
 static void
@@ -866,12 +1053,16 @@ on_system_update_request (state_t    *state,
 
                 asprintf (&progress_string, "%d", progress);
 
-                ply_boot_client_system_update (state->client,
-                                               progress_string,
-                                               (ply_boot_client_response_handler_t)
-                                               on_success,
-                                               (ply_boot_client_response_handler_t)
-                                               on_failure, state);
+                if (ply_boot_client_system_update_without_reply (state->client,
+                                                                 progress_string))
+                        on_success (state);
+                else
+                        ply_boot_client_system_update (state->client,
+                                                       progress_string,
+                                                       (ply_boot_client_response_handler_t)
+                                                       on_success,
+                                                       (ply_boot_client_response_handler_t)
+                                                       on_failure, state);
                 free (progress_string);
         } else {
                 ply_error ("couldn't set invalid percentage: %i", progress);
@@ -879,14 +1070,303 @@ on_system_update_request (state_t    *state,
         }
 }
 
+typedef struct
+{
+        state_t        *state;
+        int             fd;
+        ply_fd_watch_t *input_watch;
+        ply_buffer_t   *input;
+        int             line_number;
+        int             number_of_requests;
+        int             number_of_replies;
+        int             number_of_failures;
+        uint32_t        reached_end_of_input : 1;
+        uint32_t        should_close_fd : 1;
+} batch_state_t;
+
+typedef struct
+{
+        batch_state_t *batch;
+        int            line_number;
+} batch_request_t;
+
+static void
+finish_batch_if_done (batch_state_t *batch)
+{
+        if (!batch->reached_end_of_input)
+                return;
+
+        if (batch->number_of_replies < batch->number_of_requests)
+                return;
+
+        ply_trace ("batch finished: %d requests, %d failed",
+                   batch->number_of_requests, batch->number_of_failures);
+        ply_event_loop_exit (batch->state->loop,
+                             batch->number_of_failures > 0 ? 1 : 0);
+}
+
+static void
+on_batch_request_success (batch_request_t *request)
+{
+        batch_state_t *batch = request->batch;
+
+        batch->number_of_replies++;
+        free (request);
+
+        finish_batch_if_done (batch);
+}
+
+static void
+on_batch_request_failure (batch_request_t *request)
+{
+        batch_state_t *batch = request->batch;
+
+        ply_error ("batch line %d: request failed", request->line_number);
+
+        batch->number_of_replies++;
+        batch->number_of_failures++;
+        free (request);
+
+        finish_batch_if_done (batch);
+}
+
+/* Each batch line is a command name, optionally followed by whitespace
+ * and an argument that runs to the end of the line.  Every request goes
+ * out over the same connection, pipelined behind the ones before it.
+ */
+static void
+run_batch_line (batch_state_t *batch,
+                char          *line)
+{
+        ply_boot_client_t *client = batch->state->client;
+        ply_boot_client_response_handler_t on_success_handler, on_failure_handler;
+        batch_request_t *request;
+        char *command, *argument;
+        size_t length;
+
+        batch->line_number++;
+
+        length = strlen (line);
+        while (length > 0 && isspace ((unsigned char) line[length - 1]))
+                line[--length] = '\0';
+
+        command = line + strspn (line, " \t");
+
+        if (command[0] == '\0' || command[0] == '#')
+                return;
+
+        argument = command + strcspn (command, " \t");
+        if (argument[0] != '\0') {
+                *argument = '\0';
+                argument++;
+                argument += strspn (argument, " \t");
+        }
+
+        /* The client library can't queue an argument this long, so the
+         * line fails instead of taking the whole batch down with it
+         */
+        if (strlen (argument) >= PLY_BOOT_PROTOCOL_MAX_ARGUMENT_SIZE) {
+                ply_error ("batch line %d: argument is too long", batch->line_number);
+                batch->number_of_requests++;
+                batch->number_of_replies++;
+                batch->number_of_failures++;
+                return;
+        }
+
+        request = calloc (1, sizeof(batch_request_t));
+        request->batch = batch;
+        request->line_number = batch->line_number;
+        batch->number_of_requests++;
+
+        on_success_handler = (ply_boot_client_response_handler_t) on_batch_request_success;
+        on_failure_handler = (ply_boot_client_response_handler_t) on_batch_request_failure;
+
+        if (strcmp (command, "update") == 0) {
+                ply_boot_client_update_daemon (client, argument,
+                                               on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "system-update") == 0) {
+                ply_boot_client_system_update (client, argument,
+                                               on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "change-mode") == 0) {
+                ply_boot_client_change_mode (client, argument,
+                                             on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "display-message") == 0 ||
+                   strcmp (command, "message") == 0) {
+                ply_boot_client_tell_daemon_to_display_message (client, argument,
+                                                                on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "hide-message") == 0) {
+                ply_boot_client_tell_daemon_to_hide_message (client, argument,
+                                                             on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "show-splash") == 0) {
+                ply_boot_client_tell_daemon_to_show_splash (client,
+                                                            on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "hide-splash") == 0) {
+                ply_boot_client_tell_daemon_to_hide_splash (client,
+                                                            on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "pause-progress") == 0) {
+                ply_boot_client_tell_daemon_to_progress_pause (client,
+                                                               on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "unpause-progress") == 0) {
+                ply_boot_client_tell_daemon_to_progress_unpause (client,
+                                                                 on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "report-error") == 0) {
+                ply_boot_client_tell_daemon_about_error (client,
+                                                         on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "sysinit") == 0) {
+                ply_boot_client_tell_daemon_system_is_initialized (client,
+                                                                   on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "newroot") == 0) {
+                ply_boot_client_tell_daemon_to_change_root (client, argument,
+                                                            on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "deactivate") == 0) {
+                ply_boot_client_tell_daemon_to_deactivate (client,
+                                                           on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "reactivate") == 0) {
+                ply_boot_client_tell_daemon_to_reactivate (client,
+                                                           on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "quit") == 0) {
+                ply_boot_client_tell_daemon_to_quit (client,
+                                                     strcmp (argument, "--retain-splash") == 0,
+                                                     on_success_handler, on_failure_handler, request);
+        } else if (strcmp (command, "ping") == 0) {
+                ply_boot_client_ping_daemon (client,
+                                             on_success_handler, on_failure_handler, request);
+        } else {
+                ply_error ("batch line %d: unknown command '%s'", batch->line_number, command);
+                batch->number_of_replies++;
+                batch->number_of_failures++;
+                free (request);
+        }
+}
+
+static void
+run_batch_lines (batch_state_t *batch)
+{
+        const char *bytes;
+        char *line;
+        size_t size, offset;
+
+        bytes = ply_buffer_get_bytes (batch->input);
+        size = ply_buffer_get_size (batch->input);
+        offset = 0;
+
+        while (offset < size) {
+                const char *end;
+
+                end = memchr (bytes + offset, '\n', size - offset);
+
+                if (end == NULL) {
+                        if (!batch->reached_end_of_input)
+                                break;
+                        end = bytes + size;
+                }
+
+                line = strndup (bytes + offset, end - (bytes + offset));
+                run_batch_line (batch, line);
+                free (line);
+
+                offset = MIN ((size_t) (end - bytes) + 1, size);
+        }
+
+        ply_buffer_remove_bytes (batch->input, offset);
+}
+
+static void
+stop_reading_batch_input (batch_state_t *batch)
+{
+        if (batch->input_watch != NULL) {
+                ply_event_loop_stop_watching_fd (batch->state->loop,
+                                                 batch->input_watch);
+                batch->input_watch = NULL;
+        }
+
+        if (batch->should_close_fd) {
+                close (batch->fd);
+                batch->fd = -1;
+                batch->should_close_fd = false;
+        }
+}
+
+static void
+on_batch_input_hangup (batch_state_t *batch)
+{
+        stop_reading_batch_input (batch);
+
+        batch->reached_end_of_input = true;
+        run_batch_lines (batch);
+        finish_batch_if_done (batch);
+}
+
+static void
+on_batch_input (batch_state_t *batch)
+{
+        size_t size;
+
+        size = ply_buffer_get_size (batch->input);
+        ply_buffer_append_from_fd (batch->input, batch->fd);
+
+        if (ply_buffer_get_size (batch->input) == size) {
+                on_batch_input_hangup (batch);
+                return;
+        }
+
+        run_batch_lines (batch);
+}
+
+/* Regular files can't be watched by the event loop, so they are read in
+ * one go; pipes and terminals are read as lines arrive, so a script can
+ * stream requests into a single plymouth process.
+ */
+static bool
+start_batch (batch_state_t *batch,
+             const char    *path)
+{
+        struct stat file_attributes;
+
+        batch->input = ply_buffer_new ();
+
+        if (path != NULL) {
+                batch->fd = open (path, O_RDONLY | O_CLOEXEC);
+                if (batch->fd < 0) {
+                        ply_error ("could not open %s: %m", path);
+                        return false;
+                }
+                batch->should_close_fd = true;
+        } else {
+                batch->fd = STDIN_FILENO;
+        }
+
+        if (fstat (batch->fd, &file_attributes) == 0 &&
+            S_ISREG (file_attributes.st_mode)) {
+                char bytes[4096];
+                ssize_t bytes_read;
+
+                while ((bytes_read = read (batch->fd, bytes, sizeof(bytes))) > 0) {
+                        ply_buffer_append_bytes (batch->input, bytes, bytes_read);
+                        run_batch_lines (batch);
+                }
+
+                on_batch_input_hangup (batch);
+                return true;
+        }
+
+        batch->input_watch = ply_event_loop_watch_fd (batch->state->loop, batch->fd,
+                                                      PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                                      (ply_event_handler_t) on_batch_input,
+                                                      (ply_event_handler_t) on_batch_input_hangup,
+                                                      batch);
+        return true;
+}
+
 int
 main (int    argc,
       char **argv)
 {
         state_t state = { 0 };
-        bool should_help, should_quit, should_ping, should_check_for_active_vt, should_sysinit, should_ask_for_password, should_show_splash, should_hide_splash, should_wait, should_be_verbose, report_error, should_get_plugin_path;
+        bool should_help, should_quit, should_ping, should_check_for_active_vt, should_get_stats, should_sysinit, should_ask_for_password, should_show_splash, should_hide_splash, should_wait, should_be_verbose, report_error, should_get_plugin_path, should_run_batch, should_get_startup_trace;
         bool is_connected;
-        char *status, *chroot_dir, *ignore_keystroke;
+        char *status, *chroot_dir, *ignore_keystroke, *batch_file;
+        batch_state_t batch = { 0 };
         int exit_code;
 
         exit_code = 0;
@@ -905,6 +1385,8 @@ main (int    argc,
                                         "quit", "Tell boot daemon to quit", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "ping", "Check if boot daemon is running", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "has-active-vt", "Check if boot daemon has an active vt", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "get-stats", "Print frame timing statistics from boot daemon", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "get-startup-trace", "Print boot daemon startup phases as Chrome trace JSON", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "sysinit", "Tell boot daemon root filesystem is mounted read-write", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "show-splash", "Show splash screen", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "hide-splash", "Hide splash screen", PLY_COMMAND_OPTION_TYPE_FLAG,
@@ -913,6 +1395,8 @@ main (int    argc,
                                         "update", "Tell boot daemon an update about boot progress", PLY_COMMAND_OPTION_TYPE_STRING,
                                         "details", "Tell boot daemon there were errors during boot", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "wait", "Wait for boot daemon to quit", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "batch", "Send requests read line by line from standard input over one connection", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "batch-file", "Send requests read line by line from a file over one connection", PLY_COMMAND_OPTION_TYPE_STRING,
                                         NULL);
 
         ply_command_parser_add_command (state.command_parser,
@@ -1073,6 +1557,16 @@ main (int    argc,
                                         (ply_command_handler_t)
                                         on_reload_request, &state, NULL);
 
+        ply_command_parser_add_command (state.command_parser,
+                                        "show-log", "Show a structured boot log",
+                                        (ply_command_handler_t)
+                                        on_show_log_request, &state,
+                                        "file", "The log to show instead of the boot log",
+                                        PLY_COMMAND_OPTION_TYPE_STRING,
+                                        "plain", "Only show console output, as plain text",
+                                        PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        NULL);
+
         if (!ply_command_parser_parse_arguments (state.command_parser, state.loop, argv, argc)) {
                 char *help_string;
 
@@ -1093,6 +1587,8 @@ main (int    argc,
                                         "quit", &should_quit,
                                         "ping", &should_ping,
                                         "has-active-vt", &should_check_for_active_vt,
+                                        "get-stats", &should_get_stats,
+                                        "get-startup-trace", &should_get_startup_trace,
                                         "sysinit", &should_sysinit,
                                         "show-splash", &should_show_splash,
                                         "hide-splash", &should_hide_splash,
@@ -1101,6 +1597,8 @@ main (int    argc,
                                         "update", &status,
                                         "wait", &should_wait,
                                         "details", &report_error,
+                                        "batch", &should_run_batch,
+                                        "batch-file", &batch_file,
                                         NULL);
 
         if (should_help || argc < 2) {
@@ -1128,6 +1626,17 @@ main (int    argc,
                 goto out;
         }
 
+        /* Status updates don't need a reply, so hand them to the daemon's
+         * update socket and only set up a connection if that doesn't work
+         */
+        if (status != NULL &&
+            !should_run_batch && batch_file == NULL &&
+            !should_show_splash && !should_hide_splash && !should_quit &&
+            !should_ping && !should_check_for_active_vt &&
+            !should_get_stats && !should_get_startup_trace &&
+            ply_boot_client_update_daemon_without_reply (state.client, status))
+                goto out;
+
         is_connected = ply_boot_client_connect (state.client,
                                                 (ply_boot_client_disconnect_handler_t)
                                                 on_disconnect, &state);
@@ -1144,6 +1653,16 @@ main (int    argc,
                         exit_code = 1;
                         goto out;
                 }
+                if (should_get_stats) {
+                        ply_trace ("get stats failed");
+                        exit_code = 1;
+                        goto out;
+                }
+                if (should_get_startup_trace) {
+                        ply_trace ("get startup trace failed");
+                        exit_code = 1;
+                        goto out;
+                }
                 if (should_wait) {
                         ply_trace ("no need to wait");
                         goto out;
@@ -1152,7 +1671,13 @@ main (int    argc,
 
         ply_boot_client_attach_to_event_loop (state.client, state.loop);
 
-        if (should_show_splash) {
+        if (should_run_batch || batch_file != NULL) {
+                batch.state = &state;
+                if (!start_batch (&batch, batch_file)) {
+                        exit_code = 1;
+                        goto out;
+                }
+        } else if (should_show_splash) {
                 ply_boot_client_tell_daemon_to_show_splash (state.client,
                                                             (ply_boot_client_response_handler_t)
                                                             on_success,
@@ -1186,6 +1711,18 @@ main (int    argc,
                                                           on_success,
                                                           (ply_boot_client_response_handler_t)
                                                           on_failure, &state);
+        } else if (should_get_stats) {
+                ply_boot_client_ask_daemon_for_stats (state.client,
+                                                      (ply_boot_client_answer_handler_t)
+                                                      on_stats_answer,
+                                                      (ply_boot_client_response_handler_t)
+                                                      on_failure, &state);
+        } else if (should_get_startup_trace) {
+                ply_boot_client_ask_daemon_for_startup_trace (state.client,
+                                                              (ply_boot_client_answer_handler_t)
+                                                              on_stats_answer,
+                                                              (ply_boot_client_response_handler_t)
+                                                              on_failure, &state);
         } else if (status != NULL) {
                 ply_boot_client_update_daemon (state.client, status,
                                                (ply_boot_client_response_handler_t)
@@ -1237,6 +1774,13 @@ main (int    argc,
 out:
         ply_boot_client_free (state.client);
 
+        /* The event loop already dropped the input watch when it exited */
+        if (batch.should_close_fd)
+                close (batch.fd);
+
+        if (batch.input != NULL)
+                ply_buffer_free (batch.input);
+
         ply_event_loop_free (state.loop);
 
         ply_command_parser_free (state.command_parser);
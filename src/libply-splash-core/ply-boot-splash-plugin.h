@@ -65,6 +65,11 @@ typedef struct
                                  ply_text_display_t       *display);
         void (*remove_text_display)(ply_boot_splash_plugin_t *plugin,
                                     ply_text_display_t       *display);
+        /* Optional.  Loads theme assets ahead of show_splash_screen.  It may
+         * run on a thread other than the event loop's, so it must not touch
+         * the loop, displays or keyboards.
+         */
+        bool (*load_assets)(ply_boot_splash_plugin_t *plugin);
         bool (*show_splash_screen)(ply_boot_splash_plugin_t *plugin,
                                    ply_event_loop_t         *loop,
                                    ply_buffer_t             *boot_buffer,
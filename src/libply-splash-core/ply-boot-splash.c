@@ -25,6 +25,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -70,6 +71,17 @@ struct _ply_boot_splash
         ply_boot_splash_on_idle_handler_t         idle_handler;
         void                                     *idle_handler_user_data;
 
+        ply_boot_splash_on_loaded_handler_t       loaded_handler;
+        void                                     *loaded_handler_user_data;
+        ply_buffer_t                             *load_messages;
+        ply_event_loop_t                         *load_loop;
+        ply_fd_watch_t                           *load_watch;
+        pthread_t                                 load_thread;
+        int                                       load_sender_fd;
+        int                                       load_receiver_fd;
+        bool                                      load_succeeded;
+        bool                                      is_loading_in_background;
+
         uint32_t                                  is_loaded : 1;
         uint32_t                                  should_force_text_mode : 1;
 };
@@ -206,12 +218,10 @@ ply_boot_splash_load (ply_boot_splash_t *splash)
 
         get_plugin_interface_function_t get_boot_splash_plugin_interface;
 
-        key_file = ply_key_file_new (splash->theme_path);
+        key_file = ply_key_file_load_cached (splash->theme_path);
 
-        if (!ply_key_file_load (key_file)) {
-                ply_key_file_free (key_file);
+        if (key_file == NULL)
                 return false;
-        }
 
         module_name = ply_key_file_get_value (key_file, "Plymouth Theme", "ModuleName");
 
@@ -223,10 +233,8 @@ ply_boot_splash_load (ply_boot_splash_t *splash)
 
         free (module_path);
 
-        if (splash->module_handle == NULL) {
-                ply_key_file_free (key_file);
+        if (splash->module_handle == NULL)
                 return false;
-        }
 
         get_boot_splash_plugin_interface = (get_plugin_interface_function_t)
                                            ply_module_look_up_function (splash->module_handle,
@@ -236,7 +244,6 @@ ply_boot_splash_load (ply_boot_splash_t *splash)
                 ply_save_errno ();
                 ply_close_module (splash->module_handle);
                 splash->module_handle = NULL;
-                ply_key_file_free (key_file);
                 ply_restore_errno ();
                 return false;
         }
@@ -247,15 +254,12 @@ ply_boot_splash_load (ply_boot_splash_t *splash)
                 ply_save_errno ();
                 ply_close_module (splash->module_handle);
                 splash->module_handle = NULL;
-                ply_key_file_free (key_file);
                 ply_restore_errno ();
                 return false;
         }
 
         splash->plugin = splash->plugin_interface->create_plugin (key_file);
 
-        ply_key_file_free (key_file);
-
         assert (splash->plugin != NULL);
 
         splash->is_loaded = true;
@@ -384,6 +388,140 @@ remove_text_displays (ply_boot_splash_t *splash)
         }
 }
 
+static bool
+ply_boot_splash_load_assets (ply_boot_splash_t *splash)
+{
+        if (splash->plugin_interface->load_assets == NULL)
+                return true;
+
+        return splash->plugin_interface->load_assets (splash->plugin);
+}
+
+static void *
+ply_boot_splash_load_on_thread (ply_boot_splash_t *splash)
+{
+        uint8_t byte = 0;
+
+        /* Only the event loop thread may write to the log directly */
+        ply_logger_redirect_thread_messages (splash->load_messages);
+        splash->load_succeeded = ply_boot_splash_load (splash) &&
+                                 ply_boot_splash_load_assets (splash);
+        ply_logger_redirect_thread_messages (NULL);
+
+        ply_write (splash->load_sender_fd, &byte, sizeof(byte));
+
+        return NULL;
+}
+
+static void
+on_load_loop_exit (ply_boot_splash_t *splash)
+{
+        splash->load_loop = NULL;
+        splash->load_watch = NULL;
+}
+
+static void
+ply_boot_splash_finish_loading_in_background (ply_boot_splash_t *splash)
+{
+        pthread_join (splash->load_thread, NULL);
+        splash->is_loading_in_background = false;
+
+        if (splash->load_loop != NULL) {
+                if (splash->load_watch != NULL)
+                        ply_event_loop_stop_watching_fd (splash->load_loop, splash->load_watch);
+
+                ply_event_loop_stop_watching_for_exit (splash->load_loop, (ply_event_loop_exit_handler_t)
+                                                       on_load_loop_exit,
+                                                       splash);
+                splash->load_loop = NULL;
+        }
+        splash->load_watch = NULL;
+
+        close (splash->load_sender_fd);
+        close (splash->load_receiver_fd);
+
+        if (ply_buffer_get_size (splash->load_messages) > 0)
+                ply_logger_inject_bytes (ply_logger_get_error_default (),
+                                         ply_buffer_get_bytes (splash->load_messages),
+                                         ply_buffer_get_size (splash->load_messages));
+        ply_buffer_free (splash->load_messages);
+        splash->load_messages = NULL;
+}
+
+static void
+on_loaded_in_background (ply_boot_splash_t *splash)
+{
+        ply_boot_splash_on_loaded_handler_t handler;
+        void *user_data;
+
+        handler = splash->loaded_handler;
+        user_data = splash->loaded_handler_user_data;
+        splash->loaded_handler = NULL;
+        splash->loaded_handler_user_data = NULL;
+
+        ply_boot_splash_finish_loading_in_background (splash);
+
+        ply_trace ("splash %s in background",
+                   splash->load_succeeded ? "loaded" : "failed to load");
+
+        handler (user_data, splash->load_succeeded, splash);
+}
+
+static void
+on_load_watch_disconnected (ply_boot_splash_t *splash)
+{
+        splash->load_watch = NULL;
+}
+
+bool
+ply_boot_splash_load_in_background (ply_boot_splash_t                  *splash,
+                                    ply_event_loop_t                   *loop,
+                                    ply_boot_splash_on_loaded_handler_t handler,
+                                    void                               *user_data)
+{
+        assert (splash != NULL);
+        assert (splash->loop == NULL);
+        assert (loop != NULL);
+        assert (handler != NULL);
+        assert (!splash->is_loading_in_background);
+
+        if (!ply_open_unidirectional_pipe (&splash->load_sender_fd,
+                                           &splash->load_receiver_fd))
+                return false;
+
+        splash->load_messages = ply_buffer_new ();
+        splash->loaded_handler = handler;
+        splash->loaded_handler_user_data = user_data;
+
+        if (pthread_create (&splash->load_thread, NULL,
+                            (void *(*)(void *)) ply_boot_splash_load_on_thread,
+                            splash) != 0) {
+                ply_save_errno ();
+                close (splash->load_sender_fd);
+                close (splash->load_receiver_fd);
+                ply_buffer_free (splash->load_messages);
+                splash->load_messages = NULL;
+                ply_restore_errno ();
+                return false;
+        }
+
+        splash->is_loading_in_background = true;
+        splash->load_loop = loop;
+        ply_event_loop_watch_for_exit (loop, (ply_event_loop_exit_handler_t)
+                                       on_load_loop_exit,
+                                       splash);
+        splash->load_watch = ply_event_loop_watch_fd (loop,
+                                                      splash->load_receiver_fd,
+                                                      PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                                      (ply_event_handler_t)
+                                                      on_loaded_in_background,
+                                                      (ply_event_handler_t)
+                                                      on_load_watch_disconnected,
+                                                      splash);
+
+        return true;
+}
+
 void
 ply_boot_splash_free (ply_boot_splash_t *splash)
 {
@@ -391,8 +529,12 @@ ply_boot_splash_free (ply_boot_splash_t *splash)
         if (splash == NULL)
                 return;
 
+        if (splash->is_loading_in_background)
+                ply_boot_splash_finish_loading_in_background (splash);
+
         if (splash->loop != NULL) {
-                if (splash->plugin_interface->on_boot_progress != NULL) {
+                if (splash->plugin_interface != NULL &&
+                    splash->plugin_interface->on_boot_progress != NULL) {
                         ply_event_loop_stop_watching_for_timeout (splash->loop,
                                                                   (ply_event_loop_timeout_handler_t)
                                                                   ply_boot_splash_update_progress, splash);
@@ -441,10 +583,11 @@ ply_boot_splash_update_progress (ply_boot_splash_t *splash)
                                                             time,
                                                             percentage);
 
-        ply_event_loop_watch_for_timeout (splash->loop,
-                                          1.0 / UPDATES_PER_SECOND,
-                                          (ply_event_loop_timeout_handler_t)
-                                          ply_boot_splash_update_progress, splash);
+        ply_event_loop_watch_for_timeout_with_slack (splash->loop,
+                                                     1.0 / UPDATES_PER_SECOND,
+                                                     PLY_EVENT_LOOP_FRAME_SLACK (UPDATES_PER_SECOND),
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     ply_boot_splash_update_progress, splash);
 }
 
 void
@@ -39,6 +39,9 @@
 typedef struct _ply_boot_splash ply_boot_splash_t;
 
 typedef void (*ply_boot_splash_on_idle_handler_t) (void *user_data);
+typedef void (*ply_boot_splash_on_loaded_handler_t) (void              *user_data,
+                                                     bool               is_loaded,
+                                                     ply_boot_splash_t *splash);
 
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
 ply_boot_splash_t *ply_boot_splash_new (const char   *theme_path,
@@ -47,6 +50,14 @@ ply_boot_splash_t *ply_boot_splash_new (const char   *theme_path,
 
 bool ply_boot_splash_load (ply_boot_splash_t *splash);
 bool ply_boot_splash_load_built_in (ply_boot_splash_t *splash);
+/* Loads the theme, plugin and plugin assets on a separate thread, and calls
+ * handler from loop when done.  The splash must not be attached to an event
+ * loop or otherwise used until then, except to free it.
+ */
+bool ply_boot_splash_load_in_background (ply_boot_splash_t                  *splash,
+                                         ply_event_loop_t                   *loop,
+                                         ply_boot_splash_on_loaded_handler_t handler,
+                                         void                               *user_data);
 void ply_boot_splash_unload (ply_boot_splash_t *splash);
 void ply_boot_splash_set_keyboard (ply_boot_splash_t *splash,
                                    ply_keyboard_t    *keyboard);
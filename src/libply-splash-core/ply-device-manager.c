@@ -22,7 +22,10 @@
 #include "ply-renderer.h"
 
 #include <assert.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -37,11 +40,13 @@
 
 #include <xkbcommon/xkbcommon.h>
 
+#include "ply-buffer.h"
 #include "ply-logger.h"
 #include "ply-event-loop.h"
 #include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-key-file.h"
+#include "ply-phase-tracer.h"
 #include "ply-utils.h"
 #include "ply-input-device.h"
 
@@ -49,8 +54,22 @@
 #define SUBSYSTEM_FRAME_BUFFER "graphics"
 #define SUBSYSTEM_INPUT "input"
 
+/* Change events for a card come in storms while its driver loads, and
+ * each one means reprobing every connector.  So the first add or change
+ * event for a device is handled right away, but the ones that follow
+ * within this long are held, and all of them are handled together.
+ */
+#define UDEV_EVENT_DEBOUNCE_TIME 0.05
+
+/* Timeouts must be positive, so the rest of the devices after an early
+ * display are looked for after this short delay
+ */
+#define EARLY_DISPLAY_REMAINING_DEVICES_DELAY 0.001
+
 #ifdef HAVE_UDEV
 static void create_devices_from_udev (ply_device_manager_t *manager);
+static void create_remaining_devices_from_udev (ply_device_manager_t *manager);
+static void schedule_pending_udev_events (ply_device_manager_t *manager);
 #endif
 
 static bool create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
@@ -59,6 +78,9 @@ static bool create_devices_for_terminal_and_renderer_type (ply_device_manager_t
                                                            ply_renderer_type_t   renderer_type);
 static void create_pixel_displays_for_renderer (ply_device_manager_t *manager,
                                                 ply_renderer_t       *renderer);
+static bool add_devices_for_terminal_and_renderer (ply_device_manager_t *manager,
+                                                   ply_terminal_t       *terminal,
+                                                   ply_renderer_t       *renderer);
 
 struct _ply_device_manager
 {
@@ -75,6 +97,16 @@ struct _ply_device_manager
         struct udev                        *udev_context;
         struct udev_monitor                *udev_monitor;
         ply_fd_watch_t                     *fd_watch;
+        ply_list_t                         *pending_udev_events;
+        ply_hashtable_t                    *pending_udev_event_paths;
+        ply_hashtable_t                    *debounced_udev_event_paths;
+        ply_timeout_watch_t                *pending_udev_events_timeout;
+
+        unsigned long                       number_of_udev_events;
+        unsigned long                       number_of_coalesced_udev_events;
+        unsigned long                       number_of_renderer_reprobes;
+        unsigned long                       number_of_renderer_output_changes;
+        unsigned long                       number_of_device_removals;
 
         struct xkb_context                 *xkb_context;
         struct xkb_keymap                  *xkb_keymap;
@@ -99,6 +131,15 @@ struct _ply_device_manager
         uint32_t                            found_fb_device : 1;
 };
 
+typedef struct
+{
+        ply_renderer_t *renderer;
+        ply_buffer_t   *messages;
+        pthread_t       thread;
+        bool            has_thread;
+        bool            is_open;
+} ply_renderer_probe_t;
+
 static void
 detach_from_event_loop (ply_device_manager_t *manager)
 {
@@ -341,10 +382,21 @@ remove_input_device_from_renderers (ply_device_manager_t *manager,
 }
 
 static bool
-verify_drm_device (struct udev_device *device)
+drm_device_is_simpledrm (struct udev_device *device)
 {
         const char *id_path;
 
+        id_path = udev_device_get_property_value (device, "ID_PATH");
+        if (id_path != NULL)
+                return ply_string_has_prefix (id_path, "platform-simple-framebuffer");
+
+        /* Not processed by udevd yet, so look at where it sits in sysfs */
+        return strstr (udev_device_get_syspath (device), "/simple-framebuffer") != NULL;
+}
+
+static bool
+verify_drm_device (struct udev_device *device)
+{
         /*
          * Simple-framebuffer devices driven by simpledrm lack information
          * like panel-rotation info and physical size, causing the splash
@@ -353,8 +405,7 @@ verify_drm_device (struct udev_device *device)
          * To avoid this treat simpledrm devices as fbdev devices and only
          * use them after the timeout.
          */
-        id_path = udev_device_get_property_value (device, "ID_PATH");
-        if (!ply_string_has_prefix (id_path, "platform-simple-framebuffer"))
+        if (!drm_device_is_simpledrm (device))
                 return true; /* Not a SimpleDRM device */
 
         /*
@@ -374,6 +425,29 @@ verify_drm_device (struct udev_device *device)
         return false;
 }
 
+static bool
+should_create_drm_device (ply_device_manager_t *manager,
+                          struct udev_device   *device)
+{
+        if (!manager->device_timeout_elapsed && !verify_drm_device (device)) {
+                ply_trace ("ignoring since we only handle SimpleDRM devices after timeout");
+                return false;
+        }
+
+        return true;
+}
+
+static ply_terminal_t *
+get_terminal_for_new_renderer (ply_device_manager_t *manager)
+{
+        if (!manager->local_console_managed &&
+            manager->local_console_terminal != NULL &&
+            ply_terminal_is_vt (manager->local_console_terminal))
+                return manager->local_console_terminal;
+
+        return NULL;
+}
+
 static bool
 create_devices_for_udev_device (ply_device_manager_t *manager,
                                 struct udev_device   *device)
@@ -396,10 +470,8 @@ create_devices_for_udev_device (ply_device_manager_t *manager,
                 ply_trace ("device subsystem is %s", subsystem);
 
                 if (strcmp (subsystem, SUBSYSTEM_DRM) == 0) {
-                        if (!manager->device_timeout_elapsed && !verify_drm_device (device)) {
-                                ply_trace ("ignoring since we only handle SimpleDRM devices after timeout");
+                        if (!should_create_drm_device (manager, device))
                                 return false;
-                        }
                         ply_trace ("found DRM device %s", device_path);
                         renderer_type = PLY_RENDERER_TYPE_DRM;
                 } else if (strcmp (subsystem, SUBSYSTEM_FRAME_BUFFER) == 0) {
@@ -431,17 +503,9 @@ create_devices_for_udev_device (ply_device_manager_t *manager,
                 }
 
                 if (renderer_type != PLY_RENDERER_TYPE_NONE) {
-                        ply_terminal_t *terminal = NULL;
-
-                        if (!manager->local_console_managed &&
-                            manager->local_console_terminal != NULL &&
-                            ply_terminal_is_vt (manager->local_console_terminal)) {
-                                terminal = manager->local_console_terminal;
-                        }
-
                         created = create_devices_for_terminal_and_renderer_type (manager,
                                                                                  device_path,
-                                                                                 terminal,
+                                                                                 get_terminal_for_new_renderer (manager),
                                                                                  renderer_type);
                         if (created) {
                                 if (renderer_type == PLY_RENDERER_TYPE_DRM)
@@ -455,12 +519,126 @@ create_devices_for_udev_device (ply_device_manager_t *manager,
         return created;
 }
 
+static void *
+probe_renderer_on_thread (ply_renderer_probe_t *probe)
+{
+        /* Only the event loop thread may write to the log directly */
+        ply_logger_redirect_thread_messages (probe->messages);
+        probe->is_open = ply_renderer_open (probe->renderer);
+        ply_logger_redirect_thread_messages (NULL);
+
+        return NULL;
+}
+
+/* Opening a DRM renderer probes every connector on the card, which can
+ * take a while, so when there are several cards each is opened on its own
+ * thread.  The first card gets the console terminal and is opened on this
+ * thread, since terminals belong to the event loop.  Everything else is
+ * done here once all the probes finish, in card order.
+ */
+static bool
+create_devices_for_drm_device_paths (ply_device_manager_t *manager,
+                                     ply_list_t           *device_paths)
+{
+        ply_renderer_probe_t *probes;
+        ply_terminal_t *terminal;
+        ply_list_node_t *node;
+        bool created = false;
+        int i, number_of_probes;
+
+        number_of_probes = ply_list_get_length (device_paths);
+        if (number_of_probes == 0)
+                return false;
+
+        ply_phase_tracer_begin ("probe-drm-devices", NULL);
+
+        terminal = get_terminal_for_new_renderer (manager);
+        probes = calloc (number_of_probes, sizeof(ply_renderer_probe_t));
+
+        i = 0;
+        ply_list_foreach (device_paths, node) {
+                const char *device_path = ply_list_node_get_data (node);
+
+                probes[i].renderer = ply_renderer_new (PLY_RENDERER_TYPE_DRM,
+                                                       device_path,
+                                                       i == 0 ? terminal : NULL);
+                probes[i].messages = ply_buffer_new ();
+
+                if (i > 0) {
+                        probes[i].has_thread = pthread_create (&probes[i].thread, NULL,
+                                                               (void *(*)(void *)) probe_renderer_on_thread,
+                                                               &probes[i]) == 0;
+                }
+                i++;
+        }
+
+        probes[0].is_open = ply_renderer_open (probes[0].renderer);
+
+        for (i = 1; i < number_of_probes; i++) {
+                if (probes[i].has_thread)
+                        pthread_join (probes[i].thread, NULL);
+                else
+                        probes[i].is_open = ply_renderer_open (probes[i].renderer);
+        }
+
+        ply_phase_tracer_end ("probe-drm-devices", NULL);
+
+        for (i = 0; i < number_of_probes; i++) {
+                ply_renderer_t *renderer = probes[i].renderer;
+                char *device_path;
+
+                if (ply_buffer_get_size (probes[i].messages) > 0)
+                        ply_logger_inject_bytes (ply_logger_get_error_default (),
+                                                 ply_buffer_get_bytes (probes[i].messages),
+                                                 ply_buffer_get_size (probes[i].messages));
+                ply_buffer_free (probes[i].messages);
+
+                if (!probes[i].is_open) {
+                        ply_trace ("could not open renderer for %s",
+                                   ply_renderer_get_device_name (renderer));
+                        ply_renderer_free (renderer);
+                        continue;
+                }
+
+                if (i == 0 || terminal == NULL || manager->local_console_managed) {
+                        add_devices_for_terminal_and_renderer (manager,
+                                                               i == 0 ? terminal : NULL,
+                                                               renderer);
+                        manager->found_drm_device = 1;
+                        created = true;
+                        continue;
+                }
+
+                /* The card that had the console didn't work out, so open
+                 * this one again with the console instead
+                 */
+                device_path = strdup (ply_renderer_get_device_name (renderer));
+                ply_renderer_close (renderer);
+                ply_renderer_free (renderer);
+
+                if (create_devices_for_terminal_and_renderer_type (manager,
+                                                                   device_path,
+                                                                   terminal,
+                                                                   PLY_RENDERER_TYPE_DRM)) {
+                        manager->found_drm_device = 1;
+                        created = true;
+                }
+                free (device_path);
+        }
+
+        free (probes);
+
+        return created;
+}
+
 static bool
 create_devices_for_subsystem (ply_device_manager_t *manager,
                               const char           *subsystem)
 {
         struct udev_enumerate *matches;
         struct udev_list_entry *entry;
+        ply_list_t *drm_device_paths = NULL;
+        ply_list_node_t *path_node;
         bool found_device = false;
 
         if (strcmp (subsystem, SUBSYSTEM_INPUT) == 0) {
@@ -479,6 +657,10 @@ create_devices_for_subsystem (ply_device_manager_t *manager,
                    strcmp (subsystem, SUBSYSTEM_FRAME_BUFFER) == 0 ?
                    "frame buffer" :
                    subsystem);
+        ply_phase_tracer_begin ("enumerate-devices", subsystem);
+
+        if (strcmp (subsystem, SUBSYSTEM_DRM) == 0)
+                drm_device_paths = ply_list_new ();
 
         matches = udev_enumerate_new (manager->udev_context);
         udev_enumerate_add_match_subsystem (matches, subsystem);
@@ -507,7 +689,15 @@ create_devices_for_subsystem (ply_device_manager_t *manager,
                         node = udev_device_get_devnode (device);
                         if (node != NULL) {
                                 ply_trace ("found node %s", node);
-                                found_device = create_devices_for_udev_device (manager, device);
+
+                                /* DRM devices get probed together, below */
+                                if (drm_device_paths != NULL) {
+                                        if (!drm_device_in_use (manager, node) &&
+                                            should_create_drm_device (manager, device))
+                                                ply_list_append_data (drm_device_paths, strdup (node));
+                                } else {
+                                        found_device = create_devices_for_udev_device (manager, device);
+                                }
                         }
                 } else {
                         ply_trace ("it's not initialized");
@@ -518,6 +708,17 @@ create_devices_for_subsystem (ply_device_manager_t *manager,
 
         udev_enumerate_unref (matches);
 
+        if (drm_device_paths != NULL) {
+                found_device = create_devices_for_drm_device_paths (manager, drm_device_paths);
+
+                ply_list_foreach (drm_device_paths, path_node) {
+                        free (ply_list_node_get_data (path_node));
+                }
+                ply_list_free (drm_device_paths);
+        }
+
+        ply_phase_tracer_end ("enumerate-devices", subsystem);
+
         return found_device;
 }
 
@@ -544,8 +745,10 @@ on_drm_udev_add_or_change (ply_device_manager_t *manager,
         if (strcmp (action, "change"))
                 return;
 
+        manager->number_of_renderer_reprobes++;
         changed = ply_renderer_handle_change_event (renderer);
         if (changed) {
+                manager->number_of_renderer_output_changes++;
                 free_displays_for_renderer (manager, renderer);
                 create_pixel_displays_for_renderer (manager, renderer);
         }
@@ -579,60 +782,170 @@ verify_add_or_change (ply_device_manager_t *manager,
         return true;
 }
 
-static bool
-duplicate_device_path (ply_list_t *events,
-                       const char *device_path)
+static void
+stop_waiting_for_pending_udev_events (ply_device_manager_t *manager)
 {
-        struct udev_device *device;
-        ply_list_node_t *node;
+        if (manager->pending_udev_events_timeout == NULL)
+                return;
 
-        for (node = ply_list_get_first_node (events);
-             node; node = ply_list_get_next_node (events, node)) {
-                device = ply_list_node_get_data (node);
+        if (manager->loop != NULL)
+                ply_event_loop_stop_watching_timeout (manager->loop,
+                                                      manager->pending_udev_events_timeout);
+        manager->pending_udev_events_timeout = NULL;
+}
 
-                if (strcmp (udev_device_get_devnode (device), device_path) == 0)
-                        return true;
-        }
+static void
+free_debounced_udev_event_path (void *key,
+                                void *data,
+                                void *user_data)
+{
+        free (key);
+}
 
-        return false;
+/* Devices that saw an event in the current window get their next events
+ * held back, until a whole window passes without any.
+ */
+static void
+debounce_udev_event_path (ply_device_manager_t *manager,
+                          const char           *device_path)
+{
+        char *key;
+
+        if (ply_hashtable_lookup (manager->debounced_udev_event_paths, (void *) device_path) != NULL)
+                return;
+
+        key = strdup (device_path);
+        ply_hashtable_insert (manager->debounced_udev_event_paths, key, key);
+}
+
+static void
+stop_debouncing_udev_event_path (ply_device_manager_t *manager,
+                                 const char           *device_path)
+{
+        free (ply_hashtable_remove (manager->debounced_udev_event_paths, (void *) device_path));
+}
+
+static void
+clear_debounced_udev_event_paths (ply_device_manager_t *manager)
+{
+        ply_hashtable_foreach (manager->debounced_udev_event_paths,
+                               free_debounced_udev_event_path,
+                               NULL);
+        ply_hashtable_free (manager->debounced_udev_event_paths);
+        manager->debounced_udev_event_paths = ply_hashtable_new (ply_hashtable_string_hash,
+                                                                 ply_hashtable_string_compare);
 }
 
 static void
-process_udev_add_or_change_events (ply_device_manager_t *manager,
-                                   ply_list_t           *events)
+process_pending_udev_events (ply_device_manager_t *manager)
 {
         const char *action, *device_path;
         struct udev_device *device;
         ply_list_node_t *node;
 
-        while ((node = ply_list_get_first_node (events))) {
+        stop_waiting_for_pending_udev_events (manager);
+
+        while ((node = ply_list_get_first_node (manager->pending_udev_events))) {
                 device = ply_list_node_get_data (node);
                 action = udev_device_get_action (device);
                 device_path = udev_device_get_devnode (device);
 
+                ply_list_remove_node (manager->pending_udev_events, node);
+                ply_hashtable_remove (manager->pending_udev_event_paths, (void *) device_path);
+
+                debounce_udev_event_path (manager, device_path);
                 on_drm_udev_add_or_change (manager, action, device_path, device);
 
-                ply_list_remove_node (events, node);
                 udev_device_unref (device);
         }
+
+        schedule_pending_udev_events (manager);
+}
+
+static void
+on_pending_udev_events_timeout (ply_device_manager_t *manager)
+{
+        manager->pending_udev_events_timeout = NULL;
+
+        clear_debounced_udev_event_paths (manager);
+        process_pending_udev_events (manager);
+}
+
+static void
+schedule_pending_udev_events (ply_device_manager_t *manager)
+{
+        if (manager->pending_udev_events_timeout != NULL)
+                return;
+
+        if (ply_list_get_length (manager->pending_udev_events) == 0 &&
+            ply_hashtable_get_size (manager->debounced_udev_event_paths) == 0)
+                return;
+
+        manager->pending_udev_events_timeout =
+                ply_event_loop_watch_for_timeout (manager->loop,
+                                                  UDEV_EVENT_DEBOUNCE_TIME,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  on_pending_udev_events_timeout,
+                                                  manager);
+}
+
+static void
+queue_udev_event (ply_device_manager_t *manager,
+                  const char           *action,
+                  const char           *device_path,
+                  struct udev_device   *device)
+{
+        if (ply_hashtable_lookup (manager->pending_udev_event_paths, (void *) device_path) != NULL) {
+                ply_trace ("coalescing %s event for device %s", action, device_path);
+                manager->number_of_coalesced_udev_events++;
+                return;
+        }
+
+        if (ply_hashtable_lookup (manager->debounced_udev_event_paths, (void *) device_path) == NULL) {
+                debounce_udev_event_path (manager, device_path);
+                on_drm_udev_add_or_change (manager, action, device_path, device);
+                schedule_pending_udev_events (manager);
+                return;
+        }
+
+        device = udev_device_ref (device);
+        ply_list_append_data (manager->pending_udev_events, device);
+        ply_hashtable_insert (manager->pending_udev_event_paths,
+                              (void *) udev_device_get_devnode (device),
+                              device);
+
+        schedule_pending_udev_events (manager);
 }
 
+static void
+free_pending_udev_events (ply_device_manager_t *manager)
+{
+        ply_list_node_t *node;
+
+        stop_waiting_for_pending_udev_events (manager);
+
+        ply_list_foreach (manager->pending_udev_events, node) {
+                udev_device_unref (ply_list_node_get_data (node));
+        }
+        ply_list_free (manager->pending_udev_events);
+        ply_hashtable_free (manager->pending_udev_event_paths);
+
+        ply_hashtable_foreach (manager->debounced_udev_event_paths,
+                               free_debounced_udev_event_path,
+                               NULL);
+        ply_hashtable_free (manager->debounced_udev_event_paths);
+}
+
+/* Drains every queued event on each wakeup.  Add and change events that
+ * follow another one for the same device wait in the pending queue, see
+ * UDEV_EVENT_DEBOUNCE_TIME.
+ */
 static void
 on_udev_event (ply_device_manager_t *manager)
 {
         const char *action, *device_path;
         struct udev_device *device;
-        ply_list_t *pending_events;
-
-        pending_events = ply_list_new ();
 
-        /*
-         * During the initial monitor/connector enumeration on boot the kernel
-         * fires a large number of change events. If we process these 1 by 1,
-         * we spend a lot of time probing the drm-connectors. So instead we
-         * collect them all and then coalescence them so that if there are multiple
-         * change events pending for a single card, we only re-probe the card once.
-         */
         while ((device = udev_monitor_receive_device (manager->udev_monitor))) {
                 action = udev_device_get_action (device);
                 device_path = udev_device_get_devnode (device);
@@ -641,6 +954,7 @@ on_udev_event (ply_device_manager_t *manager)
                         goto unref;
 
                 ply_trace ("got %s event for device %s", action, device_path);
+                manager->number_of_udev_events++;
 
                 /*
                  * Add/change events before and after a remove may not be
@@ -648,7 +962,9 @@ on_udev_event (ply_device_manager_t *manager)
                  * the remove event immediately.
                  */
                 if (strcmp (action, "remove") == 0) {
-                        process_udev_add_or_change_events (manager, pending_events);
+                        process_pending_udev_events (manager);
+                        stop_debouncing_udev_event_path (manager, device_path);
+                        manager->number_of_device_removals++;
                         free_devices_from_device_path (manager, device_path, true);
                         goto unref;
                 }
@@ -656,19 +972,10 @@ on_udev_event (ply_device_manager_t *manager)
                 if (!verify_add_or_change (manager, action, device_path, device))
                         goto unref;
 
-                if (duplicate_device_path (pending_events, device_path)) {
-                        ply_trace ("ignoring duplicate %s event for device %s", action, device_path);
-                        goto unref;
-                }
-
-                ply_list_append_data (pending_events, udev_device_ref (device));
+                queue_udev_event (manager, action, device_path, device);
 unref:
                 udev_device_unref (device);
         }
-
-        process_udev_add_or_change_events (manager, pending_events);
-
-        ply_list_free (pending_events);
 }
 
 static void
@@ -894,6 +1201,12 @@ ply_device_manager_new (const char                *default_tty,
         manager->flags = flags;
 
 #ifdef HAVE_UDEV
+        manager->pending_udev_events = ply_list_new ();
+        manager->pending_udev_event_paths = ply_hashtable_new (ply_hashtable_string_hash,
+                                                               ply_hashtable_string_compare);
+        manager->debounced_udev_event_paths = ply_hashtable_new (ply_hashtable_string_hash,
+                                                                 ply_hashtable_string_compare);
+
         if (!(flags & PLY_DEVICE_MANAGER_FLAGS_IGNORE_UDEV))
                 manager->udev_context = udev_new ();
 #else
@@ -935,6 +1248,11 @@ ply_device_manager_free (ply_device_manager_t *manager)
         ply_event_loop_stop_watching_for_timeout (manager->loop,
                                                   (ply_event_loop_timeout_handler_t)
                                                   create_devices_from_udev, manager);
+        ply_event_loop_stop_watching_for_timeout (manager->loop,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  create_remaining_devices_from_udev, manager);
+
+        free_pending_udev_events (manager);
 
         if (manager->udev_monitor != NULL)
                 udev_monitor_unref (manager->udev_monitor);
@@ -1080,7 +1398,6 @@ create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
                                                ply_renderer_type_t   renderer_type)
 {
         ply_renderer_t *renderer = NULL;
-        ply_keyboard_t *keyboard = NULL;
 
         if (device_path != NULL)
                 renderer = ply_hashtable_lookup (manager->renderers, (void *) device_path);
@@ -1094,7 +1411,6 @@ create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
                    device_path ? : "", renderer_type, terminal ? ply_terminal_get_name (terminal) : "none");
 
         if (renderer_type != PLY_RENDERER_TYPE_NONE) {
-                ply_renderer_t *old_renderer = NULL;
                 renderer = ply_renderer_new (renderer_type, device_path, terminal);
 
                 if (renderer != NULL && !ply_renderer_open (renderer)) {
@@ -1105,25 +1421,37 @@ create_devices_for_terminal_and_renderer_type (ply_device_manager_t *manager,
                         if (renderer_type != PLY_RENDERER_TYPE_AUTO)
                                 return false;
                 }
+        }
+
+        return add_devices_for_terminal_and_renderer (manager, terminal, renderer);
+}
+
+/* Takes over an opened renderer (or none), and creates the keyboard and
+ * displays that go with it
+ */
+static bool
+add_devices_for_terminal_and_renderer (ply_device_manager_t *manager,
+                                       ply_terminal_t       *terminal,
+                                       ply_renderer_t       *renderer)
+{
+        ply_keyboard_t *keyboard = NULL;
 
-                if (renderer != NULL) {
-                        old_renderer = ply_hashtable_lookup (manager->renderers,
-                                                             (void *) ply_renderer_get_device_name (renderer));
+        if (renderer != NULL) {
+                ply_renderer_t *old_renderer;
 
-                        if (old_renderer != NULL) {
-                                ply_trace ("ignoring device %s since it's already managed",
-                                           ply_renderer_get_device_name (renderer));
-                                ply_renderer_free (renderer);
+                old_renderer = ply_hashtable_lookup (manager->renderers,
+                                                     (void *) ply_renderer_get_device_name (renderer));
 
-                                renderer = NULL;
-                                return true;
-                        }
+                if (old_renderer != NULL) {
+                        ply_trace ("ignoring device %s since it's already managed",
+                                   ply_renderer_get_device_name (renderer));
+                        ply_renderer_free (renderer);
 
-                        add_input_devices_to_renderer (manager, renderer);
+                        return true;
                 }
-        }
 
-        if (renderer != NULL) {
+                add_input_devices_to_renderer (manager, renderer);
+
                 keyboard = ply_keyboard_new_for_renderer (renderer);
                 ply_list_append_data (manager->keyboards, keyboard);
 
@@ -1235,8 +1563,130 @@ create_devices_from_udev (ply_device_manager_t *manager)
         ply_trace ("Creating non-graphical devices, since there's no suitable graphics hardware");
         create_non_graphical_devices (manager);
 }
+
+static bool
+create_early_display_for_card (ply_device_manager_t *manager,
+                               const char           *card_name)
+{
+        struct udev_device *device;
+        ply_terminal_t *terminal = NULL;
+        char device_path[PATH_MAX];
+        bool created;
+
+        device = udev_device_new_from_subsystem_sysname (manager->udev_context,
+                                                         SUBSYSTEM_DRM,
+                                                         card_name);
+        if (device == NULL) {
+                ply_trace ("no drm device named %s", card_name);
+                return false;
+        }
+
+        if (!verify_drm_device (device)) {
+                ply_trace ("not using %s for early display, since it's a SimpleDRM device", card_name);
+                udev_device_unref (device);
+                return false;
+        }
+        udev_device_unref (device);
+
+        if (manager->local_console_terminal != NULL &&
+            ply_terminal_is_vt (manager->local_console_terminal))
+                terminal = manager->local_console_terminal;
+
+        snprintf (device_path, sizeof(device_path), "/dev/dri/%s", card_name);
+        created = create_devices_for_terminal_and_renderer_type (manager,
+                                                                 device_path,
+                                                                 terminal,
+                                                                 PLY_RENDERER_TYPE_DRM);
+        if (created)
+                manager->found_drm_device = 1;
+
+        return created;
+}
+
+static int
+compare_card_names (const struct dirent **a,
+                    const struct dirent **b)
+{
+        return atoi ((*a)->d_name + strlen ("card")) - atoi ((*b)->d_name + strlen ("card"));
+}
+
+static int
+filter_card_names (const struct dirent *entry)
+{
+        return ply_string_has_prefix (entry->d_name, "card");
+}
+
+/* Opens the card named with plymouth.early-display=, or else the first card
+ * in /dev/dri that works, without waiting to enumerate the rest of the
+ * system through udev.
+ */
+static bool
+create_early_display (ply_device_manager_t *manager)
+{
+        struct dirent **entries;
+        char *card_name;
+        bool created = false;
+        int i, number_of_entries;
+
+        ply_phase_tracer_begin ("early-display", NULL);
+
+        card_name = ply_kernel_command_line_get_key_value ("plymouth.early-display=");
+        if (card_name != NULL) {
+                const char *name;
+
+                name = strrchr (card_name, '/');
+                name = name != NULL ? name + 1 : card_name;
+                created = create_early_display_for_card (manager, name);
+                free (card_name);
+
+                ply_phase_tracer_end ("early-display", NULL);
+                return created;
+        }
+
+        number_of_entries = scandir ("/dev/dri", &entries, filter_card_names, compare_card_names);
+        if (number_of_entries < 0) {
+                ply_trace ("could not read /dev/dri: %m");
+                ply_phase_tracer_end ("early-display", NULL);
+                return false;
+        }
+
+        for (i = 0; i < number_of_entries; i++) {
+                if (!created)
+                        created = create_early_display_for_card (manager, entries[i]->d_name);
+                free (entries[i]);
+        }
+        free (entries);
+
+        ply_phase_tracer_end ("early-display", NULL);
+
+        return created;
+}
+
+static void
+create_remaining_devices_from_udev (ply_device_manager_t *manager)
+{
+        if (manager->paused || manager->device_timeout_elapsed)
+                return;
+
+        ply_trace ("looking for the rest of the devices after early display");
+
+        create_devices_for_subsystem (manager, SUBSYSTEM_INPUT);
+        create_devices_for_subsystem (manager, SUBSYSTEM_DRM);
+}
 #endif
 
+static void
+create_offscreen_devices (ply_device_manager_t *manager)
+{
+        if (!create_devices_for_terminal_and_renderer_type (manager,
+                                                            NULL,
+                                                            NULL,
+                                                            PLY_RENDERER_TYPE_OFFSCREEN)) {
+                ply_trace ("Could not create offscreen renderer, creating non-graphical devices");
+                create_non_graphical_devices (manager);
+        }
+}
+
 static void
 create_fallback_devices (ply_device_manager_t *manager)
 {
@@ -1280,6 +1730,12 @@ ply_device_manager_watch_devices (ply_device_manager_t               *manager,
                 return;
         }
 
+        if ((manager->flags & PLY_DEVICE_MANAGER_FLAGS_OFFSCREEN)) {
+                ply_trace ("Creating offscreen devices, since they were explicitly requested");
+                create_offscreen_devices (manager);
+                return;
+        }
+
         if ((manager->flags & PLY_DEVICE_MANAGER_FLAGS_IGNORE_UDEV)) {
                 ply_trace ("udev support disabled, creating fallback devices");
                 create_fallback_devices (manager);
@@ -1288,8 +1744,22 @@ ply_device_manager_watch_devices (ply_device_manager_t               *manager,
 
 #ifdef HAVE_UDEV
         watch_for_udev_events (manager);
-        create_devices_for_subsystem (manager, SUBSYSTEM_INPUT);
-        create_devices_for_subsystem (manager, SUBSYSTEM_DRM);
+
+        /* With early display the splash gets its first head right away, and
+         * everything else is picked up from the next event loop iteration
+         * and hotplugged in like any other device.
+         */
+        if ((manager->flags & PLY_DEVICE_MANAGER_FLAGS_EARLY_DISPLAY) &&
+            create_early_display (manager)) {
+                ply_event_loop_watch_for_timeout (manager->loop,
+                                                  EARLY_DISPLAY_REMAINING_DEVICES_DELAY,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  create_remaining_devices_from_udev, manager);
+        } else {
+                create_devices_for_subsystem (manager, SUBSYSTEM_INPUT);
+                create_devices_for_subsystem (manager, SUBSYSTEM_DRM);
+        }
+
         ply_event_loop_watch_for_timeout (manager->loop,
                                           device_timeout,
                                           (ply_event_loop_timeout_handler_t)
@@ -1316,6 +1786,44 @@ ply_device_manager_get_pixel_displays (ply_device_manager_t *manager)
         return manager->pixel_displays;
 }
 
+char *
+ply_device_manager_get_stats (ply_device_manager_t *manager)
+{
+        ply_buffer_t *buffer;
+        ply_list_node_t *node;
+        char *stats;
+        int index = 0;
+
+        buffer = ply_buffer_new ();
+
+        ply_list_foreach (manager->pixel_displays, node) {
+                ply_pixel_display_t *display = ply_list_node_get_data (node);
+                const char *device_name;
+                char prefix[32];
+
+                snprintf (prefix, sizeof(prefix), "head%d", index);
+
+                device_name = ply_renderer_get_device_name (ply_pixel_display_get_renderer (display));
+                if (device_name != NULL)
+                        ply_buffer_append (buffer, "%s.device=%s\n", prefix, device_name);
+
+                ply_pixel_display_append_stats (display, buffer, prefix);
+                index++;
+        }
+
+        ply_buffer_append (buffer, "heads=%d\n", index);
+        ply_buffer_append (buffer, "udev.events=%lu\n", manager->number_of_udev_events);
+        ply_buffer_append (buffer, "udev.coalesced-events=%lu\n", manager->number_of_coalesced_udev_events);
+        ply_buffer_append (buffer, "udev.renderer-reprobes=%lu\n", manager->number_of_renderer_reprobes);
+        ply_buffer_append (buffer, "udev.renderer-output-changes=%lu\n", manager->number_of_renderer_output_changes);
+        ply_buffer_append (buffer, "udev.device-removals=%lu\n", manager->number_of_device_removals);
+
+        stats = ply_buffer_steal_bytes (buffer);
+        ply_buffer_free (buffer);
+
+        return stats;
+}
+
 ply_list_t *
 ply_device_manager_get_text_displays (ply_device_manager_t *manager)
 {
@@ -1424,6 +1932,7 @@ ply_device_manager_pause (ply_device_manager_t *manager)
         manager->paused = true;
 #ifdef HAVE_UDEV
         stop_watching_for_udev_events (manager);
+        stop_waiting_for_pending_udev_events (manager);
 #endif
 }
 
@@ -1438,5 +1947,6 @@ ply_device_manager_unpause (ply_device_manager_t *manager)
                 create_devices_from_udev (manager);
         }
         watch_for_udev_events (manager);
+        schedule_pending_udev_events (manager);
 #endif
 }
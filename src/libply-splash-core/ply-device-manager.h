@@ -33,7 +33,9 @@ typedef enum
         PLY_DEVICE_MANAGER_FLAGS_IGNORE_SERIAL_CONSOLES = 1 << 0,
         PLY_DEVICE_MANAGER_FLAGS_IGNORE_UDEV            = 1 << 1,
         PLY_DEVICE_MANAGER_FLAGS_SKIP_RENDERERS         = 1 << 2,
-        PLY_DEVICE_MANAGER_FLAGS_FORCE_FRAME_BUFFER     = 1 << 3
+        PLY_DEVICE_MANAGER_FLAGS_FORCE_FRAME_BUFFER     = 1 << 3,
+        PLY_DEVICE_MANAGER_FLAGS_OFFSCREEN              = 1 << 4,
+        PLY_DEVICE_MANAGER_FLAGS_EARLY_DISPLAY          = 1 << 5
 } ply_device_manager_flags_t;
 
 typedef struct _ply_device_manager ply_device_manager_t;
@@ -69,6 +71,10 @@ bool ply_device_manager_has_displays (ply_device_manager_t *manager);
 ply_list_t *ply_device_manager_get_keyboards (ply_device_manager_t *manager);
 ply_list_t *ply_device_manager_get_pixel_displays (ply_device_manager_t *manager);
 ply_list_t *ply_device_manager_get_text_displays (ply_device_manager_t *manager);
+/* Returns frame statistics for every pixel display as newly allocated
+ * key=value lines
+ */
+char *ply_device_manager_get_stats (ply_device_manager_t *manager);
 void ply_device_manager_free (ply_device_manager_t *manager);
 void ply_device_manager_activate_keyboards (ply_device_manager_t *manager);
 void ply_device_manager_deactivate_keyboards (ply_device_manager_t *manager);
@@ -0,0 +1,306 @@
+/* ply-flush-pool.c - worker threads for copying pixels to the screen
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-flush-pool.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ply-logger.h"
+#include "ply-utils.h"
+
+/* Copies smaller than this aren't worth waking up another thread for */
+#define PLY_FLUSH_POOL_MIN_BAND_SIZE (128 * 1024)
+#define PLY_FLUSH_POOL_MAX_THREADS 32
+
+typedef struct
+{
+        ply_flush_pool_batch_t *batch;
+        char                   *destination;
+        unsigned long           destination_row_stride;
+        const char             *source;
+        unsigned long           source_row_stride;
+        unsigned long           row_length;
+        unsigned long           number_of_rows;
+} ply_flush_pool_copy_t;
+
+struct _ply_flush_pool
+{
+        pthread_mutex_t        mutex;
+        pthread_cond_t         copies_queued;
+        pthread_cond_t         copies_finished;
+
+        pthread_t             *workers;
+        int                    number_of_workers;
+
+        ply_flush_pool_copy_t *copies;
+        size_t                 number_of_copies;
+        size_t                 copies_capacity;
+        size_t                 next_copy;
+
+        uint32_t               is_shutting_down : 1;
+};
+
+static ply_flush_pool_t *default_pool;
+static int default_number_of_threads = 1;
+static pthread_mutex_t default_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+run_copy (const ply_flush_pool_copy_t *copy)
+{
+        const char *source = copy->source;
+        char *destination = copy->destination;
+        unsigned long y;
+
+        if (copy->row_length == copy->source_row_stride &&
+            copy->row_length == copy->destination_row_stride) {
+                memcpy (destination, source, copy->row_length * copy->number_of_rows);
+                return;
+        }
+
+        for (y = 0; y < copy->number_of_rows; y++) {
+                memcpy (destination, source, copy->row_length);
+                destination += copy->destination_row_stride;
+                source += copy->source_row_stride;
+        }
+}
+
+/* Must be called with the mutex held, drops it while copying */
+static bool
+run_next_copy_locked (ply_flush_pool_t *pool)
+{
+        ply_flush_pool_copy_t copy;
+
+        if (pool->next_copy >= pool->number_of_copies)
+                return false;
+
+        copy = pool->copies[pool->next_copy];
+        pool->next_copy++;
+
+        /* Everything queued so far has been handed out, so the queue can
+         * start over without disturbing copies still being run
+         */
+        if (pool->next_copy == pool->number_of_copies) {
+                pool->next_copy = 0;
+                pool->number_of_copies = 0;
+        }
+
+        pthread_mutex_unlock (&pool->mutex);
+        run_copy (&copy);
+        pthread_mutex_lock (&pool->mutex);
+
+        copy.batch->number_of_copies_finished++;
+        if (copy.batch->number_of_copies_finished == copy.batch->number_of_copies_queued)
+                pthread_cond_broadcast (&pool->copies_finished);
+
+        return true;
+}
+
+static void *
+ply_flush_pool_worker (void *user_data)
+{
+        ply_flush_pool_t *pool = user_data;
+
+        pthread_mutex_lock (&pool->mutex);
+        while (!pool->is_shutting_down) {
+                if (!run_next_copy_locked (pool))
+                        pthread_cond_wait (&pool->copies_queued, &pool->mutex);
+        }
+        pthread_mutex_unlock (&pool->mutex);
+
+        return NULL;
+}
+
+ply_flush_pool_t *
+ply_flush_pool_new (int number_of_threads)
+{
+        ply_flush_pool_t *pool;
+        int i;
+
+        if (number_of_threads < 1)
+                number_of_threads = 1;
+        else if (number_of_threads > PLY_FLUSH_POOL_MAX_THREADS)
+                number_of_threads = PLY_FLUSH_POOL_MAX_THREADS;
+
+        pool = calloc (1, sizeof(ply_flush_pool_t));
+
+        pthread_mutex_init (&pool->mutex, NULL);
+        pthread_cond_init (&pool->copies_queued, NULL);
+        pthread_cond_init (&pool->copies_finished, NULL);
+
+        pool->workers = calloc (number_of_threads, sizeof(pthread_t));
+        for (i = 0; i < number_of_threads - 1; i++) {
+                if (pthread_create (&pool->workers[pool->number_of_workers], NULL,
+                                    ply_flush_pool_worker, pool) != 0) {
+                        ply_trace ("could not start flush thread: %m");
+                        break;
+                }
+                pool->number_of_workers++;
+        }
+
+        ply_trace ("flushing with %d extra threads", pool->number_of_workers);
+
+        return pool;
+}
+
+void
+ply_flush_pool_free (ply_flush_pool_t *pool)
+{
+        int i;
+
+        if (pool == NULL)
+                return;
+
+        pthread_mutex_lock (&default_pool_mutex);
+        if (pool == default_pool)
+                default_pool = NULL;
+        pthread_mutex_unlock (&default_pool_mutex);
+
+        /* Copies the workers already picked up finish before they
+         * notice is_shutting_down, run the rest here
+         */
+        pthread_mutex_lock (&pool->mutex);
+        while (run_next_copy_locked (pool)) {
+        }
+        pool->is_shutting_down = true;
+        pthread_cond_broadcast (&pool->copies_queued);
+        pthread_mutex_unlock (&pool->mutex);
+
+        for (i = 0; i < pool->number_of_workers; i++) {
+                pthread_join (pool->workers[i], NULL);
+        }
+
+        pthread_cond_destroy (&pool->copies_finished);
+        pthread_cond_destroy (&pool->copies_queued);
+        pthread_mutex_destroy (&pool->mutex);
+
+        free (pool->copies);
+        free (pool->workers);
+        free (pool);
+}
+
+int
+ply_flush_pool_get_number_of_threads (ply_flush_pool_t *pool)
+{
+        return pool->number_of_workers + 1;
+}
+
+static void
+ply_flush_pool_add_copy_locked (ply_flush_pool_t            *pool,
+                                const ply_flush_pool_copy_t *copy)
+{
+        if (pool->number_of_copies == pool->copies_capacity) {
+                pool->copies_capacity = MAX (pool->copies_capacity * 2, 16);
+                pool->copies = realloc (pool->copies,
+                                        pool->copies_capacity * sizeof(ply_flush_pool_copy_t));
+        }
+
+        pool->copies[pool->number_of_copies] = *copy;
+        pool->number_of_copies++;
+}
+
+void
+ply_flush_pool_queue_copy (ply_flush_pool_t       *pool,
+                           ply_flush_pool_batch_t *batch,
+                           char                   *destination,
+                           unsigned long           destination_row_stride,
+                           const char             *source,
+                           unsigned long           source_row_stride,
+                           unsigned long           row_length,
+                           unsigned long           number_of_rows)
+{
+        ply_flush_pool_copy_t copy;
+        unsigned long number_of_bands, rows_per_band, y;
+
+        assert (pool != NULL);
+        assert (batch != NULL);
+
+        if (row_length == 0 || number_of_rows == 0)
+                return;
+
+        number_of_bands = (row_length * number_of_rows) / PLY_FLUSH_POOL_MIN_BAND_SIZE;
+        number_of_bands = CLAMP (number_of_bands, 1, (unsigned long) pool->number_of_workers + 1);
+        number_of_bands = MIN (number_of_bands, number_of_rows);
+        rows_per_band = (number_of_rows + number_of_bands - 1) / number_of_bands;
+
+        copy.batch = batch;
+        copy.destination_row_stride = destination_row_stride;
+        copy.source_row_stride = source_row_stride;
+        copy.row_length = row_length;
+
+        pthread_mutex_lock (&pool->mutex);
+        for (y = 0; y < number_of_rows; y += rows_per_band) {
+                copy.destination = destination + y * destination_row_stride;
+                copy.source = source + y * source_row_stride;
+                copy.number_of_rows = MIN (rows_per_band, number_of_rows - y);
+
+                ply_flush_pool_add_copy_locked (pool, &copy);
+                batch->number_of_copies_queued++;
+        }
+        pthread_cond_broadcast (&pool->copies_queued);
+        pthread_mutex_unlock (&pool->mutex);
+}
+
+void
+ply_flush_pool_wait (ply_flush_pool_t       *pool,
+                     ply_flush_pool_batch_t *batch)
+{
+        assert (pool != NULL);
+        assert (batch != NULL);
+
+        pthread_mutex_lock (&pool->mutex);
+
+        /* Help out instead of sitting idle, even with other callers' copies */
+        while (batch->number_of_copies_finished < batch->number_of_copies_queued &&
+               run_next_copy_locked (pool)) {
+        }
+
+        while (batch->number_of_copies_finished < batch->number_of_copies_queued) {
+                pthread_cond_wait (&pool->copies_finished, &pool->mutex);
+        }
+
+        batch->number_of_copies_queued = 0;
+        batch->number_of_copies_finished = 0;
+
+        pthread_mutex_unlock (&pool->mutex);
+}
+
+ply_flush_pool_t *
+ply_flush_pool_get_default (void)
+{
+        ply_flush_pool_t *pool;
+
+        /* Renderers may be created on device probing threads */
+        pthread_mutex_lock (&default_pool_mutex);
+        if (default_pool == NULL && default_number_of_threads > 1)
+                default_pool = ply_flush_pool_new (default_number_of_threads);
+        pool = default_pool;
+        pthread_mutex_unlock (&default_pool_mutex);
+
+        return pool;
+}
+
+void
+ply_flush_pool_set_default_number_of_threads (int number_of_threads)
+{
+        default_number_of_threads = number_of_threads;
+}
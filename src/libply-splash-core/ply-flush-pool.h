@@ -0,0 +1,70 @@
+/* ply-flush-pool.h - worker threads for copying pixels to the screen
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_FLUSH_POOL_H
+#define PLY_FLUSH_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _ply_flush_pool ply_flush_pool_t;
+
+/* Tracks the copies one caller queued, so it only waits for its own.
+ * Start it out zeroed, it can be reused once ply_flush_pool_wait ()
+ * returns.
+ */
+typedef struct
+{
+        unsigned long number_of_copies_queued;
+        unsigned long number_of_copies_finished;
+} ply_flush_pool_batch_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_flush_pool_t *ply_flush_pool_new (int number_of_threads);
+void ply_flush_pool_free (ply_flush_pool_t *pool);
+
+/* The calling thread counts as one of the threads, so a pool with
+ * one thread copies everything synchronously from ply_flush_pool_wait ()
+ */
+int ply_flush_pool_get_number_of_threads (ply_flush_pool_t *pool);
+
+/* Queues a copy of number_of_rows rows of row_length bytes each as part
+ * of batch.  Large copies get split into bands of rows that are handed out
+ * to different threads.  Neither buffer may be touched until
+ * ply_flush_pool_wait () returns for the batch.
+ */
+void ply_flush_pool_queue_copy (ply_flush_pool_t       *pool,
+                                ply_flush_pool_batch_t *batch,
+                                char                   *destination,
+                                unsigned long           destination_row_stride,
+                                const char             *source,
+                                unsigned long           source_row_stride,
+                                unsigned long           row_length,
+                                unsigned long           number_of_rows);
+void ply_flush_pool_wait (ply_flush_pool_t       *pool,
+                          ply_flush_pool_batch_t *batch);
+
+/* Returns NULL unless more than one thread was requested with
+ * ply_flush_pool_set_default_number_of_threads ()
+ */
+ply_flush_pool_t *ply_flush_pool_get_default (void);
+void ply_flush_pool_set_default_number_of_threads (int number_of_threads);
+#endif
+
+#endif /* PLY_FLUSH_POOL_H */
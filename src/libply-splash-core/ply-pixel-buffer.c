@@ -48,9 +48,16 @@ struct _ply_pixel_buffer
         ply_list_t                 *clip_areas;    /* in device pixels */
 
         ply_region_t               *updated_areas; /* in device pixels */
+        unsigned long long          number_of_pixels_blended;
+        unsigned long long          number_of_pixels_filled;
         uint32_t                    is_opaque : 1;
         int                         device_scale;
 
+        uint32_t                   *gradient_rows; /* dithered pattern for each row */
+        uint32_t                    gradient_start;
+        uint32_t                    gradient_end;
+        unsigned long               gradient_height;
+
         ply_pixel_buffer_rotation_t device_rotation;
 };
 
@@ -320,6 +327,22 @@ ply_pixel_buffer_fill_area_with_pixel_value (ply_pixel_buffer_t *buffer,
                 buffer->is_opaque = true;
         }
 
+        /* Opaque colors replace what's there, so there's nothing to blend */
+        if ((pixel_value >> 24) == 0xff &&
+            buffer->device_rotation == PLY_PIXEL_BUFFER_ROTATE_UPRIGHT) {
+                for (row = cropped_area.y; row < cropped_area.y + cropped_area.height; row++) {
+                        uint32_t *bytes = &buffer->bytes[row * buffer->area.width];
+
+                        for (column = cropped_area.x; column < cropped_area.x + cropped_area.width; column++) {
+                                bytes[column] = pixel_value;
+                        }
+                }
+
+                buffer->number_of_pixels_filled += (unsigned long long) cropped_area.width * cropped_area.height;
+                ply_pixel_buffer_add_updated_area (buffer, &cropped_area);
+                return;
+        }
+
         for (row = cropped_area.y; row < cropped_area.y + cropped_area.height; row++) {
                 for (column = cropped_area.x; column < cropped_area.x + cropped_area.width; column++) {
                         ply_pixel_buffer_blend_value_at_pixel (buffer,
@@ -328,6 +351,7 @@ ply_pixel_buffer_fill_area_with_pixel_value (ply_pixel_buffer_t *buffer,
                 }
         }
 
+        buffer->number_of_pixels_blended += (unsigned long long) cropped_area.width * cropped_area.height;
         ply_pixel_buffer_add_updated_area (buffer, &cropped_area);
 }
 
@@ -412,6 +436,7 @@ ply_pixel_buffer_free (ply_pixel_buffer_t *buffer)
                 return;
 
         free_clip_areas (buffer);
+        free (buffer->gradient_rows);
         free (buffer->bytes);
         ply_region_free (buffer->updated_areas);
         free (buffer);
@@ -462,11 +487,28 @@ ply_pixel_buffer_get_updated_areas (ply_pixel_buffer_t *buffer)
         return buffer->updated_areas;
 }
 
-void
-ply_pixel_buffer_fill_with_gradient (ply_pixel_buffer_t *buffer,
-                                     ply_rectangle_t    *fill_area,
-                                     uint32_t            start,
-                                     uint32_t            end)
+unsigned long long
+ply_pixel_buffer_get_number_of_pixels_blended (ply_pixel_buffer_t *buffer)
+{
+        return buffer->number_of_pixels_blended;
+}
+
+unsigned long long
+ply_pixel_buffer_get_number_of_pixels_filled (ply_pixel_buffer_t *buffer)
+{
+        return buffer->number_of_pixels_filled;
+}
+
+#define GRADIENT_PATTERN_WIDTH 8
+
+/* Returns GRADIENT_PATTERN_WIDTH dithered pixels for every row of the
+ * buffer.  They only depend on the color stops and the buffer height, so
+ * they are computed once and reused for every area filled afterward.
+ */
+static const uint32_t *
+ply_pixel_buffer_get_gradient_rows (ply_pixel_buffer_t *buffer,
+                                    uint32_t            start,
+                                    uint32_t            end)
 {
 /* The gradient produced is a linear interpolation of the two passed
  * in color stops: start and end.
@@ -511,18 +553,25 @@ ply_pixel_buffer_fill_with_gradient (ply_pixel_buffer_t *buffer,
  */
 #define COLOR_MASK (0xff << (24 - NOISE_BITS))
 
-        uint32_t red, green, blue, red_step, green_step, blue_step, t, pixel;
+        uint32_t red, green, blue, red_step, green_step, blue_step, t;
+        uint32_t *pattern;
         uint32_t x, y;
         /* we use a fixed seed so that the dithering doesn't change on repaints
          * of the same area.
          */
         uint32_t noise = 0x100001;
-        ply_rectangle_t cropped_area;
 
-        if (fill_area == NULL)
-                fill_area = &buffer->logical_area;
+        if (buffer->gradient_rows != NULL &&
+            buffer->gradient_start == start &&
+            buffer->gradient_end == end &&
+            buffer->gradient_height == buffer->area.height)
+                return buffer->gradient_rows;
 
-        ply_pixel_buffer_crop_area_to_clip_area (buffer, fill_area, &cropped_area);
+        free (buffer->gradient_rows);
+        buffer->gradient_rows = malloc (buffer->area.height * GRADIENT_PATTERN_WIDTH * sizeof(uint32_t));
+        buffer->gradient_start = start;
+        buffer->gradient_end = end;
+        buffer->gradient_height = buffer->area.height;
 
         red = (start << RED_SHIFT) & COLOR_MASK;
         green = (start << GREEN_SHIFT) & COLOR_MASK;
@@ -535,50 +584,75 @@ ply_pixel_buffer_fill_with_gradient (ply_pixel_buffer_t *buffer,
         t = (end << BLUE_SHIFT) & COLOR_MASK;
         blue_step = (int32_t) (t - blue) / (int32_t) buffer->area.height;
 
-
 #define RANDOMIZE(num) (num = (num + (num << 1)) & NOISE_MASK)
-#define UNROLLED_PIXEL_COUNT 8
-
-        for (y = buffer->area.y; y < buffer->area.y + buffer->area.height; y++) {
-                if (cropped_area.y <= y && y < cropped_area.y + cropped_area.height) {
-                        if (cropped_area.width < UNROLLED_PIXEL_COUNT || buffer->device_rotation) {
-                                for (x = cropped_area.x; x < cropped_area.x + cropped_area.width; x++) {
-                                        pixel = 0xff000000;
-                                        RANDOMIZE (noise);
-                                        pixel |= (((red + noise) & COLOR_MASK) >> RED_SHIFT);
-                                        RANDOMIZE (noise);
-                                        pixel |= (((green + noise) & COLOR_MASK) >> GREEN_SHIFT);
-                                        RANDOMIZE (noise);
-                                        pixel |= (((blue + noise) & COLOR_MASK) >> BLUE_SHIFT);
-
-                                        ply_pixel_buffer_set_pixel (buffer, x, y, pixel);
-                                }
-                        } else {
-                                uint32_t shaded_set[UNROLLED_PIXEL_COUNT];
-                                uint32_t *ptr = &buffer->bytes[y * buffer->area.width + cropped_area.x];
-                                for (x = 0; x < UNROLLED_PIXEL_COUNT; x++) {
-                                        shaded_set[x] = 0xff000000;
-                                        RANDOMIZE (noise);
-                                        shaded_set[x] |= (((red + noise) & COLOR_MASK) >> RED_SHIFT);
-                                        RANDOMIZE (noise);
-                                        shaded_set[x] |= (((green + noise) & COLOR_MASK) >> GREEN_SHIFT);
-                                        RANDOMIZE (noise);
-                                        shaded_set[x] |= (((blue + noise) & COLOR_MASK) >> BLUE_SHIFT);
-                                }
-                                for (x = cropped_area.width; x >= UNROLLED_PIXEL_COUNT; x -= UNROLLED_PIXEL_COUNT) {
-                                        memcpy (ptr, (void *) shaded_set, UNROLLED_PIXEL_COUNT * sizeof(uint32_t));
-                                        ptr += UNROLLED_PIXEL_COUNT;
-                                }
 
-                                memcpy (ptr, (void *) shaded_set, x * sizeof(uint32_t));
-                        }
+        pattern = buffer->gradient_rows;
+        for (y = 0; y < buffer->area.height; y++) {
+                for (x = 0; x < GRADIENT_PATTERN_WIDTH; x++) {
+                        pattern[x] = 0xff000000;
+                        RANDOMIZE (noise);
+                        pattern[x] |= (((red + noise) & COLOR_MASK) >> RED_SHIFT);
+                        RANDOMIZE (noise);
+                        pattern[x] |= (((green + noise) & COLOR_MASK) >> GREEN_SHIFT);
+                        RANDOMIZE (noise);
+                        pattern[x] |= (((blue + noise) & COLOR_MASK) >> BLUE_SHIFT);
                 }
+                pattern += GRADIENT_PATTERN_WIDTH;
 
                 red += red_step;
                 green += green_step;
                 blue += blue_step;
         }
 
+        return buffer->gradient_rows;
+}
+
+void
+ply_pixel_buffer_fill_with_gradient (ply_pixel_buffer_t *buffer,
+                                     ply_rectangle_t    *fill_area,
+                                     uint32_t            start,
+                                     uint32_t            end)
+{
+        const uint32_t *gradient_rows;
+        uint32_t x, y;
+        ply_rectangle_t cropped_area;
+
+        if (fill_area == NULL)
+                fill_area = &buffer->logical_area;
+
+        ply_pixel_buffer_crop_area_to_clip_area (buffer, fill_area, &cropped_area);
+
+        if (buffer->area.height == 0)
+                return;
+
+        gradient_rows = ply_pixel_buffer_get_gradient_rows (buffer, start, end);
+
+        /* Every pixel of a gradient is opaque, so filling all of the buffer
+         * lets it get copied instead of blended later
+         */
+        if (memcmp (&cropped_area, &buffer->area, sizeof(ply_rectangle_t)) == 0)
+                buffer->is_opaque = true;
+
+        /* The pattern is lined up on absolute columns so that filling part of
+         * the buffer gives the same pixels as filling all of it
+         */
+        for (y = cropped_area.y; y < cropped_area.y + cropped_area.height; y++) {
+                const uint32_t *pattern = gradient_rows + y * GRADIENT_PATTERN_WIDTH;
+
+                if (buffer->device_rotation) {
+                        for (x = cropped_area.x; x < cropped_area.x + cropped_area.width; x++) {
+                                ply_pixel_buffer_set_pixel (buffer, x, y,
+                                                            pattern[x % GRADIENT_PATTERN_WIDTH]);
+                        }
+                } else {
+                        uint32_t *bytes = &buffer->bytes[y * buffer->area.width];
+
+                        for (x = cropped_area.x; x < cropped_area.x + cropped_area.width; x++) {
+                                bytes[x] = pattern[x % GRADIENT_PATTERN_WIDTH];
+                        }
+                }
+        }
+
         ply_pixel_buffer_add_updated_area (buffer, &cropped_area);
 }
 
@@ -772,6 +846,7 @@ ply_pixel_buffer_fill_with_argb32_data_at_opacity_with_clip_and_scale (ply_pixel
                 }
         }
 
+        buffer->number_of_pixels_blended += (unsigned long long) cropped_area.width * cropped_area.height;
         ply_pixel_buffer_add_updated_area (buffer, &cropped_area);
 }
 
@@ -947,20 +1022,227 @@ ply_pixel_buffer_get_argb32_data (ply_pixel_buffer_t *buffer)
         return buffer->bytes;
 }
 
+/* Linearly interpolates between two premultiplied pixels, two channels at
+ * a time.  weight is in 1/256ths, so every product fits in the 16 bits
+ * each channel gets.
+ */
 static inline uint32_t
-ply_pixel_buffer_interpolate (ply_pixel_buffer_t *buffer,
-                              double              x,
-                              double              y)
+ply_pixels_lerp (uint32_t pixel_value_1,
+                 uint32_t pixel_value_2,
+                 uint32_t weight)
 {
-        int width;
-        int height;
+        uint32_t inverse_weight = 256 - weight;
+        uint32_t red_and_blue, alpha_and_green;
+
+        red_and_blue = (pixel_value_1 & 0x00ff00ff) * inverse_weight +
+                       (pixel_value_2 & 0x00ff00ff) * weight;
+        alpha_and_green = ((pixel_value_1 >> 8) & 0x00ff00ff) * inverse_weight +
+                          ((pixel_value_2 >> 8) & 0x00ff00ff) * weight;
+
+        return ((red_and_blue >> 8) & 0x00ff00ff) | (alpha_and_green & 0xff00ff00);
+}
+
+/* x and y are non-negative 16.16 fixed point coordinates */
+static inline uint32_t
+ply_pixels_interpolate_fixed (const uint32_t *bytes,
+                              int             width,
+                              int             height,
+                              int64_t         x,
+                              int64_t         y)
+{
+        const uint32_t *row_1, *row_2;
+        int x1, x2, y1, y2;
+        uint32_t x_weight, y_weight;
+
+        x1 = MIN (x >> 16, width - 1);
+        y1 = MIN (y >> 16, height - 1);
+        x2 = MIN (x1 + 1, width - 1);
+        y2 = MIN (y1 + 1, height - 1);
+        x_weight = (x >> 8) & 0xff;
+        y_weight = (y >> 8) & 0xff;
+
+        row_1 = bytes + y1 * width;
+        row_2 = bytes + y2 * width;
+
+        return ply_pixels_lerp (ply_pixels_lerp (row_1[x1], row_1[x2], x_weight),
+                                ply_pixels_lerp (row_2[x1], row_2[x2], x_weight),
+                                y_weight);
+}
+
+static void
+ply_pixels_resample_row (const uint32_t *source_row,
+                         int             source_width,
+                         const int      *columns,
+                         const uint32_t *column_weights,
+                         uint32_t       *row,
+                         int             width)
+{
+        int x;
+
+        for (x = 0; x < width; x++) {
+                int column = columns[x];
+
+                row[x] = ply_pixels_lerp (source_row[column],
+                                          source_row[MIN (column + 1, source_width - 1)],
+                                          column_weights[x]);
+        }
+}
+
+/* Bilinear resampling done as two passes: each source row that's needed
+ * gets resampled horizontally once, and output rows are blended from the
+ * two cached source rows around them.
+ */
+static void
+ply_pixel_buffer_resize_bilinear (ply_pixel_buffer_t *old_buffer,
+                                  ply_pixel_buffer_t *buffer)
+{
+        const uint32_t *old_bytes;
         uint32_t *bytes;
+        int old_width, old_height, width, height;
+        int64_t step_x, step_y;
+        int *columns;
+        uint32_t *column_weights;
+        uint32_t *rows[2];
+        int row_sources[2] = { -1, -1 };
+        int x, y;
 
+        old_bytes = old_buffer->bytes;
+        old_width = old_buffer->area.width;
+        old_height = old_buffer->area.height;
+        bytes = buffer->bytes;
         width = buffer->area.width;
         height = buffer->area.height;
-        bytes = ply_pixel_buffer_get_argb32_data (buffer);
 
-        return ply_pixels_interpolate (bytes, width, height, x, y);
+        step_x = ((int64_t) (old_width - 1) << 16) / MAX (width - 1, 1);
+        step_y = ((int64_t) (old_height - 1) << 16) / MAX (height - 1, 1);
+
+        columns = malloc (width * sizeof(int));
+        column_weights = malloc (width * sizeof(uint32_t));
+        rows[0] = malloc (width * sizeof(uint32_t));
+        rows[1] = malloc (width * sizeof(uint32_t));
+
+        for (x = 0; x < width; x++) {
+                int64_t position = x * step_x;
+
+                columns[x] = position >> 16;
+                column_weights[x] = (position >> 8) & 0xff;
+        }
+
+        for (y = 0; y < height; y++) {
+                int64_t position = y * step_y;
+                int source_rows[2];
+                uint32_t row_weight;
+                int i;
+
+                source_rows[0] = position >> 16;
+                source_rows[1] = MIN (source_rows[0] + 1, old_height - 1);
+                row_weight = (position >> 8) & 0xff;
+
+                /* When upscaling, the bottom row of this line is usually
+                 * the top row of the next one
+                 */
+                if (row_sources[1] == source_rows[0]) {
+                        uint32_t *row = rows[0];
+
+                        rows[0] = rows[1];
+                        rows[1] = row;
+                        row_sources[0] = row_sources[1];
+                        row_sources[1] = -1;
+                }
+
+                for (i = 0; i < 2; i++) {
+                        if (row_sources[i] == source_rows[i])
+                                continue;
+
+                        ply_pixels_resample_row (old_bytes + source_rows[i] * old_width,
+                                                 old_width, columns, column_weights,
+                                                 rows[i], width);
+                        row_sources[i] = source_rows[i];
+                }
+
+                for (x = 0; x < width; x++) {
+                        bytes[x + y * width] = ply_pixels_lerp (rows[0][x], rows[1][x],
+                                                                row_weight);
+                }
+        }
+
+        free (rows[1]);
+        free (rows[0]);
+        free (column_weights);
+        free (columns);
+}
+
+/* Averages every source pixel that lands in each destination pixel.
+ * Bilinear sampling skips most of the source when shrinking by more than
+ * half, which makes large downscales alias.
+ */
+static void
+ply_pixel_buffer_resize_box (ply_pixel_buffer_t *old_buffer,
+                             ply_pixel_buffer_t *buffer)
+{
+        const uint32_t *old_bytes;
+        uint32_t *bytes;
+        int old_width, old_height, width, height;
+        int *first_columns;
+        uint64_t *sums;
+        int x, y;
+
+        old_bytes = old_buffer->bytes;
+        old_width = old_buffer->area.width;
+        old_height = old_buffer->area.height;
+        bytes = buffer->bytes;
+        width = buffer->area.width;
+        height = buffer->area.height;
+
+        first_columns = malloc ((width + 1) * sizeof(int));
+        sums = malloc (width * 4 * sizeof(uint64_t));
+
+        for (x = 0; x <= width; x++) {
+                first_columns[x] = ((int64_t) x * old_width) / width;
+        }
+
+        for (y = 0; y < height; y++) {
+                int first_row, last_row, old_y;
+
+                first_row = ((int64_t) y * old_height) / height;
+                last_row = ((int64_t) (y + 1) * old_height) / height;
+
+                memset (sums, 0, width * 4 * sizeof(uint64_t));
+
+                for (old_y = first_row; old_y < last_row; old_y++) {
+                        const uint32_t *old_row = old_bytes + old_y * old_width;
+
+                        for (x = 0; x < width; x++) {
+                                uint64_t *sum = sums + x * 4;
+                                int old_x;
+
+                                for (old_x = first_columns[x]; old_x < first_columns[x + 1]; old_x++) {
+                                        uint32_t pixel_value = old_row[old_x];
+
+                                        sum[0] += pixel_value >> 24;
+                                        sum[1] += (pixel_value >> 16) & 0xff;
+                                        sum[2] += (pixel_value >> 8) & 0xff;
+                                        sum[3] += pixel_value & 0xff;
+                                }
+                        }
+                }
+
+                for (x = 0; x < width; x++) {
+                        uint64_t *sum = sums + x * 4;
+                        uint64_t count;
+
+                        count = (uint64_t) (first_columns[x + 1] - first_columns[x]) *
+                                (last_row - first_row);
+
+                        bytes[x + y * width] = (((sum[0] + count / 2) / count) << 24) |
+                                               (((sum[1] + count / 2) / count) << 16) |
+                                               (((sum[2] + count / 2) / count) << 8) |
+                                               ((sum[3] + count / 2) / count);
+                }
+        }
+
+        free (sums);
+        free (first_columns);
 }
 
 ply_pixel_buffer_t *
@@ -969,31 +1251,89 @@ ply_pixel_buffer_resize (ply_pixel_buffer_t *old_buffer,
                          long                height)
 {
         ply_pixel_buffer_t *buffer;
-        int x, y;
-        double old_x, old_y;
-        int old_width, old_height;
-        double scale_x, scale_y;
-        uint32_t *bytes;
 
         buffer = ply_pixel_buffer_new (width, height);
 
-        bytes = ply_pixel_buffer_get_argb32_data (buffer);
+        if (width <= 0 || height <= 0 ||
+            old_buffer->area.width == 0 || old_buffer->area.height == 0)
+                return buffer;
 
-        old_width = old_buffer->area.width;
-        old_height = old_buffer->area.height;
+        if (old_buffer->area.width >= 2 * (unsigned long) width &&
+            old_buffer->area.height >= 2 * (unsigned long) height)
+                ply_pixel_buffer_resize_box (old_buffer, buffer);
+        else
+                ply_pixel_buffer_resize_bilinear (old_buffer, buffer);
+
+        return buffer;
+}
+
+/* Rotations by a multiple of a quarter turn map pixels onto pixels, so
+ * they can be moved across without sampling.  Returns false if
+ * theta_offset isn't close enough to one for that to be exact.
+ */
+static bool
+ply_pixel_buffer_rotate_by_quarter_turns (ply_pixel_buffer_t *old_buffer,
+                                          ply_pixel_buffer_t *buffer,
+                                          long                center_x,
+                                          long                center_y,
+                                          double              theta_offset)
+{
+        const uint32_t *old_bytes;
+        uint32_t *bytes;
+        long width, height;
+        long quarter_turns;
+        long cos_theta, sin_theta;
+        long x, y;
 
-        scale_x = ((double) old_width - 1) / MAX (width - 1, 1);
-        scale_y = ((double) old_height - 1) / MAX (height - 1, 1);
+        width = old_buffer->area.width;
+        height = old_buffer->area.height;
+
+        quarter_turns = lround (theta_offset / M_PI_2);
+
+        /* Only take the fast path if the sampled version wouldn't drift
+         * by a visible fraction of a pixel across the image
+         */
+        if (fabs (theta_offset - quarter_turns * M_PI_2) * MAX (width, height) >= 1.0 / 256)
+                return false;
+
+        switch (((quarter_turns % 4) + 4) % 4) {
+        case 0:
+                cos_theta = 1;
+                sin_theta = 0;
+                break;
+        case 1:
+                cos_theta = 0;
+                sin_theta = -1;
+                break;
+        case 2:
+                cos_theta = -1;
+                sin_theta = 0;
+                break;
+        default:
+                cos_theta = 0;
+                sin_theta = 1;
+                break;
+        }
+
+        old_bytes = old_buffer->bytes;
+        bytes = buffer->bytes;
 
         for (y = 0; y < height; y++) {
-                old_y = y * scale_y;
                 for (x = 0; x < width; x++) {
-                        old_x = x * scale_x;
-                        bytes[x + y * width] =
-                                ply_pixel_buffer_interpolate (old_buffer, old_x, old_y);
+                        long old_x, old_y;
+
+                        old_x = center_x + cos_theta * (x - center_x) - sin_theta * (y - center_y);
+                        old_y = center_y + sin_theta * (x - center_x) + cos_theta * (y - center_y);
+
+                        if (old_x < 0 || old_x > width || old_y < 0 || old_y > height)
+                                bytes[x + y * width] = 0;
+                        else
+                                bytes[x + y * width] = old_bytes[MIN (old_x, width - 1) +
+                                                                 MIN (old_y, height - 1) * width];
                 }
         }
-        return buffer;
+
+        return true;
 }
 
 ply_pixel_buffer_t *
@@ -1003,38 +1343,55 @@ ply_pixel_buffer_rotate (ply_pixel_buffer_t *old_buffer,
                          double              theta_offset)
 {
         ply_pixel_buffer_t *buffer;
+        const uint32_t *old_bytes;
         int x, y;
-        double old_x, old_y;
         int width;
         int height;
         uint32_t *bytes;
+        int64_t max_x, max_y;
+        int64_t step_x, step_y;
+        double cos_theta, sin_theta;
 
         width = old_buffer->area.width;
         height = old_buffer->area.height;
 
         buffer = ply_pixel_buffer_new (width, height);
 
-        bytes = ply_pixel_buffer_get_argb32_data (buffer);
+        if (width == 0 || height == 0)
+                return buffer;
+
+        if (ply_pixel_buffer_rotate_by_quarter_turns (old_buffer, buffer,
+                                                      center_x, center_y,
+                                                      theta_offset))
+                return buffer;
+
+        old_bytes = old_buffer->bytes;
+        bytes = buffer->bytes;
 
-        double d = sqrt ((center_x * center_x +
-                          center_y * center_y));
-        double theta = atan2 (-center_y, -center_x) - theta_offset;
-        double start_x = center_x + d * cos (theta);
-        double start_y = center_y + d * sin (theta);
-        double step_x = cos (-theta_offset);
-        double step_y = sin (-theta_offset);
+        cos_theta = cos (-theta_offset);
+        sin_theta = sin (-theta_offset);
+
+        step_x = llround (cos_theta * 65536.0);
+        step_y = llround (sin_theta * 65536.0);
+        max_x = (int64_t) width << 16;
+        max_y = (int64_t) height << 16;
 
         for (y = 0; y < height; y++) {
-                old_y = start_y;
-                old_x = start_x;
-                start_y += step_x;
-                start_x -= step_y;
+                int64_t old_x, old_y;
+
+                /* Each row starts from an exact position so rounding in
+                 * the steps can't build up down the image
+                 */
+                old_x = llround ((center_x - cos_theta * center_x - sin_theta * (y - center_y)) * 65536.0);
+                old_y = llround ((center_y - sin_theta * center_x + cos_theta * (y - center_y)) * 65536.0);
+
                 for (x = 0; x < width; x++) {
-                        if (old_x < 0 || old_x > width || old_y < 0 || old_y > height)
+                        if (old_x < 0 || old_x > max_x || old_y < 0 || old_y > max_y)
                                 bytes[x + y * width] = 0;
                         else
                                 bytes[x + y * width] =
-                                        ply_pixel_buffer_interpolate (old_buffer, old_x, old_y);
+                                        ply_pixels_interpolate_fixed (old_bytes, width, height,
+                                                                      old_x, old_y);
                         old_x += step_x;
                         old_y += step_y;
                 }
@@ -1048,7 +1405,6 @@ ply_pixel_buffer_tile (ply_pixel_buffer_t *old_buffer,
                        long                height)
 {
         long x, y;
-        long old_x, old_y;
         long old_width, old_height;
         uint32_t *bytes, *old_bytes;
         ply_pixel_buffer_t *buffer;
@@ -1061,13 +1417,25 @@ ply_pixel_buffer_tile (ply_pixel_buffer_t *old_buffer,
         old_width = old_buffer->area.width;
         old_height = old_buffer->area.height;
 
-        for (y = 0; y < height; y++) {
-                old_y = y % old_height;
-                for (x = 0; x < width; x++) {
-                        old_x = x % old_width;
-                        bytes[x + y * width] = old_bytes[old_x + old_y * old_width];
+        if (old_width == 0 || old_height == 0)
+                return buffer;
+
+        /* Lay out one row of tiles by copying whole source rows across... */
+        for (y = 0; y < MIN (height, old_height); y++) {
+                uint32_t *row = bytes + y * width;
+                const uint32_t *old_row = old_bytes + y * old_width;
+
+                for (x = 0; x < width; x += old_width) {
+                        memcpy (row + x, old_row, MIN (old_width, width - x) * sizeof(uint32_t));
                 }
         }
+
+        /* ...then every row below that repeats one that's already done */
+        for (; y < height; y++) {
+                memcpy (bytes + y * width, bytes + (y - old_height) * width,
+                        width * sizeof(uint32_t));
+        }
+
         return buffer;
 }
 
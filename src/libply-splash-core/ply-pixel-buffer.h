@@ -74,6 +74,15 @@ void ply_pixel_buffer_set_opaque (ply_pixel_buffer_t *buffer,
 
 ply_region_t *ply_pixel_buffer_get_updated_areas (ply_pixel_buffer_t *buffer);
 
+/* Running count of pixels that went through the blending paths, as opposed
+ * to being copied straight across
+ */
+unsigned long long ply_pixel_buffer_get_number_of_pixels_blended (ply_pixel_buffer_t *buffer);
+/* Running count of pixels overwritten by opaque color fills, which skip
+ * blending
+ */
+unsigned long long ply_pixel_buffer_get_number_of_pixels_filled (ply_pixel_buffer_t *buffer);
+
 void ply_pixel_buffer_fill_with_color (ply_pixel_buffer_t *buffer,
                                        ply_rectangle_t    *fill_area,
                                        double              red,
@@ -35,13 +35,36 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include "ply-buffer.h"
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-pixel-buffer.h"
 #include "ply-renderer.h"
+#include "ply-region.h"
 #include "ply-utils.h"
 
+/* A frame that takes longer than this to draw and flush misses a vsync at
+ * the rate the splash plugins animate at
+ */
+#define PLY_PIXEL_DISPLAY_FRAME_BUDGET (1.0 / 50)
+
+typedef struct
+{
+        unsigned long      number_of_frames;
+        unsigned long      number_of_missed_deadlines;
+        unsigned long      number_of_rectangles;
+        unsigned long      max_rectangles_per_frame;
+        unsigned long long number_of_pixels_copied;
+        unsigned long long number_of_pixels_blended;
+        unsigned long long number_of_pixels_filled;
+        double             draw_time;
+        double             flush_time;
+        double             max_frame_time;
+
+        double             unflushed_draw_time;
+} ply_pixel_display_stats_t;
+
 struct _ply_pixel_display
 {
         ply_event_loop_t                *loop;
@@ -57,6 +80,10 @@ struct _ply_pixel_display
         void                            *draw_handler_user_data;
 
         int                              pause_count;
+
+        ply_pixel_display_stats_t        stats;
+
+        uint32_t                         drew_while_paused : 1;
 };
 
 ply_pixel_display_t *
@@ -114,12 +141,54 @@ ply_pixel_display_get_device_scale (ply_pixel_display_t *display)
 }
 
 static void
-ply_pixel_display_flush (ply_pixel_display_t *display)
+ply_pixel_display_count_damage (ply_pixel_display_t *display,
+                                ply_pixel_buffer_t  *pixel_buffer)
+{
+        ply_list_t *areas;
+        ply_list_node_t *node;
+        unsigned long number_of_rectangles = 0;
+
+        areas = ply_region_get_rectangle_list (ply_pixel_buffer_get_updated_areas (pixel_buffer));
+        ply_list_foreach (areas, node) {
+                ply_rectangle_t *area = ply_list_node_get_data (node);
+
+                display->stats.number_of_pixels_copied += (unsigned long long) area->width * area->height;
+                number_of_rectangles++;
+        }
+
+        display->stats.number_of_rectangles += number_of_rectangles;
+        display->stats.max_rectangles_per_frame = MAX (display->stats.max_rectangles_per_frame,
+                                                       number_of_rectangles);
+}
+
+/* Takes the buffer the caller already has, because asking the renderer
+ * for it again can make it wait for copies still in flight
+ */
+static void
+ply_pixel_display_flush (ply_pixel_display_t *display,
+                         ply_pixel_buffer_t  *pixel_buffer)
 {
+        double start_time, flush_time, frame_time;
+
         if (display->pause_count > 0)
                 return;
 
+        if (pixel_buffer != NULL)
+                ply_pixel_display_count_damage (display, pixel_buffer);
+
+        start_time = ply_get_timestamp ();
         ply_renderer_flush_head (display->renderer, display->head);
+        flush_time = ply_get_timestamp () - start_time;
+
+        frame_time = display->stats.unflushed_draw_time + flush_time;
+        display->stats.unflushed_draw_time = 0.0;
+
+        display->stats.number_of_frames++;
+        display->stats.flush_time += flush_time;
+        display->stats.max_frame_time = MAX (display->stats.max_frame_time, frame_time);
+
+        if (frame_time > PLY_PIXEL_DISPLAY_FRAME_BUDGET)
+                display->stats.number_of_missed_deadlines++;
 }
 
 void
@@ -133,11 +202,21 @@ ply_pixel_display_pause_updates (ply_pixel_display_t *display)
 void
 ply_pixel_display_unpause_updates (ply_pixel_display_t *display)
 {
+        ply_pixel_buffer_t *pixel_buffer = NULL;
+
         assert (display != NULL);
 
         display->pause_count--;
 
-        ply_pixel_display_flush (display);
+        /* Damage from draws made while paused is only flushed now
+         */
+        if (display->pause_count == 0 && display->drew_while_paused) {
+                pixel_buffer = ply_renderer_get_buffer_for_head (display->renderer,
+                                                                 display->head);
+                display->drew_while_paused = false;
+        }
+
+        ply_pixel_display_flush (display, pixel_buffer);
 }
 
 void
@@ -154,19 +233,59 @@ ply_pixel_display_draw_area (ply_pixel_display_t *display,
 
         if (display->draw_handler != NULL) {
                 ply_rectangle_t clip_area;
+                unsigned long long number_of_pixels_blended, number_of_pixels_filled;
+                double start_time, draw_time;
 
                 clip_area.x = x;
                 clip_area.y = y;
                 clip_area.width = width;
                 clip_area.height = height;
+
+                number_of_pixels_blended = ply_pixel_buffer_get_number_of_pixels_blended (pixel_buffer);
+                number_of_pixels_filled = ply_pixel_buffer_get_number_of_pixels_filled (pixel_buffer);
+                start_time = ply_get_timestamp ();
+
                 ply_pixel_buffer_push_clip_area (pixel_buffer, &clip_area);
                 display->draw_handler (display->draw_handler_user_data,
                                        pixel_buffer,
                                        x, y, width, height, display);
                 ply_pixel_buffer_pop_clip_area (pixel_buffer);
+
+                draw_time = ply_get_timestamp () - start_time;
+                display->stats.draw_time += draw_time;
+                display->stats.unflushed_draw_time += draw_time;
+                display->stats.number_of_pixels_blended +=
+                        ply_pixel_buffer_get_number_of_pixels_blended (pixel_buffer) - number_of_pixels_blended;
+                display->stats.number_of_pixels_filled +=
+                        ply_pixel_buffer_get_number_of_pixels_filled (pixel_buffer) - number_of_pixels_filled;
         }
 
-        ply_pixel_display_flush (display);
+        if (display->pause_count > 0)
+                display->drew_while_paused = true;
+
+        ply_pixel_display_flush (display, pixel_buffer);
+}
+
+void
+ply_pixel_display_append_stats (ply_pixel_display_t *display,
+                                ply_buffer_t        *buffer,
+                                const char          *prefix)
+{
+        ply_pixel_display_stats_t *stats = &display->stats;
+
+        ply_buffer_append (buffer, "%s.size=%lux%lu\n", prefix, display->width, display->height);
+        ply_buffer_append (buffer, "%s.frames=%lu\n", prefix, stats->number_of_frames);
+        ply_buffer_append (buffer, "%s.missed-deadlines=%lu\n", prefix, stats->number_of_missed_deadlines);
+        ply_buffer_append (buffer, "%s.draw-time=%.6f\n", prefix, stats->draw_time);
+        ply_buffer_append (buffer, "%s.flush-time=%.6f\n", prefix, stats->flush_time);
+        ply_buffer_append (buffer, "%s.max-frame-time=%.6f\n", prefix, stats->max_frame_time);
+        ply_buffer_append (buffer, "%s.pixels-blended=%llu\n", prefix, stats->number_of_pixels_blended);
+        ply_buffer_append (buffer, "%s.pixels-filled=%llu\n", prefix, stats->number_of_pixels_filled);
+        ply_buffer_append (buffer, "%s.pixels-copied=%llu\n", prefix, stats->number_of_pixels_copied);
+        ply_buffer_append (buffer, "%s.rectangles=%lu\n", prefix, stats->number_of_rectangles);
+        ply_buffer_append (buffer, "%s.max-rectangles-per-frame=%lu\n", prefix, stats->max_rectangles_per_frame);
+        ply_buffer_append (buffer, "%s.average-rectangles-per-frame=%.2f\n", prefix,
+                           stats->number_of_frames > 0 ? (double) stats->number_of_rectangles / stats->number_of_frames : 0.0);
 }
 
 void
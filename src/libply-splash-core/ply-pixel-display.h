@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "ply-buffer.h"
 #include "ply-event-loop.h"
 #include "ply-pixel-buffer.h"
 #include "ply-renderer.h"
@@ -66,6 +67,11 @@ void ply_pixel_display_draw_area (ply_pixel_display_t *display,
 void ply_pixel_display_pause_updates (ply_pixel_display_t *display);
 void ply_pixel_display_unpause_updates (ply_pixel_display_t *display);
 
+/* Appends frame timing and damage counters as prefix.key=value lines */
+void ply_pixel_display_append_stats (ply_pixel_display_t *display,
+                                     ply_buffer_t        *buffer,
+                                     const char          *prefix);
+
 #endif
 
 #endif /* PLY_PIXEL_DISPLAY_H */
@@ -40,6 +40,7 @@
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-phase-tracer.h"
 #include "ply-utils.h"
 
 struct _ply_renderer
@@ -63,6 +64,8 @@ typedef const ply_renderer_plugin_interface_t *
 
 static void ply_renderer_unload_plugin (ply_renderer_t *renderer);
 
+static bool has_flushed_first_frame;
+
 ply_renderer_t *
 ply_renderer_new (ply_renderer_type_t renderer_type,
                   const char         *device_name,
@@ -196,10 +199,16 @@ ply_renderer_close_device (ply_renderer_t *renderer)
 static bool
 ply_renderer_query_device (ply_renderer_t *renderer)
 {
+        bool is_queried;
+
         assert (renderer != NULL);
         assert (renderer->plugin_interface != NULL);
 
-        return renderer->plugin_interface->query_device (renderer->backend);
+        ply_phase_tracer_begin ("query-device", renderer->device_name);
+        is_queried = renderer->plugin_interface->query_device (renderer->backend);
+        ply_phase_tracer_end ("query-device", renderer->device_name);
+
+        return is_queried;
 }
 
 static bool
@@ -211,7 +220,9 @@ ply_renderer_map_to_device (ply_renderer_t *renderer)
         if (renderer->is_mapped)
                 return true;
 
+        ply_phase_tracer_begin ("map-to-device", renderer->device_name);
         renderer->is_mapped = renderer->plugin_interface->map_to_device (renderer->backend);
+        ply_phase_tracer_end ("map-to-device", renderer->device_name);
 
         return renderer->is_mapped;
 }
@@ -271,11 +282,17 @@ ply_renderer_open (ply_renderer_t *renderer)
                 { PLY_RENDERER_TYPE_X11,          PLYMOUTH_PLUGIN_PATH "renderers/x11.so"          },
                 { PLY_RENDERER_TYPE_DRM,          PLYMOUTH_PLUGIN_PATH "renderers/drm.so"          },
                 { PLY_RENDERER_TYPE_FRAME_BUFFER, PLYMOUTH_PLUGIN_PATH "renderers/frame-buffer.so" },
+                { PLY_RENDERER_TYPE_OFFSCREEN,    PLYMOUTH_PLUGIN_PATH "renderers/offscreen.so"    },
                 { PLY_RENDERER_TYPE_NONE,         NULL                                             }
         };
 
         renderer->is_active = false;
         for (i = 0; known_plugins[i].type != PLY_RENDERER_TYPE_NONE; i++) {
+                /* The offscreen renderer never shows anything, so only use it on request */
+                if (known_plugins[i].type == PLY_RENDERER_TYPE_OFFSCREEN &&
+                    renderer->type != PLY_RENDERER_TYPE_OFFSCREEN)
+                        continue;
+
                 if (renderer->type == known_plugins[i].type ||
                     renderer->type == PLY_RENDERER_TYPE_AUTO) {
                         if (ply_renderer_open_plugin (renderer, known_plugins[i].path)) {
@@ -354,6 +371,21 @@ ply_renderer_get_buffer_for_head (ply_renderer_t      *renderer,
                                                                 head);
 }
 
+bool
+ply_renderer_head_shows_firmware_image (ply_renderer_t      *renderer,
+                                        ply_renderer_head_t *head)
+{
+        assert (renderer != NULL);
+        assert (renderer->plugin_interface != NULL);
+        assert (head != NULL);
+
+        if (!renderer->plugin_interface->head_shows_firmware_image)
+                return false;
+
+        return renderer->plugin_interface->head_shows_firmware_image (renderer->backend,
+                                                                      head);
+}
+
 void
 ply_renderer_flush_head (ply_renderer_t      *renderer,
                          ply_renderer_head_t *head)
@@ -368,6 +400,13 @@ ply_renderer_flush_head (ply_renderer_t      *renderer,
         renderer->plugin_interface->flush_head (renderer->backend, head);
 }
 
+void
+ply_renderer_note_flushed_frame (const char *device_name)
+{
+        if (!__atomic_exchange_n (&has_flushed_first_frame, true, __ATOMIC_RELAXED))
+                ply_phase_tracer_mark ("first-frame", device_name);
+}
+
 void
 ply_renderer_add_input_device (ply_renderer_t     *renderer,
                                ply_input_device_t *input_device)
@@ -42,7 +42,8 @@ typedef enum
         PLY_RENDERER_TYPE_AUTO,
         PLY_RENDERER_TYPE_DRM,
         PLY_RENDERER_TYPE_FRAME_BUFFER,
-        PLY_RENDERER_TYPE_X11
+        PLY_RENDERER_TYPE_X11,
+        PLY_RENDERER_TYPE_OFFSCREEN
 } ply_renderer_type_t;
 
 typedef void (*ply_renderer_input_source_handler_t) (void                        *user_data,
@@ -65,9 +66,18 @@ const char *ply_renderer_get_device_name (ply_renderer_t *renderer);
 ply_list_t *ply_renderer_get_heads (ply_renderer_t *renderer);
 ply_pixel_buffer_t *ply_renderer_get_buffer_for_head (ply_renderer_t      *renderer,
                                                       ply_renderer_head_t *head);
+/* Returns true while the head's buffer still holds what the firmware
+ * left on screen, before anything has been flushed to it
+ */
+bool ply_renderer_head_shows_firmware_image (ply_renderer_t      *renderer,
+                                             ply_renderer_head_t *head);
 
 void ply_renderer_flush_head (ply_renderer_t      *renderer,
                               ply_renderer_head_t *head);
+/* Called by renderer plugins once a frame has actually reached the
+ * display, which may be after flush_head returns
+ */
+void ply_renderer_note_flushed_frame (const char *device_name);
 
 void ply_renderer_add_input_device (ply_renderer_t     *renderer,
                                     ply_input_device_t *input_device);
@@ -63,6 +63,7 @@ struct _ply_animation
 
         ply_pixel_display_t *display;
         ply_trigger_t       *stop_trigger;
+        ply_timeout_watch_t *timeout_watch;
 
         int                  frame_number;
         long                 x, y;
@@ -173,6 +174,8 @@ on_timeout (ply_animation_t *animation)
         double sleep_time;
         bool should_continue;
 
+        animation->timeout_watch = NULL;
+
         animation->previous_time = animation->now;
         animation->now = ply_get_timestamp ();
 
@@ -190,10 +193,11 @@ on_timeout (ply_animation_t *animation)
                         animation->stop_trigger = NULL;
                 }
         } else {
-                ply_event_loop_watch_for_timeout (animation->loop,
-                                                  sleep_time,
-                                                  (ply_event_loop_timeout_handler_t)
-                                                  on_timeout, animation);
+                animation->timeout_watch = ply_event_loop_watch_for_timeout_with_slack (animation->loop,
+                                                                                        sleep_time,
+                                                                                        PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                                                        (ply_event_loop_timeout_handler_t)
+                                                                                        on_timeout, animation);
         }
 }
 
@@ -325,10 +329,11 @@ ply_animation_start (ply_animation_t     *animation,
 
         animation->start_time = ply_get_timestamp ();
 
-        ply_event_loop_watch_for_timeout (animation->loop,
-                                          1.0 / FRAMES_PER_SECOND,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, animation);
+        animation->timeout_watch = ply_event_loop_watch_for_timeout_with_slack (animation->loop,
+                                                                                1.0 / FRAMES_PER_SECOND,
+                                                                                PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                                                (ply_event_loop_timeout_handler_t)
+                                                                                on_timeout, animation);
 
         return true;
 }
@@ -341,9 +346,11 @@ ply_animation_stop_now (ply_animation_t *animation)
         ply_trace ("stopping animation now");
 
         if (animation->loop != NULL) {
-                ply_event_loop_stop_watching_for_timeout (animation->loop,
-                                                          (ply_event_loop_timeout_handler_t)
-                                                          on_timeout, animation);
+                if (animation->timeout_watch != NULL) {
+                        ply_event_loop_stop_watching_timeout (animation->loop,
+                                                              animation->timeout_watch);
+                        animation->timeout_watch = NULL;
+                }
                 animation->loop = NULL;
         }
 
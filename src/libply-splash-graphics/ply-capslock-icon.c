@@ -118,9 +118,10 @@ on_timeout (void             *user_data,
         if (capslock_icon->is_on != old_is_on)
                 ply_capslock_icon_draw (capslock_icon);
 
-        ply_event_loop_watch_for_timeout (capslock_icon->loop,
-                                          1.0 / FRAMES_PER_SECOND,
-                                          on_timeout, capslock_icon);
+        ply_event_loop_watch_for_timeout_with_slack (capslock_icon->loop,
+                                                     1.0 / FRAMES_PER_SECOND,
+                                                     PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                     on_timeout, capslock_icon);
 }
 
 static void
@@ -177,9 +178,10 @@ ply_capslock_icon_show (ply_capslock_icon_t *capslock_icon,
 
         ply_capslock_icon_draw (capslock_icon);
 
-        ply_event_loop_watch_for_timeout (capslock_icon->loop,
-                                          1.0 / FRAMES_PER_SECOND,
-                                          on_timeout, capslock_icon);
+        ply_event_loop_watch_for_timeout_with_slack (capslock_icon->loop,
+                                                     1.0 / FRAMES_PER_SECOND,
+                                                     PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                     on_timeout, capslock_icon);
 
         return true;
 }
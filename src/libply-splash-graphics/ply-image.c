@@ -47,6 +47,7 @@
 
 #include <linux/fb.h>
 
+#include "ply-phase-tracer.h"
 #include "ply-utils.h"
 
 struct _ply_image
@@ -290,6 +291,8 @@ ply_image_load (ply_image_t *image)
         if (fp == NULL)
                 return false;
 
+        ply_phase_tracer_begin ("decode-image", image->filename);
+
         if (fread (header, 1, 16, fp) != 16)
                 goto out;
 
@@ -305,6 +308,7 @@ ply_image_load (ply_image_t *image)
                 ret = ply_image_load_bmp (image, fp);
 
 out:
+        ply_phase_tracer_end ("decode-image", image->filename);
         fclose (fp);
         return ret;
 }
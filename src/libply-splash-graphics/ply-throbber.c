@@ -69,6 +69,7 @@ struct _ply_throbber
         ply_pixel_display_t *display;
         ply_rectangle_t      frame_area;
         ply_trigger_t       *stop_trigger;
+        ply_timeout_watch_t *timeout_watch;
 
         long                 x, y;
         long                 width, height;
@@ -186,6 +187,8 @@ on_timeout (ply_throbber_t *throbber)
         double sleep_time;
         bool should_continue;
 
+        throbber->timeout_watch = NULL;
+
         throbber->now = ply_get_timestamp ();
 
         should_continue = animate_at_time (throbber,
@@ -202,10 +205,11 @@ on_timeout (ply_throbber_t *throbber)
                         throbber->stop_trigger = NULL;
                 }
         } else {
-                ply_event_loop_watch_for_timeout (throbber->loop,
-                                                  sleep_time,
-                                                  (ply_event_loop_timeout_handler_t)
-                                                  on_timeout, throbber);
+                throbber->timeout_watch = ply_event_loop_watch_for_timeout_with_slack (throbber->loop,
+                                                                                       sleep_time,
+                                                                                       PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                                                       (ply_event_loop_timeout_handler_t)
+                                                                                       on_timeout, throbber);
         }
 }
 
@@ -316,10 +320,11 @@ ply_throbber_start (ply_throbber_t      *throbber,
 
         throbber->start_time = ply_get_timestamp ();
 
-        ply_event_loop_watch_for_timeout (throbber->loop,
-                                          1.0 / FRAMES_PER_SECOND,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, throbber);
+        throbber->timeout_watch = ply_event_loop_watch_for_timeout_with_slack (throbber->loop,
+                                                                               1.0 / FRAMES_PER_SECOND,
+                                                                               PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                                               (ply_event_loop_timeout_handler_t)
+                                                                               on_timeout, throbber);
 
         return true;
 }
@@ -339,9 +344,11 @@ ply_throbber_stop_now (ply_throbber_t *throbber,
         }
 
         if (throbber->loop != NULL) {
-                ply_event_loop_stop_watching_for_timeout (throbber->loop,
-                                                          (ply_event_loop_timeout_handler_t)
-                                                          on_timeout, throbber);
+                if (throbber->timeout_watch != NULL) {
+                        ply_event_loop_stop_watching_timeout (throbber->loop,
+                                                              throbber->timeout_watch);
+                        throbber->timeout_watch = NULL;
+                }
                 throbber->loop = NULL;
         }
         throbber->display = NULL;
@@ -32,6 +32,7 @@
 #include <string.h>
 #include <sys/fcntl.h>
 #include <sys/file.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -225,6 +226,52 @@ ply_buffer_append_from_fd (ply_buffer_t *buffer,
                 ply_buffer_append_bytes (buffer, bytes, bytes_read);
 }
 
+ssize_t
+ply_buffer_append_from_socket (ply_buffer_t *buffer,
+                               int           fd,
+                               size_t        max_bytes)
+{
+        char bytes[4096];
+        size_t total_bytes_read = 0;
+
+        assert (buffer != NULL);
+        assert (fd >= 0);
+
+        /* Never let the buffer overflow and discard what's already queued
+         */
+        if (buffer->size + 1 >= PLY_BUFFER_MAX_BUFFER_CAPACITY)
+                return 0;
+        if (max_bytes > PLY_BUFFER_MAX_BUFFER_CAPACITY - buffer->size - 1)
+                max_bytes = PLY_BUFFER_MAX_BUFFER_CAPACITY - buffer->size - 1;
+
+        while (total_bytes_read < max_bytes) {
+                size_t bytes_to_read;
+                ssize_t bytes_read;
+
+                bytes_to_read = MIN (sizeof(bytes), max_bytes - total_bytes_read);
+                bytes_read = recv (fd, bytes, bytes_to_read, MSG_DONTWAIT);
+
+                if (bytes_read > 0) {
+                        ply_buffer_append_bytes (buffer, bytes, bytes_read);
+                        total_bytes_read += bytes_read;
+                        continue;
+                }
+
+                if (bytes_read < 0 && errno == EINTR)
+                        continue;
+
+                if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        break;
+
+                if (total_bytes_read == 0)
+                        return -1;
+
+                break;
+        }
+
+        return total_bytes_read;
+}
+
 const char *
 ply_buffer_get_bytes (ply_buffer_t *buffer)
 {
@@ -37,6 +37,10 @@ void ply_buffer_append_bytes (ply_buffer_t *buffer,
 
 void ply_buffer_append_from_fd (ply_buffer_t *buffer,
                                 int           fd);
+/* Returns the number of bytes read, or -1 on hangup or error */
+ssize_t ply_buffer_append_from_socket (ply_buffer_t *buffer,
+                                       int           fd,
+                                       size_t        max_bytes);
 #define ply_buffer_append(buffer, format, args ...)                             \
         ply_buffer_append_with_non_literal_format_string (buffer,              \
                                                           format "", ## args)
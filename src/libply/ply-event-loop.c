@@ -37,6 +37,15 @@
 #include <sys/termios.h>
 #include <unistd.h>
 
+#ifdef HAVE_IO_URING
+#include <endian.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#include "ply-buffer.h"
 #include "ply-logger.h"
 #include "ply-list.h"
 #include "ply-utils.h"
@@ -49,16 +58,49 @@
 #define PLY_EVENT_LOOP_NO_TIMED_WAKEUP 0.0
 #endif
 
+/* Slack finer than this isn't worth lining timeouts up for */
+#define PLY_EVENT_LOOP_MIN_TIMEOUT_GRANULARITY (1.0 / 1024)
+
+#ifndef PLY_EVENT_LOOP_DEFAULT_BACKEND
+#define PLY_EVENT_LOOP_DEFAULT_BACKEND "epoll"
+#endif
+
+typedef enum
+{
+        PLY_EVENT_LOOP_BACKEND_EPOLL = 0,
+        PLY_EVENT_LOOP_BACKEND_IO_URING,
+} ply_event_loop_backend_t;
+
+typedef struct _ply_event_loop_poll ply_event_loop_poll_t;
+
 typedef struct
 {
-        int         fd;
-        ply_list_t *destinations;
-        ply_list_t *fd_watches;
-        uint32_t    is_getting_polled : 1;
-        uint32_t    is_disconnected : 1;
-        int         reference_count;
+        int                    fd;
+        ply_list_t            *destinations;
+        ply_list_t            *fd_watches;
+
+        /* The poll request that's currently queued for the fd, when
+         * using the io_uring backend
+         */
+        ply_event_loop_poll_t *poll;
+
+        uint32_t               is_getting_polled : 1;
+        uint32_t               is_disconnected : 1;
+        uint32_t               needs_poll : 1;
+        int                    reference_count;
 } ply_event_source_t;
 
+/* A one-shot poll request on the io_uring backend. It holds a reference
+ * on its source until its completion comes back, even if it got
+ * cancelled in the mean time.
+ */
+struct _ply_event_loop_poll
+{
+        ply_event_source_t *source;
+        uint32_t            mask;
+        uint32_t            is_cancelled : 1;
+};
+
 typedef struct
 {
         ply_event_source_t        *source;
@@ -97,33 +139,90 @@ typedef struct
         void                         *user_data;
 } ply_event_loop_exit_closure_t;
 
-typedef struct
+struct _ply_timeout_watch
 {
+        /* When the watch fires, which is somewhere between
+         * earliest_timeout and earliest_timeout plus its slack
+         */
         double                           timeout;
+        double                           earliest_timeout;
         ply_event_loop_timeout_handler_t handler;
         void                            *user_data;
-} ply_event_loop_timeout_watch_t;
+
+        /* Keeps watches that expire at the same time in the order they
+         * were added
+         */
+        uint64_t                         sequence_number;
+
+        /* Position in the loop's timeout heap, or -1 once it's been
+         * taken off
+         */
+        int                              heap_index;
+};
+
+#ifdef HAVE_IO_URING
+typedef struct
+{
+        int                  fd;
+
+        char                *rings;
+        size_t               rings_size;
+        struct io_uring_sqe *entries;
+        size_t               entries_size;
+
+        unsigned            *submission_head;
+        unsigned            *submission_tail;
+        unsigned             submission_mask;
+        unsigned             number_of_entries;
+        unsigned             number_of_unsubmitted_entries;
+
+        unsigned            *completion_head;
+        unsigned            *completion_tail;
+        unsigned             completion_mask;
+        struct io_uring_cqe *completions;
+} ply_event_loop_ring_t;
+#endif
 
 struct _ply_event_loop
 {
+        ply_event_loop_backend_t backend;
         int                      epoll_fd;
+#ifdef HAVE_IO_URING
+        ply_event_loop_ring_t    ring;
+#endif
         int                      exit_code;
-        double                   wakeup_time;
 
         ply_list_t              *sources;
         ply_list_t              *exit_closures;
-        ply_list_t              *timeout_watches;
+
+        /* Binary min-heap ordered by expiry time */
+        ply_timeout_watch_t    **timeout_watches;
+        int                      number_of_timeout_watches;
+        int                      timeout_watches_capacity;
+        uint64_t                 next_timeout_sequence_number;
+
+        double                   start_time;
+        double                   current_second_start_time;
+        unsigned long            number_of_wakeups;
+        unsigned long            number_of_timed_wakeups;
+        unsigned long            number_of_timeouts_dispatched;
+        unsigned long            number_of_coalesced_timeouts;
+        unsigned long            wakeups_in_current_second;
+        unsigned long            wakeups_in_last_second;
+        unsigned long            max_wakeups_per_second;
 
         ply_signal_dispatcher_t *signal_dispatcher;
 
         uint32_t                 should_exit : 1;
         uint32_t                 is_running : 1;
+        uint32_t                 has_sources_needing_polls : 1;
 };
 
 static void ply_event_loop_remove_source (ply_event_loop_t   *loop,
                                           ply_event_source_t *source);
 static ply_list_node_t *ply_event_loop_find_source_node (ply_event_loop_t *loop,
                                                          int               fd);
+static void ply_event_loop_free_timeout_watches (ply_event_loop_t *loop);
 
 static ply_list_node_t *
 ply_signal_dispatcher_find_source_node (ply_signal_dispatcher_t *dispatcher,
@@ -366,18 +465,16 @@ ply_event_source_drop_reference (ply_event_source_t *source)
                 ply_event_source_free (source);
 }
 
-static void
-ply_event_loop_update_source_event_mask (ply_event_loop_t   *loop,
-                                         ply_event_source_t *source)
+static uint32_t
+ply_event_loop_get_poll_mask_for_source (ply_event_source_t *source)
 {
         ply_list_node_t *node;
-        struct epoll_event event = { 0 };
+        uint32_t mask;
 
-        assert (loop != NULL);
         assert (source != NULL);
         assert (source->destinations != NULL);
 
-        event.events = EPOLLERR | EPOLLHUP;
+        mask = EPOLLERR | EPOLLHUP;
 
         node = ply_list_get_first_node (source->destinations);
         while (node != NULL) {
@@ -388,16 +485,293 @@ ply_event_loop_update_source_event_mask (ply_event_loop_t   *loop,
                 next_node = ply_list_get_next_node (source->destinations, node);
 
                 if (destination->status & PLY_EVENT_LOOP_FD_STATUS_HAS_DATA)
-                        event.events |= EPOLLIN;
+                        mask |= EPOLLIN;
 
                 if (destination->status & PLY_EVENT_LOOP_FD_STATUS_HAS_CONTROL_DATA)
-                        event.events |= EPOLLPRI;
+                        mask |= EPOLLPRI;
 
                 if (destination->status & PLY_EVENT_LOOP_FD_STATUS_CAN_TAKE_DATA)
-                        event.events |= EPOLLOUT;
+                        mask |= EPOLLOUT;
 
                 node = next_node;
         }
+
+        return mask;
+}
+
+#ifdef HAVE_IO_URING
+static bool
+ply_event_loop_ring_open (ply_event_loop_t *loop)
+{
+        ply_event_loop_ring_t *ring = &loop->ring;
+        struct io_uring_params parameters = { 0 };
+        unsigned *submission_array;
+        unsigned i;
+
+        ring->fd = syscall (__NR_io_uring_setup, PLY_EVENT_LOOP_NUM_EVENT_HANDLERS, &parameters);
+
+        if (ring->fd < 0)
+                return false;
+
+        /* Waiting with a timeout and without a timeout request needs 5.11 */
+        if (!(parameters.features & IORING_FEAT_SINGLE_MMAP) ||
+            !(parameters.features & IORING_FEAT_EXT_ARG)) {
+                close (ring->fd);
+                ring->fd = -1;
+                errno = ENOTSUP;
+                return false;
+        }
+
+        ring->rings_size = MAX (parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned),
+                                parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe));
+        ring->rings = mmap (NULL, ring->rings_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+
+        if (ring->rings == MAP_FAILED) {
+                close (ring->fd);
+                ring->fd = -1;
+                return false;
+        }
+
+        ring->entries_size = parameters.sq_entries * sizeof(struct io_uring_sqe);
+        ring->entries = mmap (NULL, ring->entries_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+        if (ring->entries == MAP_FAILED) {
+                munmap (ring->rings, ring->rings_size);
+                close (ring->fd);
+                ring->fd = -1;
+                return false;
+        }
+
+        ring->submission_head = (unsigned *) (ring->rings + parameters.sq_off.head);
+        ring->submission_tail = (unsigned *) (ring->rings + parameters.sq_off.tail);
+        ring->submission_mask = *(unsigned *) (ring->rings + parameters.sq_off.ring_mask);
+        ring->number_of_entries = parameters.sq_entries;
+
+        /* Entries are always queued in slot order */
+        submission_array = (unsigned *) (ring->rings + parameters.sq_off.array);
+        for (i = 0; i < parameters.sq_entries; i++) {
+                submission_array[i] = i;
+        }
+
+        ring->completion_head = (unsigned *) (ring->rings + parameters.cq_off.head);
+        ring->completion_tail = (unsigned *) (ring->rings + parameters.cq_off.tail);
+        ring->completion_mask = *(unsigned *) (ring->rings + parameters.cq_off.ring_mask);
+        ring->completions = (struct io_uring_cqe *) (ring->rings + parameters.cq_off.cqes);
+
+        return true;
+}
+
+static void
+ply_event_loop_ring_close (ply_event_loop_t *loop)
+{
+        ply_event_loop_ring_t *ring = &loop->ring;
+
+        munmap (ring->entries, ring->entries_size);
+        munmap (ring->rings, ring->rings_size);
+        close (ring->fd);
+        ring->fd = -1;
+}
+
+/* Submits everything queued so far and, if asked to, waits up to timeout
+ * seconds (or forever, if it's negative) for at least one completion
+ */
+static int
+ply_event_loop_ring_enter (ply_event_loop_t *loop,
+                           bool              should_wait,
+                           double            timeout)
+{
+        ply_event_loop_ring_t *ring = &loop->ring;
+        struct io_uring_getevents_arg argument = { 0 };
+        struct __kernel_timespec timeout_spec;
+        unsigned flags;
+        int result;
+
+        flags = IORING_ENTER_EXT_ARG;
+
+        if (should_wait)
+                flags |= IORING_ENTER_GETEVENTS;
+
+        if (should_wait && timeout >= 0.0) {
+                timeout_spec.tv_sec = (long long) timeout;
+                timeout_spec.tv_nsec = (long long) ((timeout - timeout_spec.tv_sec) * 1000000000.0);
+                argument.ts = (uintptr_t) &timeout_spec;
+        }
+
+        result = syscall (__NR_io_uring_enter, ring->fd,
+                          ring->number_of_unsubmitted_entries, should_wait ? 1 : 0,
+                          flags, &argument, sizeof(argument));
+
+        if (result > 0)
+                ring->number_of_unsubmitted_entries -= MIN ((unsigned) result,
+                                                            ring->number_of_unsubmitted_entries);
+
+        return result;
+}
+
+static struct io_uring_sqe *
+ply_event_loop_ring_get_free_entry (ply_event_loop_t *loop)
+{
+        ply_event_loop_ring_t *ring = &loop->ring;
+        struct io_uring_sqe *entry;
+        unsigned head, tail;
+
+        tail = *ring->submission_tail;
+        head = __atomic_load_n (ring->submission_head, __ATOMIC_ACQUIRE);
+
+        if (tail - head >= ring->number_of_entries) {
+                ply_event_loop_ring_enter (loop, false, -1.0);
+                head = __atomic_load_n (ring->submission_head, __ATOMIC_ACQUIRE);
+
+                if (tail - head >= ring->number_of_entries)
+                        return NULL;
+        }
+
+        entry = &ring->entries[tail & ring->submission_mask];
+        memset (entry, 0, sizeof(struct io_uring_sqe));
+
+        return entry;
+}
+
+static void
+ply_event_loop_ring_queue_entry (ply_event_loop_t *loop)
+{
+        ply_event_loop_ring_t *ring = &loop->ring;
+
+        __atomic_store_n (ring->submission_tail, *ring->submission_tail + 1, __ATOMIC_RELEASE);
+        ring->number_of_unsubmitted_entries++;
+}
+
+static void
+ply_event_loop_ring_cancel_poll_for_source (ply_event_loop_t   *loop,
+                                            ply_event_source_t *source)
+{
+        struct io_uring_sqe *entry;
+
+        if (source->poll == NULL)
+                return;
+
+        /* Whether or not the removal below gets queued, the poll can
+         * still complete later.  That completion is dropped, and only
+         * releases the reference the poll holds on the source.
+         */
+        source->poll->is_cancelled = true;
+
+        entry = ply_event_loop_ring_get_free_entry (loop);
+
+        if (entry != NULL) {
+                entry->opcode = IORING_OP_POLL_REMOVE;
+                entry->fd = -1;
+                entry->addr = (uintptr_t) source->poll;
+                ply_event_loop_ring_queue_entry (loop);
+        } else {
+                ply_trace ("could not queue removal of poll for fd %d, "
+                           "leaving it to complete on its own", source->fd);
+        }
+
+        source->poll = NULL;
+}
+
+/* Queues a poll for whatever the watchers of the source currently want,
+ * replacing the one that's already queued if that's for something else
+ */
+static void
+ply_event_loop_ring_arm_source (ply_event_loop_t   *loop,
+                                ply_event_source_t *source)
+{
+        struct io_uring_sqe *entry;
+        ply_event_loop_poll_t *poll;
+        uint32_t mask;
+
+        mask = ply_event_loop_get_poll_mask_for_source (source);
+
+        if (source->poll != NULL) {
+                if (source->poll->mask == mask)
+                        return;
+
+                ply_event_loop_ring_cancel_poll_for_source (loop, source);
+        }
+
+        entry = ply_event_loop_ring_get_free_entry (loop);
+
+        /* Try again before the next wait, so the fd doesn't go unwatched */
+        if (entry == NULL) {
+                ply_trace ("could not queue poll for fd %d, retrying later", source->fd);
+                source->needs_poll = true;
+                loop->has_sources_needing_polls = true;
+                return;
+        }
+
+        source->needs_poll = false;
+
+        poll = calloc (1, sizeof(ply_event_loop_poll_t));
+        poll->source = source;
+        poll->mask = mask;
+        ply_event_source_take_reference (source);
+
+        entry->opcode = IORING_OP_POLL_ADD;
+        entry->fd = source->fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+        entry->poll32_events = (mask << 16) | (mask >> 16);
+#else
+        entry->poll32_events = mask;
+#endif
+        entry->user_data = (uintptr_t) poll;
+        ply_event_loop_ring_queue_entry (loop);
+
+        source->poll = poll;
+}
+
+static void
+ply_event_loop_ring_arm_sources_needing_polls (ply_event_loop_t *loop)
+{
+        ply_list_node_t *node;
+
+        if (!loop->has_sources_needing_polls)
+                return;
+
+        loop->has_sources_needing_polls = false;
+
+        node = ply_list_get_first_node (loop->sources);
+        while (node != NULL) {
+                ply_event_source_t *source;
+
+                source = (ply_event_source_t *) ply_list_node_get_data (node);
+
+                if (source->needs_poll && source->is_getting_polled)
+                        ply_event_loop_ring_arm_source (loop, source);
+
+                node = ply_list_get_next_node (loop->sources, node);
+        }
+}
+
+static void
+ply_event_loop_ring_free_poll (ply_event_loop_poll_t *poll)
+{
+        ply_event_source_drop_reference (poll->source);
+        free (poll);
+}
+#endif
+
+static void
+ply_event_loop_update_source_event_mask (ply_event_loop_t   *loop,
+                                         ply_event_source_t *source)
+{
+        struct epoll_event event = { 0 };
+
+        assert (loop != NULL);
+        assert (source != NULL);
+
+#ifdef HAVE_IO_URING
+        if (loop->backend == PLY_EVENT_LOOP_BACKEND_IO_URING) {
+                if (source->is_getting_polled)
+                        ply_event_loop_ring_arm_source (loop, source);
+                return;
+        }
+#endif
+
+        event.events = ply_event_loop_get_poll_mask_for_source (source);
         event.data.ptr = source;
 
         if (source->is_getting_polled) {
@@ -476,6 +850,26 @@ ply_event_loop_remove_destination_by_fd_watch (ply_event_loop_t *loop,
         ply_event_loop_update_source_event_mask (loop, source);
 }
 
+/* PLYMOUTH_EVENT_LOOP_BACKEND in the environment overrides the build
+ * time default. The io_uring backend falls back to epoll if the kernel
+ * doesn't support it or has it turned off.
+ */
+static ply_event_loop_backend_t
+ply_event_loop_get_requested_backend (void)
+{
+        const char *backend;
+
+        backend = getenv ("PLYMOUTH_EVENT_LOOP_BACKEND");
+
+        if (backend == NULL || backend[0] == '\0')
+                backend = PLY_EVENT_LOOP_DEFAULT_BACKEND;
+
+        if (strcmp (backend, "io_uring") == 0)
+                return PLY_EVENT_LOOP_BACKEND_IO_URING;
+
+        return PLY_EVENT_LOOP_BACKEND_EPOLL;
+}
+
 ply_event_loop_t *
 ply_event_loop_new (void)
 {
@@ -483,18 +877,37 @@ ply_event_loop_new (void)
 
         loop = calloc (1, sizeof(ply_event_loop_t));
 
-        loop->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
-        loop->wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
+        loop->backend = ply_event_loop_get_requested_backend ();
+        loop->epoll_fd = -1;
 
-        assert (loop->epoll_fd >= 0);
+#ifdef HAVE_IO_URING
+        if (loop->backend == PLY_EVENT_LOOP_BACKEND_IO_URING &&
+            !ply_event_loop_ring_open (loop)) {
+                ply_trace ("could not set up io_uring, falling back to epoll: %m");
+                loop->backend = PLY_EVENT_LOOP_BACKEND_EPOLL;
+        }
+#else
+        if (loop->backend == PLY_EVENT_LOOP_BACKEND_IO_URING) {
+                ply_trace ("built without io_uring support, using epoll");
+                loop->backend = PLY_EVENT_LOOP_BACKEND_EPOLL;
+        }
+#endif
+
+        if (loop->backend == PLY_EVENT_LOOP_BACKEND_EPOLL) {
+                loop->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+
+                assert (loop->epoll_fd >= 0);
+        }
 
         loop->should_exit = false;
         loop->is_running = false;
         loop->exit_code = 0;
 
+        loop->start_time = ply_get_timestamp ();
+        loop->current_second_start_time = loop->start_time;
+
         loop->sources = ply_list_new ();
         loop->exit_closures = ply_list_new ();
-        loop->timeout_watches = ply_list_new ();
 
         loop->signal_dispatcher = ply_signal_dispatcher_new ();
 
@@ -578,9 +991,16 @@ ply_event_loop_free (ply_event_loop_t *loop)
         ply_event_loop_free_exit_closures (loop);
 
         ply_list_free (loop->sources);
-        ply_list_free (loop->timeout_watches);
+        ply_event_loop_free_timeout_watches (loop);
+        free (loop->timeout_watches);
 
-        close (loop->epoll_fd);
+#ifdef HAVE_IO_URING
+        if (loop->backend == PLY_EVENT_LOOP_BACKEND_IO_URING)
+                ply_event_loop_ring_close (loop);
+#endif
+
+        if (loop->epoll_fd >= 0)
+                close (loop->epoll_fd);
         free (loop);
 }
 
@@ -615,11 +1035,16 @@ ply_event_loop_add_source (ply_event_loop_t   *loop,
         assert (ply_event_loop_find_source_node (loop, source->fd) == NULL);
         assert (source->is_getting_polled == false);
 
-        event.events = EPOLLERR | EPOLLHUP;
-        event.data.ptr = source;
+        /* With io_uring, the poll gets queued once the first destination
+         * says what to poll for
+         */
+        if (loop->backend == PLY_EVENT_LOOP_BACKEND_EPOLL) {
+                event.events = EPOLLERR | EPOLLHUP;
+                event.data.ptr = source;
 
-        status = epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, source->fd, &event);
-        assert (status == 0);
+                status = epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, source->fd, &event);
+                assert (status == 0);
+        }
 
         source->is_getting_polled = true;
 
@@ -637,6 +1062,18 @@ ply_event_loop_remove_source_node (ply_event_loop_t *loop,
 
         assert (source != NULL);
 
+#ifdef HAVE_IO_URING
+        if (source->is_getting_polled &&
+            loop->backend == PLY_EVENT_LOOP_BACKEND_IO_URING) {
+                /* Submit the cancellation right away, so the ring doesn't
+                 * keep the file open after the caller closes the fd
+                 */
+                ply_event_loop_ring_cancel_poll_for_source (loop, source);
+                ply_event_loop_ring_enter (loop, false, -1.0);
+                source->is_getting_polled = false;
+        }
+#endif
+
         if (source->is_getting_polled) {
                 int status;
 
@@ -905,29 +1342,197 @@ ply_event_loop_stop_watching_for_exit (ply_event_loop_t             *loop,
         }
 }
 
-void
+static bool
+ply_timeout_watch_expires_before (ply_timeout_watch_t *watch,
+                                  ply_timeout_watch_t *other_watch)
+{
+        if (watch->timeout != other_watch->timeout)
+                return watch->timeout < other_watch->timeout;
+
+        return watch->sequence_number < other_watch->sequence_number;
+}
+
+static void
+ply_event_loop_set_timeout_watch_at_index (ply_event_loop_t    *loop,
+                                           ply_timeout_watch_t *watch,
+                                           int                  index)
+{
+        loop->timeout_watches[index] = watch;
+        watch->heap_index = index;
+}
+
+static void
+ply_event_loop_move_timeout_watch_up (ply_event_loop_t *loop,
+                                      int               index)
+{
+        ply_timeout_watch_t *watch = loop->timeout_watches[index];
+
+        while (index > 0) {
+                int parent_index = (index - 1) / 2;
+                ply_timeout_watch_t *parent = loop->timeout_watches[parent_index];
+
+                if (!ply_timeout_watch_expires_before (watch, parent))
+                        break;
+
+                ply_event_loop_set_timeout_watch_at_index (loop, parent, index);
+                index = parent_index;
+        }
+
+        ply_event_loop_set_timeout_watch_at_index (loop, watch, index);
+}
+
+static void
+ply_event_loop_move_timeout_watch_down (ply_event_loop_t *loop,
+                                        int               index)
+{
+        ply_timeout_watch_t *watch = loop->timeout_watches[index];
+
+        while (true) {
+                int child_index = 2 * index + 1;
+                ply_timeout_watch_t *child;
+
+                if (child_index >= loop->number_of_timeout_watches)
+                        break;
+
+                if (child_index + 1 < loop->number_of_timeout_watches &&
+                    ply_timeout_watch_expires_before (loop->timeout_watches[child_index + 1],
+                                                      loop->timeout_watches[child_index]))
+                        child_index++;
+
+                child = loop->timeout_watches[child_index];
+
+                if (!ply_timeout_watch_expires_before (child, watch))
+                        break;
+
+                ply_event_loop_set_timeout_watch_at_index (loop, child, index);
+                index = child_index;
+        }
+
+        ply_event_loop_set_timeout_watch_at_index (loop, watch, index);
+}
+
+static void
+ply_event_loop_add_timeout_watch (ply_event_loop_t    *loop,
+                                  ply_timeout_watch_t *watch)
+{
+        if (loop->number_of_timeout_watches == loop->timeout_watches_capacity) {
+                loop->timeout_watches_capacity = MAX (loop->timeout_watches_capacity * 2, 16);
+                loop->timeout_watches = realloc (loop->timeout_watches,
+                                                 loop->timeout_watches_capacity * sizeof(ply_timeout_watch_t *));
+        }
+
+        watch->sequence_number = loop->next_timeout_sequence_number++;
+
+        ply_event_loop_set_timeout_watch_at_index (loop, watch, loop->number_of_timeout_watches);
+        loop->number_of_timeout_watches++;
+        ply_event_loop_move_timeout_watch_up (loop, watch->heap_index);
+}
+
+static void
+ply_event_loop_remove_timeout_watch (ply_event_loop_t    *loop,
+                                     ply_timeout_watch_t *watch)
+{
+        int index = watch->heap_index;
+        ply_timeout_watch_t *last_watch;
+
+        assert (index >= 0 && index < loop->number_of_timeout_watches);
+        assert (loop->timeout_watches[index] == watch);
+
+        loop->number_of_timeout_watches--;
+        last_watch = loop->timeout_watches[loop->number_of_timeout_watches];
+
+        if (last_watch != watch) {
+                ply_event_loop_set_timeout_watch_at_index (loop, last_watch, index);
+                ply_event_loop_move_timeout_watch_down (loop, index);
+                ply_event_loop_move_timeout_watch_up (loop, last_watch->heap_index);
+        }
+
+        watch->heap_index = -1;
+}
+
+static double
+ply_event_loop_get_wakeup_time (ply_event_loop_t *loop)
+{
+        if (loop->number_of_timeout_watches == 0)
+                return PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
+
+        return loop->timeout_watches[0]->timeout;
+}
+
+/* Pushes the timeout out to the next multiple of the largest power of
+ * two fraction of a second that fits in the slack.  Watches with
+ * overlapping windows end up on the same grid point and so get
+ * dispatched from the same wakeup.
+ */
+static double
+ply_event_loop_align_timeout (double timeout,
+                              double slack)
+{
+        double granularity;
+
+        if (slack < PLY_EVENT_LOOP_MIN_TIMEOUT_GRANULARITY)
+                return timeout;
+
+        granularity = 1.0;
+        while (granularity > slack) {
+                granularity /= 2;
+        }
+
+        return ceil (timeout / granularity) * granularity;
+}
+
+ply_timeout_watch_t *
 ply_event_loop_watch_for_timeout (ply_event_loop_t                *loop,
                                   double                           seconds,
                                   ply_event_loop_timeout_handler_t timeout_handler,
                                   void                            *user_data)
 {
-        ply_event_loop_timeout_watch_t *timeout_watch;
+        return ply_event_loop_watch_for_timeout_with_slack (loop, seconds, 0.0,
+                                                            timeout_handler,
+                                                            user_data);
+}
+
+ply_timeout_watch_t *
+ply_event_loop_watch_for_timeout_with_slack (ply_event_loop_t                *loop,
+                                             double                           seconds,
+                                             double                           slack,
+                                             ply_event_loop_timeout_handler_t timeout_handler,
+                                             void                            *user_data)
+{
+        ply_timeout_watch_t *timeout_watch;
 
         assert (loop != NULL);
         assert (timeout_handler != NULL);
         assert (seconds > 0.0);
+        assert (slack >= 0.0);
 
-        timeout_watch = calloc (1, sizeof(ply_event_loop_timeout_watch_t));
-        timeout_watch->timeout = ply_get_timestamp () + seconds;
+        timeout_watch = calloc (1, sizeof(ply_timeout_watch_t));
+        timeout_watch->earliest_timeout = ply_get_timestamp () + seconds;
+        timeout_watch->timeout = ply_event_loop_align_timeout (timeout_watch->earliest_timeout,
+                                                               slack);
         timeout_watch->handler = timeout_handler;
         timeout_watch->user_data = user_data;
 
-        if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0)
-                loop->wakeup_time = timeout_watch->timeout;
-        else
-                loop->wakeup_time = MIN (loop->wakeup_time, timeout_watch->timeout);
+        ply_event_loop_add_timeout_watch (loop, timeout_watch);
 
-        ply_list_append_data (loop->timeout_watches, timeout_watch);
+        return timeout_watch;
+}
+
+void
+ply_event_loop_stop_watching_timeout (ply_event_loop_t    *loop,
+                                      ply_timeout_watch_t *watch)
+{
+        assert (loop != NULL);
+        assert (watch != NULL);
+
+        /* The watch is being dispatched and will be freed when its handler
+         * returns
+         */
+        if (watch->heap_index < 0)
+                return;
+
+        ply_event_loop_remove_timeout_watch (loop, watch);
+        free (watch);
 }
 
 void
@@ -935,37 +1540,33 @@ ply_event_loop_stop_watching_for_timeout (ply_event_loop_t                *loop,
                                           ply_event_loop_timeout_handler_t timeout_handler,
                                           void                            *user_data)
 {
-        ply_list_node_t *node;
         bool timeout_removed;
-
-        loop->wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
+        int i;
 
         timeout_removed = false;
-        node = ply_list_get_first_node (loop->timeout_watches);
-        while (node != NULL) {
-                ply_list_node_t *next_node;
-                ply_event_loop_timeout_watch_t *timeout_watch;
+        i = 0;
+        while (i < loop->number_of_timeout_watches) {
+                ply_timeout_watch_t *timeout_watch;
 
-                timeout_watch = (ply_event_loop_timeout_watch_t *) ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (loop->timeout_watches, node);
+                timeout_watch = loop->timeout_watches[i];
 
                 if (timeout_watch->handler == timeout_handler &&
                     timeout_watch->user_data == user_data) {
-                        ply_list_remove_node (loop->timeout_watches, node);
+                        ply_event_loop_remove_timeout_watch (loop, timeout_watch);
                         free (timeout_watch);
 
                         if (timeout_removed)
                                 ply_trace ("multiple matching timeouts found for removal");
 
                         timeout_removed = true;
-                } else {
-                        if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0)
-                                loop->wakeup_time = timeout_watch->timeout;
-                        else
-                                loop->wakeup_time = MIN (loop->wakeup_time, timeout_watch->timeout);
+
+                        /* Another watch was moved into this slot, so look at
+                         * this index again
+                         */
+                        continue;
                 }
 
-                node = next_node;
+                i++;
         }
 
         if (!timeout_removed)
@@ -1098,26 +1699,15 @@ ply_event_loop_free_watches_for_source (ply_event_loop_t   *loop,
 static void
 ply_event_loop_free_timeout_watches (ply_event_loop_t *loop)
 {
-        ply_list_node_t *node;
+        int i;
 
         assert (loop != NULL);
 
-        node = ply_list_get_first_node (loop->timeout_watches);
-        while (node != NULL) {
-                ply_list_node_t *next_node;
-                ply_event_loop_timeout_watch_t *watch;
-
-                watch = (ply_event_loop_timeout_watch_t *) ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (loop->timeout_watches, node);
-
-                free (watch);
-                ply_list_remove_node (loop->timeout_watches, node);
-
-                node = next_node;
+        for (i = 0; i < loop->number_of_timeout_watches; i++) {
+                free (loop->timeout_watches[i]);
         }
 
-        assert (ply_list_get_length (loop->timeout_watches) == 0);
-        loop->wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
+        loop->number_of_timeout_watches = 0;
 }
 
 static void
@@ -1168,47 +1758,230 @@ ply_event_loop_disconnect_source (ply_event_loop_t   *loop,
 }
 
 static void
-ply_event_loop_handle_timeouts (ply_event_loop_t *loop)
+ply_event_loop_handle_timeouts (ply_event_loop_t *loop,
+                                double            now)
 {
-        ply_list_node_t *node;
-        double now;
+        unsigned long number_of_timeouts_dispatched = 0;
 
         assert (loop != NULL);
 
+        while (loop->number_of_timeout_watches > 0) {
+                ply_timeout_watch_t *watch;
+
+                watch = loop->timeout_watches[0];
+
+                /* Since we're awake anyway, also take the next watch if
+                 * it's inside its window, even if it isn't due yet
+                 */
+                if (watch->earliest_timeout > now)
+                        break;
+
+                assert (watch->handler != NULL);
+
+                /* Take it off first, so the handler can add or remove
+                 * other watches
+                 */
+                ply_event_loop_remove_timeout_watch (loop, watch);
+
+                watch->handler (watch->user_data, loop);
+                free (watch);
+
+                number_of_timeouts_dispatched++;
+        }
+
+        loop->number_of_timeouts_dispatched += number_of_timeouts_dispatched;
+        if (number_of_timeouts_dispatched > 1)
+                loop->number_of_coalesced_timeouts += number_of_timeouts_dispatched - 1;
+}
+
+static void
+ply_event_loop_count_wakeup (ply_event_loop_t *loop,
+                             double            now,
+                             bool              is_timed_wakeup)
+{
+        loop->number_of_wakeups++;
+
+        if (is_timed_wakeup)
+                loop->number_of_timed_wakeups++;
+
+        if (now - loop->current_second_start_time >= 1.0) {
+                loop->wakeups_in_last_second = loop->wakeups_in_current_second;
+                loop->wakeups_in_current_second = 0;
+                loop->current_second_start_time = now;
+        }
+
+        loop->wakeups_in_current_second++;
+        loop->max_wakeups_per_second = MAX (loop->max_wakeups_per_second,
+                                            loop->wakeups_in_current_second);
+}
+
+void
+ply_event_loop_append_stats (ply_event_loop_t *loop,
+                             ply_buffer_t     *buffer,
+                             const char       *prefix)
+{
+        double run_time;
+
+        run_time = ply_get_timestamp () - loop->start_time;
+
+        ply_buffer_append (buffer, "%s.backend=%s\n", prefix,
+                           loop->backend == PLY_EVENT_LOOP_BACKEND_IO_URING ? "io_uring" : "epoll");
+        ply_buffer_append (buffer, "%s.wakeups=%lu\n", prefix, loop->number_of_wakeups);
+        ply_buffer_append (buffer, "%s.timed-wakeups=%lu\n", prefix, loop->number_of_timed_wakeups);
+        ply_buffer_append (buffer, "%s.timeouts=%lu\n", prefix, loop->number_of_timeouts_dispatched);
+        ply_buffer_append (buffer, "%s.coalesced-timeouts=%lu\n", prefix, loop->number_of_coalesced_timeouts);
+        ply_buffer_append (buffer, "%s.pending-timeouts=%d\n", prefix, loop->number_of_timeout_watches);
+        ply_buffer_append (buffer, "%s.wakeups-per-second=%.2f\n", prefix,
+                           run_time > 0.0 ? loop->number_of_wakeups / run_time : 0.0);
+        ply_buffer_append (buffer, "%s.wakeups-last-second=%lu\n", prefix, loop->wakeups_in_last_second);
+        ply_buffer_append (buffer, "%s.max-wakeups-per-second=%lu\n", prefix, loop->max_wakeups_per_second);
+}
+
+/* An fd that hung up can still have data queued, which its watchers get
+ * to read before they hear about the disconnect. That's only possible
+ * if it also polled readable, so the FIONREAD check is skipped otherwise.
+ */
+static bool
+ply_event_loop_source_is_disconnected (ply_event_source_t *source,
+                                       uint32_t            mask)
+{
+        int bytes_ready;
+
+        if (!(mask & (EPOLLHUP | EPOLLERR)))
+                return false;
+
+        if (!(mask & EPOLLIN))
+                return true;
+
+        bytes_ready = 0;
+        if (ioctl (source->fd, FIONREAD, &bytes_ready) < 0)
+                bytes_ready = 0;
+
+        return bytes_ready <= 0;
+}
+
+static void
+ply_event_loop_handle_events_for_source (ply_event_loop_t   *loop,
+                                         ply_event_source_t *source,
+                                         uint32_t            mask)
+{
+        ply_event_loop_fd_status_t status;
+
+        status = ply_event_loop_get_fd_status_from_poll_mask (mask);
+
+        if (ply_event_loop_source_is_disconnected (source, mask))
+                ply_event_loop_disconnect_source (loop, source);
+        else if (ply_event_loop_source_has_met_status (source, status))
+                ply_event_loop_handle_met_status_for_source (loop, source, status);
+}
+
+#ifdef HAVE_IO_URING
+static int
+ply_event_loop_ring_take_completions (ply_event_loop_t    *loop,
+                                      struct io_uring_cqe *completions,
+                                      int                  max_completions)
+{
+        ply_event_loop_ring_t *ring = &loop->ring;
+        unsigned head, tail;
+        int number_of_completions;
+
+        head = *ring->completion_head;
+        tail = __atomic_load_n (ring->completion_tail, __ATOMIC_ACQUIRE);
+
+        number_of_completions = 0;
+        while (head != tail && number_of_completions < max_completions) {
+                completions[number_of_completions] = ring->completions[head & ring->completion_mask];
+                number_of_completions++;
+                head++;
+        }
+
+        __atomic_store_n (ring->completion_head, head, __ATOMIC_RELEASE);
+
+        return number_of_completions;
+}
+
+/* One io_uring_enter both submits the polls queued since the last
+ * iteration and waits for the next completions or timeout
+ */
+static void
+ply_event_loop_process_pending_ring_events (ply_event_loop_t *loop)
+{
+        static struct io_uring_cqe completions[PLY_EVENT_LOOP_NUM_EVENT_HANDLERS];
+        int number_of_completions, result, i;
+        double wakeup_time, timeout, now;
+
+        wakeup_time = ply_event_loop_get_wakeup_time (loop);
+        if (fabs (wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0)
+                timeout = -1.0;
+        else
+                timeout = MAX (wakeup_time - ply_get_timestamp (), 0.0);
+
+        ply_event_loop_ring_arm_sources_needing_polls (loop);
+
+        result = ply_event_loop_ring_enter (loop, true, timeout);
+
+        if (result < 0 && errno != EINTR && errno != EAGAIN && errno != ETIME && errno != EBUSY) {
+                ply_event_loop_exit (loop, 255);
+                return;
+        }
+
+        number_of_completions = ply_event_loop_ring_take_completions (loop, completions,
+                                                                      PLY_EVENT_LOOP_NUM_EVENT_HANDLERS);
         now = ply_get_timestamp ();
-        node = ply_list_get_first_node (loop->timeout_watches);
-        loop->wakeup_time = PLY_EVENT_LOOP_NO_TIMED_WAKEUP;
-        while (node != NULL) {
-                ply_list_node_t *next_node;
-                ply_event_loop_timeout_watch_t *watch;
+        ply_event_loop_count_wakeup (loop, now, number_of_completions == 0);
 
-                watch = (ply_event_loop_timeout_watch_t *) ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (loop->timeout_watches, node);
+        /* First handle timeouts */
+        ply_event_loop_handle_timeouts (loop, now);
 
-                if (watch->timeout <= now) {
-                        assert (watch->handler != NULL);
+        /* Then process the incoming events. Each poll holds a reference on
+         * its source, so the source stays alive until the poll is freed.
+         */
+        for (i = 0; i < number_of_completions; i++) {
+                ply_event_loop_poll_t *poll;
+                ply_event_source_t *source;
 
-                        ply_list_remove_node (loop->timeout_watches, node);
+                poll = (ply_event_loop_poll_t *) (uintptr_t) completions[i].user_data;
 
-                        watch->handler (watch->user_data, loop);
-                        free (watch);
+                /* Completions of the cancellations themselves */
+                if (poll == NULL)
+                        continue;
 
-                        /* start over in case the handler invalidated the list
-                         */
-                        next_node = ply_list_get_first_node (loop->timeout_watches);
-                } else {
-                        if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0)
-                                loop->wakeup_time = watch->timeout;
-                        else
-                                loop->wakeup_time = MIN (loop->wakeup_time, watch->timeout);
+                source = poll->source;
+
+                if (!poll->is_cancelled) {
+                        int result = completions[i].res;
+
+                        assert (source->poll == poll);
+                        source->poll = NULL;
+
+                        if (result < 0) {
+                                ply_trace ("failed to poll fd %d: %s", source->fd,
+                                           strerror (-result));
+
+                                /* Running short on memory is worth another
+                                 * try, anything else is as good as an error
+                                 * on the fd itself
+                                 */
+                                if (result != -EAGAIN && result != -ENOMEM && result != -EINTR)
+                                        result = EPOLLERR;
+                        }
+
+                        if (result >= 0 && !loop->should_exit)
+                                ply_event_loop_handle_events_for_source (loop, source,
+                                                                         result);
+
+                        /* Polls are one-shot, so queue the next one */
+                        if (source->is_getting_polled)
+                                ply_event_loop_ring_arm_source (loop, source);
                 }
 
-                node = next_node;
+                ply_event_loop_ring_free_poll (poll);
         }
 }
+#endif
 
-void
-ply_event_loop_process_pending_events (ply_event_loop_t *loop)
+static void
+ply_event_loop_process_pending_epoll_events (ply_event_loop_t *loop)
 {
         int number_of_received_events, i;
         static struct epoll_event events[PLY_EVENT_LOOP_NUM_EVENT_HANDLERS];
@@ -1219,18 +1992,26 @@ ply_event_loop_process_pending_events (ply_event_loop_t *loop)
                 PLY_EVENT_LOOP_NUM_EVENT_HANDLERS * sizeof(struct epoll_event));
 
         do {
+                double wakeup_time, now;
                 int timeout;
 
-                if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0) {
+                wakeup_time = ply_event_loop_get_wakeup_time (loop);
+                if (fabs (wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0) {
                         timeout = -1;
                 } else {
-                        timeout = (int) ((loop->wakeup_time - ply_get_timestamp ()) * 1000);
+                        /* Round up, or we'd spin until the last fraction of
+                         * a millisecond before the watch is due runs out
+                         */
+                        timeout = (int) ceil ((wakeup_time - ply_get_timestamp ()) * 1000);
                         timeout = MAX (timeout, 0);
                 }
 
                 number_of_received_events = epoll_wait (loop->epoll_fd, events,
                                                         PLY_EVENT_LOOP_NUM_EVENT_HANDLERS,
                                                         timeout);
+                now = ply_get_timestamp ();
+                ply_event_loop_count_wakeup (loop, now, number_of_received_events == 0);
+
                 if (number_of_received_events < 0) {
                         if (errno != EINTR && errno != EAGAIN) {
                                 ply_event_loop_exit (loop, 255);
@@ -1249,35 +2030,17 @@ ply_event_loop_process_pending_events (ply_event_loop_t *loop)
                 }
 
                 /* First handle timeouts */
-                ply_event_loop_handle_timeouts (loop);
+                ply_event_loop_handle_timeouts (loop, now);
         } while (number_of_received_events < 0);
 
         /* Then process the incoming events
          */
         for (i = 0; i < number_of_received_events; i++) {
                 ply_event_source_t *source;
-                ply_event_loop_fd_status_t status;
-                bool is_disconnected;
 
                 source = (ply_event_source_t *) (events[i].data.ptr);
-                status = ply_event_loop_get_fd_status_from_poll_mask (events[i].events);
-
-                is_disconnected = false;
-                if ((events[i].events & EPOLLHUP) || (events[i].events & EPOLLERR)) {
-                        int bytes_ready;
-
-                        bytes_ready = 0;
-                        if (ioctl (source->fd, FIONREAD, &bytes_ready) < 0)
-                                bytes_ready = 0;
-
-                        if (bytes_ready <= 0)
-                                is_disconnected = true;
-                }
 
-                if (is_disconnected)
-                        ply_event_loop_disconnect_source (loop, source);
-                else if (ply_event_loop_source_has_met_status (source, status))
-                        ply_event_loop_handle_met_status_for_source (loop, source, status);
+                ply_event_loop_handle_events_for_source (loop, source, events[i].events);
 
                 if (loop->should_exit)
                         break;
@@ -1294,6 +2057,21 @@ ply_event_loop_process_pending_events (ply_event_loop_t *loop)
         }
 }
 
+void
+ply_event_loop_process_pending_events (ply_event_loop_t *loop)
+{
+        assert (loop != NULL);
+
+#ifdef HAVE_IO_URING
+        if (loop->backend == PLY_EVENT_LOOP_BACKEND_IO_URING) {
+                ply_event_loop_process_pending_ring_events (loop);
+                return;
+        }
+#endif
+
+        ply_event_loop_process_pending_epoll_events (loop);
+}
+
 void
 ply_event_loop_exit (ply_event_loop_t *loop,
                      int               exit_code)
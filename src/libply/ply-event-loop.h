@@ -26,8 +26,11 @@
 #include <signal.h>
 #include <stdint.h>
 
+#include "ply-buffer.h"
+
 typedef struct _ply_event_loop ply_event_loop_t;
 typedef struct _ply_fd_watch ply_fd_watch_t;
+typedef struct _ply_timeout_watch ply_timeout_watch_t;
 
 typedef enum
 {
@@ -46,6 +49,11 @@ typedef void (*ply_event_loop_exit_handler_t) (void             *user_data,
 typedef void (*ply_event_loop_timeout_handler_t) (void             *user_data,
                                                   ply_event_loop_t *loop);
 
+/* Slack for animation timers: a quarter of a frame is too little to see,
+ * but enough to let them share wakeups
+ */
+#define PLY_EVENT_LOOP_FRAME_SLACK(frames_per_second) (1.0 / (frames_per_second) / 4)
+
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
 ply_event_loop_t *ply_event_loop_new (void);
 void ply_event_loop_free (ply_event_loop_t *loop);
@@ -71,10 +79,23 @@ void ply_event_loop_watch_for_exit (ply_event_loop_t             *loop,
 void ply_event_loop_stop_watching_for_exit (ply_event_loop_t             *loop,
                                             ply_event_loop_exit_handler_t exit_handler,
                                             void                         *user_data);
-void ply_event_loop_watch_for_timeout (ply_event_loop_t                *loop,
-                                       double                           seconds,
-                                       ply_event_loop_timeout_handler_t timeout_handler,
-                                       void                            *user_data);
+/* The returned watch is freed after its handler runs, so it must not be
+ * passed to ply_event_loop_stop_watching_timeout () after that
+ */
+ply_timeout_watch_t *ply_event_loop_watch_for_timeout (ply_event_loop_t                *loop,
+                                                       double                           seconds,
+                                                       ply_event_loop_timeout_handler_t timeout_handler,
+                                                       void                            *user_data);
+/* Lets the loop fire the watch up to slack seconds late, so it can share
+ * a wakeup with other watches
+ */
+ply_timeout_watch_t *ply_event_loop_watch_for_timeout_with_slack (ply_event_loop_t                *loop,
+                                                                  double                           seconds,
+                                                                  double                           slack,
+                                                                  ply_event_loop_timeout_handler_t timeout_handler,
+                                                                  void                            *user_data);
+void ply_event_loop_stop_watching_timeout (ply_event_loop_t    *loop,
+                                           ply_timeout_watch_t *watch);
 
 void ply_event_loop_stop_watching_for_timeout (ply_event_loop_t                *loop,
                                                ply_event_loop_timeout_handler_t timeout_handler,
@@ -85,6 +106,10 @@ void ply_event_loop_exit (ply_event_loop_t *loop,
                           int               exit_code);
 void
 ply_event_loop_process_pending_events (ply_event_loop_t *loop);
+
+void ply_event_loop_append_stats (ply_event_loop_t *loop,
+                                  ply_buffer_t     *buffer,
+                                  const char       *prefix);
 #endif
 
 #endif
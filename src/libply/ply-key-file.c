@@ -28,64 +28,169 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
 #include <strings.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "ply-utils.h"
 #include "ply-hashtable.h"
+#include "ply-list.h"
 #include "ply-logger.h"
 
+/* Keys, values and group names point into the loaded file contents, which
+ * are terminated in place while parsing.  Typed values are parsed the
+ * first time they're asked for and remembered in the entry, under
+ * typed_value_mutex, since cached key files are shared between threads.
+ */
 typedef struct
 {
-        char *key;
-        char *value;
+        const char *key;
+        const char *value;
+
+        double      double_value;
+        long        long_value;
+
+        uint32_t    has_double_value : 1;
+        uint32_t    has_long_value : 1;
+        uint32_t    has_bool_value : 1;
+        uint32_t    bool_value : 1;
 } ply_key_file_entry_t;
 
 typedef struct
 {
-        char            *name;
+        const char      *name;
         ply_hashtable_t *entries;
 } ply_key_file_group_t;
 
 struct _ply_key_file
 {
         char                 *filename;
-        FILE                 *fp;
+
+        char                 *contents;
+        size_t                contents_size;
+        size_t                offset;
+        struct stat           file_info;
 
         ply_hashtable_t      *groups;
         ply_key_file_group_t *groupless_group;
+
+        uint32_t              contents_are_mapped : 1;
+        uint32_t              should_copy_contents : 1;
 };
 
 typedef struct
 {
         ply_key_file_foreach_func_t *func;
         void                        *user_data;
-        char                        *group_name;
+        const char                  *group_name;
 } ply_key_file_foreach_func_data_t;
 
+/* Key files that changed on disk are retired rather than freed, since a
+ * splash being loaded on another thread may still be reading them.
+ */
+static pthread_mutex_t key_file_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t typed_value_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ply_hashtable_t *key_file_cache;
+static ply_list_t *retired_key_files;
+
 static bool ply_key_file_open_file (ply_key_file_t *key_file);
 static void ply_key_file_close_file (ply_key_file_t *key_file);
 
+static bool
+ply_key_file_read_contents (ply_key_file_t *key_file,
+                            int             fd)
+{
+        size_t bytes_read = 0;
+
+        key_file->contents = malloc (key_file->contents_size + 1);
+
+        while (bytes_read < key_file->contents_size) {
+                ssize_t result;
+
+                result = read (fd, key_file->contents + bytes_read,
+                               key_file->contents_size - bytes_read);
+
+                if (result < 0 && errno == EINTR)
+                        continue;
+
+                if (result <= 0)
+                        break;
+
+                bytes_read += result;
+        }
+
+        key_file->contents_size = bytes_read;
+        key_file->contents[bytes_read] = '\0';
+
+        return true;
+}
+
+/* The file is mapped privately and writable, so the parser can terminate
+ * strings in place without touching the file.  The tail of the last page
+ * past the end of the file reads back as zeros and serves as the final
+ * terminator, so only files that end exactly on a page boundary need to
+ * be read into a buffer instead.  Cached key files are always read, since
+ * they outlive the open and touching a mapping of a file that was since
+ * truncated raises SIGBUS.
+ */
 static bool
 ply_key_file_open_file (ply_key_file_t *key_file)
 {
+        int fd;
+        bool is_open = false;
+
         assert (key_file != NULL);
 
-        key_file->fp = fopen (key_file->filename, "re");
+        fd = open (key_file->filename, O_RDONLY | O_CLOEXEC);
 
-        if (key_file->fp == NULL) {
+        if (fd < 0) {
                 ply_trace ("Failed to open key file %s: %m",
                            key_file->filename);
                 return false;
         }
-        return true;
+
+        if (fstat (fd, &key_file->file_info) < 0) {
+                ply_trace ("Failed to get size of key file %s: %m",
+                           key_file->filename);
+                goto out;
+        }
+
+        key_file->contents_size = key_file->file_info.st_size;
+        key_file->offset = 0;
+
+        if (!key_file->should_copy_contents &&
+            key_file->contents_size > 0 &&
+            key_file->contents_size % (size_t) sysconf (_SC_PAGESIZE) != 0) {
+                void *contents;
+
+                contents = mmap (NULL, key_file->contents_size,
+                                 PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                                 fd, 0);
+
+                if (contents != MAP_FAILED) {
+                        key_file->contents = contents;
+                        key_file->contents_are_mapped = true;
+                        is_open = true;
+                        goto out;
+                }
+
+                ply_trace ("Failed to map key file %s: %m",
+                           key_file->filename);
+        }
+
+        is_open = ply_key_file_read_contents (key_file, fd);
+out:
+        close (fd);
+
+        return is_open;
 }
 
 static void
@@ -93,10 +198,16 @@ ply_key_file_close_file (ply_key_file_t *key_file)
 {
         assert (key_file != NULL);
 
-        if (key_file->fp == NULL)
+        if (key_file->contents == NULL)
                 return;
-        fclose (key_file->fp);
-        key_file->fp = NULL;
+
+        if (key_file->contents_are_mapped)
+                munmap (key_file->contents, key_file->contents_size);
+        else
+                free (key_file->contents);
+
+        key_file->contents = NULL;
+        key_file->contents_are_mapped = false;
 }
 
 ply_key_file_t *
@@ -109,7 +220,6 @@ ply_key_file_new (const char *filename)
         key_file = calloc (1, sizeof(ply_key_file_t));
 
         key_file->filename = strdup (filename);
-        key_file->fp = NULL;
         key_file->groups = ply_hashtable_new (ply_hashtable_string_hash, ply_hashtable_string_compare);
 
         return key_file;
@@ -122,8 +232,6 @@ ply_key_file_free_entry_foreach (void *key,
 {
         ply_key_file_entry_t *entry = data;
 
-        free (entry->key);
-        free (entry->value);
         free (entry);
 }
 
@@ -138,7 +246,6 @@ ply_key_file_free_group (void *key,
                                ply_key_file_free_entry_foreach,
                                NULL);
         ply_hashtable_free (group->entries);
-        free (group->name);
         free (group);
 }
 
@@ -157,70 +264,113 @@ ply_key_file_free (ply_key_file_t *key_file)
                 ply_key_file_free_group (NULL, key_file->groupless_group, NULL);
 
         ply_hashtable_free (key_file->groups);
+        ply_key_file_close_file (key_file);
         free (key_file->filename);
         free (key_file);
 }
 
+static char
+ply_key_file_peek_byte (ply_key_file_t *key_file)
+{
+        if (key_file->offset >= key_file->contents_size)
+                return '\0';
+
+        return key_file->contents[key_file->offset];
+}
+
+static void
+ply_key_file_skip_whitespace (ply_key_file_t *key_file)
+{
+        while (isspace ((unsigned char) ply_key_file_peek_byte (key_file)))
+                key_file->offset++;
+}
+
+static void
+ply_key_file_skip_line (ply_key_file_t *key_file)
+{
+        const char *end_of_line;
+
+        end_of_line = memchr (key_file->contents + key_file->offset, '\n',
+                              key_file->contents_size - key_file->offset);
+
+        if (end_of_line == NULL)
+                key_file->offset = key_file->contents_size;
+        else
+                key_file->offset = end_of_line - key_file->contents + 1;
+}
+
+static size_t
+ply_key_file_skip_until (ply_key_file_t *key_file,
+                         const char     *delimiters)
+{
+        size_t start = key_file->offset;
+
+        while (key_file->offset < key_file->contents_size &&
+               key_file->contents[key_file->offset] != '\0' &&
+               strchr (delimiters, key_file->contents[key_file->offset]) == NULL)
+                key_file->offset++;
+
+        return key_file->offset - start;
+}
+
 static ply_key_file_group_t *
 ply_key_file_load_group (ply_key_file_t *key_file,
                          const char     *group_name)
 {
-        int items_matched;
         ply_key_file_group_t *group;
 
         group = calloc (1, sizeof(ply_key_file_group_t));
-        group->name = strdup (group_name);
+        group->name = group_name;
         group->entries = ply_hashtable_new (ply_hashtable_string_hash, ply_hashtable_string_compare);
 
         ply_trace ("trying to load group %s", group_name);
         do {
                 ply_key_file_entry_t *entry;
-                char *key;
-                char *value;
-                off_t offset;
-                int first_byte;
+                size_t key_offset, key_end;
+                size_t value_offset, value_end;
 
-                key = NULL;
-                value = NULL;
+                ply_key_file_skip_whitespace (key_file);
 
-                do {
-                        first_byte = fgetc (key_file->fp);
-                } while (isspace (first_byte));
+                if (ply_key_file_peek_byte (key_file) == '#') {
+                        ply_key_file_skip_line (key_file);
+                        continue;
+                }
 
-                if (first_byte == '#') {
-                        char *line_to_toss;
-                        size_t number_of_bytes;
+                key_offset = key_file->offset;
+                if (ply_key_file_skip_until (key_file, "= \t\n") == 0)
+                        break;
+                key_end = key_file->offset;
 
-                        line_to_toss = NULL;
-                        number_of_bytes = 0;
+                ply_key_file_skip_whitespace (key_file);
 
-                        getline (&line_to_toss, &number_of_bytes,
-                                 key_file->fp);
-                        free (line_to_toss);
-                        items_matched = 0;
-                        continue;
+                if (ply_key_file_peek_byte (key_file) != '=') {
+                        key_file->offset = key_offset;
+                        break;
                 }
-                ungetc (first_byte, key_file->fp);
-
-                offset = ftello (key_file->fp);
-                items_matched = fscanf (key_file->fp, " %m[^= \t\n] = %m[^\n] ", &key, &value);
+                key_file->offset++;
 
-                if (items_matched != 2) {
-                        if (items_matched == 1)
-                                fseeko (key_file->fp, offset, SEEK_SET);
+                ply_key_file_skip_whitespace (key_file);
 
-                        free (key);
-                        free (value);
+                value_offset = key_file->offset;
+                if (ply_key_file_skip_until (key_file, "\n") == 0) {
+                        key_file->offset = key_offset;
                         break;
                 }
+                value_end = key_file->offset;
+
+                ply_key_file_skip_whitespace (key_file);
+
+                key_file->contents[key_end] = '\0';
+                if (value_end < key_file->contents_size)
+                        key_file->contents[value_end] = '\0';
 
                 entry = calloc (1, sizeof(ply_key_file_entry_t));
 
-                entry->key = key;
-                entry->value = value;
+                entry->key = key_file->contents + key_offset;
+                entry->value = key_file->contents + value_offset;
 
-                ply_hashtable_insert (group->entries, entry->key, entry);
-        } while (items_matched != EOF);
+                ply_hashtable_insert (group->entries, (void *) entry->key, entry);
+        } while (key_file->offset < key_file->contents_size);
 
         return group;
 }
@@ -228,53 +378,46 @@ ply_key_file_load_group (ply_key_file_t *key_file,
 static bool
 ply_key_file_load_groups (ply_key_file_t *key_file)
 {
-        int items_matched;
         bool added_group = false;
         bool has_comments = false;
 
         do {
-                char *group_name;
-                int first_byte;
-
                 ply_key_file_group_t *group;
+                size_t name_offset;
 
-                first_byte = fgetc (key_file->fp);
-                if (first_byte == '#') {
-                        char *line_to_toss;
-                        size_t number_of_bytes;
-
-                        line_to_toss = NULL;
-                        number_of_bytes = 0;
+                ply_key_file_skip_whitespace (key_file);
 
-                        getline (&line_to_toss, &number_of_bytes,
-                                 key_file->fp);
-                        free (line_to_toss);
+                if (ply_key_file_peek_byte (key_file) == '#') {
+                        ply_key_file_skip_line (key_file);
                         has_comments = true;
-                        items_matched = 0;
                         continue;
                 }
-                ungetc (first_byte, key_file->fp);
-
-                group_name = NULL;
-                items_matched = fscanf (key_file->fp, " [ %m[^]] ] ", &group_name);
 
-                if (items_matched <= 0) {
+                if (ply_key_file_peek_byte (key_file) != '[') {
                         ply_trace ("key file has no %sgroups",
                                    added_group ? "more " : "");
                         break;
                 }
+                key_file->offset++;
 
-                assert (group_name != NULL);
-                group = ply_key_file_load_group (key_file, group_name);
+                ply_key_file_skip_whitespace (key_file);
 
-                free (group_name);
-
-                if (group == NULL)
+                name_offset = key_file->offset;
+                if (ply_key_file_skip_until (key_file, "]") == 0 ||
+                    ply_key_file_peek_byte (key_file) != ']') {
+                        ply_trace ("key file has malformed group header");
                         break;
+                }
 
-                ply_hashtable_insert (key_file->groups, group->name, group);
+                key_file->contents[key_file->offset] = '\0';
+                key_file->offset++;
+
+                group = ply_key_file_load_group (key_file,
+                                                 key_file->contents + name_offset);
+
+                ply_hashtable_insert (key_file->groups, (void *) group->name, group);
                 added_group = true;
-        } while (items_matched != EOF);
+        } while (key_file->offset < key_file->contents_size);
 
         if (!added_group && has_comments)
                 ply_trace ("key file has comments but no groups");
@@ -297,11 +440,97 @@ ply_key_file_load (ply_key_file_t *key_file)
         if (!was_loaded)
                 ply_trace ("was unable to load any groups");
 
-        ply_key_file_close_file (key_file);
-
         return was_loaded;
 }
 
+static bool
+ply_key_file_is_up_to_date (ply_key_file_t *key_file)
+{
+        struct stat file_info;
+
+        if (stat (key_file->filename, &file_info) < 0)
+                return false;
+
+        return file_info.st_dev == key_file->file_info.st_dev &&
+               file_info.st_ino == key_file->file_info.st_ino &&
+               file_info.st_size == key_file->file_info.st_size &&
+               file_info.st_mtim.tv_sec == key_file->file_info.st_mtim.tv_sec &&
+               file_info.st_mtim.tv_nsec == key_file->file_info.st_mtim.tv_nsec;
+}
+
+ply_key_file_t *
+ply_key_file_load_cached (const char *filename)
+{
+        ply_key_file_t *key_file;
+
+        pthread_mutex_lock (&key_file_cache_mutex);
+
+        if (key_file_cache == NULL) {
+                key_file_cache = ply_hashtable_new (ply_hashtable_string_hash,
+                                                    ply_hashtable_string_compare);
+                retired_key_files = ply_list_new ();
+        }
+
+        key_file = ply_hashtable_lookup (key_file_cache, (void *) filename);
+
+        if (key_file != NULL) {
+                if (ply_key_file_is_up_to_date (key_file)) {
+                        ply_trace ("reusing parsed key file %s", filename);
+                        goto out;
+                }
+
+                ply_trace ("key file %s changed since it was parsed", filename);
+                ply_hashtable_remove (key_file_cache, (void *) filename);
+                ply_list_append_data (retired_key_files, key_file);
+        }
+
+        key_file = ply_key_file_new (filename);
+        key_file->should_copy_contents = true;
+
+        if (!ply_key_file_load (key_file)) {
+                ply_key_file_free (key_file);
+                key_file = NULL;
+                goto out;
+        }
+
+        ply_hashtable_insert (key_file_cache, key_file->filename, key_file);
+out:
+        pthread_mutex_unlock (&key_file_cache_mutex);
+
+        return key_file;
+}
+
+static void
+ply_key_file_free_cached (void *key,
+                          void *data,
+                          void *user_data)
+{
+        ply_key_file_free (data);
+}
+
+void
+ply_key_file_free_cache (void)
+{
+        ply_list_node_t *node;
+
+        pthread_mutex_lock (&key_file_cache_mutex);
+
+        if (key_file_cache == NULL)
+                goto out;
+
+        ply_hashtable_foreach (key_file_cache, ply_key_file_free_cached, NULL);
+        ply_hashtable_free (key_file_cache);
+        key_file_cache = NULL;
+
+        ply_list_foreach (retired_key_files, node) {
+                ply_key_file_free (ply_list_node_get_data (node));
+        }
+        ply_list_free (retired_key_files);
+        retired_key_files = NULL;
+out:
+        pthread_mutex_unlock (&key_file_cache_mutex);
+}
+
 static ply_key_file_group_t *
 ply_key_file_find_group (ply_key_file_t *key_file,
                          const char     *group_name)
@@ -338,8 +567,8 @@ ply_key_file_has_key (ply_key_file_t *key_file,
         return entry != NULL;
 }
 
-static char *
-ply_key_file_get_raw_value (ply_key_file_t *key_file,
+static ply_key_file_entry_t *
+ply_key_file_look_up_entry (ply_key_file_t *key_file,
                             const char     *group_name,
                             const char     *key)
 {
@@ -360,7 +589,19 @@ ply_key_file_get_raw_value (ply_key_file_t *key_file,
                 return NULL;
         }
 
-        return entry->value;
+        return entry;
+}
+
+const char *
+ply_key_file_peek_value (ply_key_file_t *key_file,
+                         const char     *group_name,
+                         const char     *key)
+{
+        ply_key_file_entry_t *entry;
+
+        entry = ply_key_file_look_up_entry (key_file, group_name, key);
+
+        return entry ? entry->value : NULL;
 }
 
 char *
@@ -368,7 +609,7 @@ ply_key_file_get_value (ply_key_file_t *key_file,
                         const char     *group,
                         const char     *key)
 {
-        char *raw_value = ply_key_file_get_raw_value (key_file, group, key);
+        const char *raw_value = ply_key_file_peek_value (key_file, group, key);
 
         return raw_value ? strdup (raw_value) : NULL;
 }
@@ -378,19 +619,30 @@ ply_key_file_get_bool (ply_key_file_t *key_file,
                        const char     *group,
                        const char     *key)
 {
-        char *raw_value = ply_key_file_get_raw_value (key_file, group, key);
+        ply_key_file_entry_t *entry;
+        const char *raw_value;
+        bool value;
+
+        entry = ply_key_file_look_up_entry (key_file, group, key);
 
-        if (!raw_value)
+        if (!entry)
                 return false;
 
-        /* We treat "1", "y" and "yes" and "true" as true, all else is false */
-        if (strcasecmp (raw_value, "1") == 0 ||
-            strcasecmp (raw_value, "y") == 0 ||
-            strcasecmp (raw_value, "yes") == 0 ||
-            strcasecmp (raw_value, "true") == 0)
-                return true;
+        pthread_mutex_lock (&typed_value_mutex);
+        if (!entry->has_bool_value) {
+                raw_value = entry->value;
 
-        return false;
+                /* We treat "1", "y" and "yes" and "true" as true, all else is false */
+                entry->bool_value = strcasecmp (raw_value, "1") == 0 ||
+                                    strcasecmp (raw_value, "y") == 0 ||
+                                    strcasecmp (raw_value, "yes") == 0 ||
+                                    strcasecmp (raw_value, "true") == 0;
+                entry->has_bool_value = true;
+        }
+        value = entry->bool_value;
+        pthread_mutex_unlock (&typed_value_mutex);
+
+        return value;
 }
 
 double
@@ -399,12 +651,23 @@ ply_key_file_get_double (ply_key_file_t *key_file,
                          const char     *key,
                          double          default_value)
 {
-        char *raw_value = ply_key_file_get_raw_value (key_file, group, key);
+        ply_key_file_entry_t *entry;
+        double value;
+
+        entry = ply_key_file_look_up_entry (key_file, group, key);
 
-        if (!raw_value)
+        if (!entry)
                 return default_value;
 
-        return ply_strtod (raw_value);
+        pthread_mutex_lock (&typed_value_mutex);
+        if (!entry->has_double_value) {
+                entry->double_value = ply_strtod (entry->value);
+                entry->has_double_value = true;
+        }
+        value = entry->double_value;
+        pthread_mutex_unlock (&typed_value_mutex);
+
+        return value;
 }
 
 double
@@ -413,12 +676,23 @@ ply_key_file_get_long (ply_key_file_t *key_file,
                        const char     *key,
                        long            default_value)
 {
-        char *raw_value = ply_key_file_get_raw_value (key_file, group, key);
+        ply_key_file_entry_t *entry;
+        long value;
+
+        entry = ply_key_file_look_up_entry (key_file, group, key);
 
-        if (!raw_value)
+        if (!entry)
                 return default_value;
 
-        return strtol (raw_value, NULL, 0);
+        pthread_mutex_lock (&typed_value_mutex);
+        if (!entry->has_long_value) {
+                entry->long_value = strtol (entry->value, NULL, 0);
+                entry->has_long_value = true;
+        }
+        value = entry->long_value;
+        pthread_mutex_unlock (&typed_value_mutex);
+
+        return value;
 }
 
 static void
@@ -478,8 +752,6 @@ ply_key_file_load_groupless_file (ply_key_file_t *key_file)
         key_file->groupless_group =
                 ply_key_file_load_group (key_file, "NONE");
 
-        ply_key_file_close_file (key_file);
-
         return key_file->groupless_group != NULL;
 }
 
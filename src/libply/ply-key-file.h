@@ -36,6 +36,15 @@ typedef void (ply_key_file_foreach_func_t) (const char *group_name,
 ply_key_file_t *ply_key_file_new (const char *filename);
 void ply_key_file_free (ply_key_file_t *key_file);
 bool ply_key_file_load (ply_key_file_t *key_file);
+/* Returns an already parsed copy of the file if it hasn't changed on disk
+ * since it was last loaded this way, and loads it otherwise.  The key file
+ * belongs to the cache, stays valid until ply_key_file_free_cache (), and
+ * must not be freed by the caller.  Safe to call from any thread.  Callers
+ * on different threads may get the same key file back, and may look up
+ * values in it concurrently, but must not load it again themselves.
+ */
+ply_key_file_t *ply_key_file_load_cached (const char *filename);
+void ply_key_file_free_cache (void);
 /* For loading key=value pair files, which do not have ini style groups.
  * When a file is loaded this way, NULL must be passed as group_name
  * for subsequent ply_key_file_get_* calls.
@@ -44,6 +53,10 @@ bool ply_key_file_load_groupless_file (ply_key_file_t *key_file);
 bool ply_key_file_has_key (ply_key_file_t *key_file,
                            const char     *group_name,
                            const char     *key);
+/* Returns the value without copying it; it lives as long as the key file */
+const char *ply_key_file_peek_value (ply_key_file_t *key_file,
+                                     const char     *group_name,
+                                     const char     *key);
 char *ply_key_file_get_value (ply_key_file_t *key_file,
                               const char     *group_name,
                               const char     *key);
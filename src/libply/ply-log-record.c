@@ -0,0 +1,177 @@
+/* ply-log-record.c - structured boot log records
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-log-record.h"
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#define PLY_LOG_RECORD_MAGIC_SIZE 4
+
+static void
+write_uint32 (uint8_t *bytes,
+              uint32_t value)
+{
+        int i;
+
+        for (i = 0; i < 4; i++) {
+                bytes[i] = (value >> (i * 8)) & 0xff;
+        }
+}
+
+static void
+write_uint64 (uint8_t *bytes,
+              uint64_t value)
+{
+        int i;
+
+        for (i = 0; i < 8; i++) {
+                bytes[i] = (value >> (i * 8)) & 0xff;
+        }
+}
+
+static uint32_t
+read_uint32 (const uint8_t *bytes)
+{
+        uint32_t value = 0;
+        int i;
+
+        for (i = 3; i >= 0; i--) {
+                value = (value << 8) | bytes[i];
+        }
+
+        return value;
+}
+
+static uint64_t
+read_uint64 (const uint8_t *bytes)
+{
+        uint64_t value = 0;
+        int i;
+
+        for (i = 7; i >= 0; i--) {
+                value = (value << 8) | bytes[i];
+        }
+
+        return value;
+}
+
+uint64_t
+ply_log_record_get_timestamp (void)
+{
+        struct timespec now = { 0L, /* zero-filled */ };
+
+        clock_gettime (CLOCK_MONOTONIC, &now);
+
+        return ((uint64_t) now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+void
+ply_log_record_fill_header (uint8_t                 header[PLY_LOG_RECORD_HEADER_SIZE],
+                            ply_log_record_source_t source,
+                            uint64_t                timestamp,
+                            size_t                  payload_size)
+{
+        assert (payload_size <= PLY_LOG_RECORD_MAX_PAYLOAD_SIZE);
+
+        memcpy (header, PLY_LOG_RECORD_MAGIC, PLY_LOG_RECORD_MAGIC_SIZE);
+        write_uint32 (header + 4, payload_size);
+        write_uint64 (header + 8, timestamp);
+        write_uint32 (header + 16, source);
+}
+
+ply_log_record_parse_result_t
+ply_log_record_parse (const uint8_t    *data,
+                      size_t            size,
+                      ply_log_record_t *record,
+                      size_t           *record_size)
+{
+        uint32_t payload_size, source;
+
+        if (size < PLY_LOG_RECORD_MAGIC_SIZE) {
+                if (memcmp (data, PLY_LOG_RECORD_MAGIC, size) != 0)
+                        return PLY_LOG_RECORD_PARSE_RESULT_INVALID;
+                return PLY_LOG_RECORD_PARSE_RESULT_TRUNCATED;
+        }
+
+        if (memcmp (data, PLY_LOG_RECORD_MAGIC, PLY_LOG_RECORD_MAGIC_SIZE) != 0)
+                return PLY_LOG_RECORD_PARSE_RESULT_INVALID;
+
+        if (size < PLY_LOG_RECORD_HEADER_SIZE)
+                return PLY_LOG_RECORD_PARSE_RESULT_TRUNCATED;
+
+        payload_size = read_uint32 (data + 4);
+        source = read_uint32 (data + 16);
+
+        if (payload_size > PLY_LOG_RECORD_MAX_PAYLOAD_SIZE ||
+            source >= PLY_LOG_RECORD_NUMBER_OF_SOURCES)
+                return PLY_LOG_RECORD_PARSE_RESULT_INVALID;
+
+        if (size - PLY_LOG_RECORD_HEADER_SIZE < payload_size)
+                return PLY_LOG_RECORD_PARSE_RESULT_TRUNCATED;
+
+        record->source = source;
+        record->timestamp = read_uint64 (data + 8);
+        record->payload = (const char *) data + PLY_LOG_RECORD_HEADER_SIZE;
+        record->payload_size = payload_size;
+        *record_size = PLY_LOG_RECORD_HEADER_SIZE + payload_size;
+
+        return PLY_LOG_RECORD_PARSE_RESULT_OK;
+}
+
+size_t
+ply_log_record_find_next (const uint8_t *data,
+                          size_t         size)
+{
+        const uint8_t *next;
+
+        if (size <= 1)
+                return size;
+
+        next = memmem (data + 1, size - 1,
+                       PLY_LOG_RECORD_MAGIC, PLY_LOG_RECORD_MAGIC_SIZE);
+
+        if (next == NULL) {
+                /* The magic might be split off at the end */
+                return size < PLY_LOG_RECORD_MAGIC_SIZE ? size : size - (PLY_LOG_RECORD_MAGIC_SIZE - 1);
+        }
+
+        return next - data;
+}
+
+const char *
+ply_log_record_source_to_string (ply_log_record_source_t source)
+{
+        switch (source) {
+        case PLY_LOG_RECORD_SOURCE_DAEMON:
+                return "plymouthd";
+        case PLY_LOG_RECORD_SOURCE_CONSOLE:
+                return "console";
+        case PLY_LOG_RECORD_SOURCE_STATUS:
+                return "status";
+        case PLY_LOG_RECORD_SOURCE_TRACE:
+                return "trace";
+        case PLY_LOG_RECORD_NUMBER_OF_SOURCES:
+                break;
+        }
+
+        return "unknown";
+}
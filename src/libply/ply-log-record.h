@@ -0,0 +1,86 @@
+/* ply-log-record.h - structured boot log records
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_LOG_RECORD_H
+#define PLY_LOG_RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Each record is a fixed size header followed by the payload.  The
+ * header holds a magic number, the payload size, a CLOCK_MONOTONIC
+ * timestamp in microseconds and the source, all little endian.
+ *
+ * Records are only ever appended, so a crash can at worst leave a
+ * truncated record at the end.  If the logger had to drop bytes, the
+ * magic number lets readers find the next whole record.
+ */
+#define PLY_LOG_RECORD_MAGIC "PLYR"
+#define PLY_LOG_RECORD_HEADER_SIZE 20
+#define PLY_LOG_RECORD_MAX_PAYLOAD_SIZE (1024 * 1024)
+
+typedef enum
+{
+        PLY_LOG_RECORD_SOURCE_DAEMON = 0,
+        PLY_LOG_RECORD_SOURCE_CONSOLE,
+        PLY_LOG_RECORD_SOURCE_STATUS,
+        PLY_LOG_RECORD_SOURCE_TRACE,
+        PLY_LOG_RECORD_NUMBER_OF_SOURCES
+} ply_log_record_source_t;
+
+typedef enum
+{
+        PLY_LOG_RECORD_PARSE_RESULT_OK = 0,
+        PLY_LOG_RECORD_PARSE_RESULT_TRUNCATED,
+        PLY_LOG_RECORD_PARSE_RESULT_INVALID,
+} ply_log_record_parse_result_t;
+
+typedef struct
+{
+        ply_log_record_source_t source;
+        uint64_t                timestamp;
+        const char             *payload;
+        size_t                  payload_size;
+} ply_log_record_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+uint64_t ply_log_record_get_timestamp (void);
+void ply_log_record_fill_header (uint8_t                 header[PLY_LOG_RECORD_HEADER_SIZE],
+                                 ply_log_record_source_t source,
+                                 uint64_t                timestamp,
+                                 size_t                  payload_size);
+
+/* On success, record points into data and record_size is how many bytes
+ * of data it took up
+ */
+ply_log_record_parse_result_t ply_log_record_parse (const uint8_t    *data,
+                                                    size_t            size,
+                                                    ply_log_record_t *record,
+                                                    size_t           *record_size);
+
+/* Returns how many bytes to skip to get to what might be the next
+ * record, after a parse came back invalid
+ */
+size_t ply_log_record_find_next (const uint8_t *data,
+                                 size_t         size);
+const char *ply_log_record_source_to_string (ply_log_record_source_t source);
+#endif
+
+#endif /* PLY_LOG_RECORD_H */
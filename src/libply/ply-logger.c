@@ -26,10 +26,13 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/fcntl.h>
 #include <sys/file.h>
 #include <sys/stat.h>
@@ -38,7 +41,9 @@
 #include <unistd.h>
 
 #include "ply-utils.h"
+#include "ply-buffer.h"
 #include "ply-list.h"
+#include "ply-log-record.h"
 
 #ifndef PLY_LOGGER_OPEN_FLAGS
 #define PLY_LOGGER_OPEN_FLAGS (O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW | O_CLOEXEC)
@@ -48,6 +53,7 @@
 #define PLY_LOGGER_MAX_INJECTION_SIZE 4096
 #endif
 
+/* Once the buffer is full, the oldest bytes get overwritten */
 #ifndef PLY_LOGGER_MAX_BUFFER_CAPACITY
 #define PLY_LOGGER_MAX_BUFFER_CAPACITY (8 * 4096)
 #endif
@@ -58,19 +64,44 @@ typedef struct
         void                       *user_data;
 } ply_logger_filter_t;
 
+static __thread ply_buffer_t *redirected_thread_messages;
+
 struct _ply_logger
 {
         int                       output_fd;
         bool                      output_fd_is_terminal;
         char                     *filename;
 
+        /* Ring buffer of bytes that haven't been written out yet.  Only
+         * the thread injecting messages moves write_position, and it
+         * does so without taking any locks.  read_position is moved by
+         * whoever drains the buffer, but also gets pushed forward by the
+         * injecting thread when it overwrites bytes that weren't written
+         * out in time.  Positions only ever grow, so they're taken modulo
+         * the capacity to index into the buffer.
+         */
         char                     *buffer;
-        size_t                    buffer_size;
-        size_t                    buffer_capacity;
+        atomic_size_t             read_position;
+        atomic_size_t             write_position;
+
+        /* Held while draining, so bytes hit the fd in order.  It's never
+         * taken by the injecting thread unless it flushes.
+         */
+        pthread_mutex_t           drain_mutex;
+        char                     *drain_buffer;
+        atomic_size_t             number_of_dropped_bytes;
+
+        pthread_t                 writer_thread;
+        int                       writer_wakeup_fd;
+        atomic_bool               writer_is_waiting;
+        atomic_bool               writer_should_stop;
 
         ply_logger_flush_policy_t flush_policy;
         ply_list_t               *filters;
 
+        uint32_t                  has_writer_thread : 1;
+        uint32_t                  writes_records : 1;
+
         uint32_t                  is_enabled : 1;
         uint32_t                  tracing_is_enabled : 1;
 };
@@ -87,6 +118,9 @@ static bool ply_logger_write (ply_logger_t *logger,
 static bool ply_logger_buffer (ply_logger_t *logger,
                                const char   *string,
                                size_t        length);
+static bool ply_logger_write_message (ply_logger_t *logger,
+                                      const char   *message,
+                                      size_t        length);
 static bool ply_logger_flush_buffer (ply_logger_t *logger);
 
 static bool
@@ -147,52 +181,150 @@ ply_logger_write (ply_logger_t *logger,
         return true;
 }
 
+/* Writes a note from the logger itself, in whatever format the log is in
+ */
 static bool
-ply_logger_flush_buffer (ply_logger_t *logger)
+ply_logger_write_message (ply_logger_t *logger,
+                          const char   *message,
+                          size_t        length)
 {
-        assert (logger != NULL);
+        uint8_t header[PLY_LOG_RECORD_HEADER_SIZE];
 
-        if (logger->buffer_size == 0)
-                return true;
+        if (logger->writes_records) {
+                ply_log_record_fill_header (header, PLY_LOG_RECORD_SOURCE_DAEMON,
+                                            ply_log_record_get_timestamp (), length);
+                if (!ply_logger_write (logger, (const char *) header, sizeof(header), false))
+                        return false;
+        }
 
-        if (!ply_logger_write (logger, logger->buffer, logger->buffer_size, true))
-                return false;
+        return ply_logger_write (logger, message, length, false);
+}
 
-        memset (logger->buffer, '\0', logger->buffer_size);
-        logger->buffer_size = 0;
+/* Like ply_logger_write, but returns how much actually made it out, so
+ * a failed write only loses its place in the queue, not the bytes
+ */
+static size_t
+ply_logger_write_queued_bytes (ply_logger_t *logger,
+                               const char   *bytes,
+                               size_t        length)
+{
+        size_t total_bytes_written = 0;
 
-        return true;
+        while (total_bytes_written < length) {
+                ssize_t bytes_written;
+
+                bytes_written = write (logger->output_fd,
+                                       bytes + total_bytes_written,
+                                       length - total_bytes_written);
+
+                if (bytes_written > 0) {
+                        total_bytes_written += bytes_written;
+                        continue;
+                }
+
+                if (bytes_written < 0 && errno == EINTR)
+                        continue;
+
+                if (bytes_written < 0)
+                        ply_logger_write_exception (logger, strerror (errno));
+                break;
+        }
+
+        return total_bytes_written;
 }
 
+/* Must be called with the drain mutex held */
 static bool
-ply_logger_increase_buffer_size (ply_logger_t *logger)
+ply_logger_drain_buffer (ply_logger_t *logger)
 {
+        size_t read_position, write_position, length, offset, start;
+        size_t number_of_dropped_bytes, number_of_bytes_written;
+
         assert (logger != NULL);
 
-        if ((logger->buffer_capacity * 2) > PLY_LOGGER_MAX_BUFFER_CAPACITY)
-                return false;
+        while (true) {
+                read_position = atomic_load (&logger->read_position);
+                write_position = atomic_load (&logger->write_position);
 
-        logger->buffer_capacity *= 2;
+                if (read_position == write_position)
+                        break;
+
+                length = write_position - read_position;
+                if (length > PLY_LOGGER_MAX_BUFFER_CAPACITY) {
+                        read_position = write_position - PLY_LOGGER_MAX_BUFFER_CAPACITY;
+                        length = PLY_LOGGER_MAX_BUFFER_CAPACITY;
+                }
+
+                start = read_position % PLY_LOGGER_MAX_BUFFER_CAPACITY;
+                offset = MIN (length, PLY_LOGGER_MAX_BUFFER_CAPACITY - start);
+                memcpy (logger->drain_buffer, logger->buffer + start, offset);
+                memcpy (logger->drain_buffer + offset, logger->buffer, length - offset);
+
+                /* The injecting thread moves the read position before it
+                 * overwrites anything, so whatever is behind it now may
+                 * have changed while we were copying
+                 */
+                atomic_thread_fence (memory_order_seq_cst);
+                offset = atomic_load (&logger->read_position) - read_position;
+                if ((ssize_t) offset < 0)
+                        offset = 0;
+                else if (offset > length)
+                        offset = length;
+
+                number_of_dropped_bytes = atomic_exchange (&logger->number_of_dropped_bytes, 0);
+                if (number_of_dropped_bytes > 0) {
+                        char message[64];
+                        int message_length;
+
+                        message_length = snprintf (message, sizeof(message),
+                                                   "[%zu bytes of log dropped]\n",
+                                                   number_of_dropped_bytes);
+                        ply_logger_write_message (logger, message, message_length);
+                }
+
+                number_of_bytes_written = 0;
+                if (offset < length)
+                        number_of_bytes_written = ply_logger_write_queued_bytes (logger,
+                                                                                 logger->drain_buffer + offset,
+                                                                                 length - offset);
+
+                /* Only move past what was written, leaving the rest queued
+                 * for the next drain.  The injecting thread may have pushed
+                 * the read position ahead in the meantime, so only move it
+                 * forward if it's still behind
+                 */
+                write_position = read_position + offset + number_of_bytes_written;
+                read_position = atomic_load (&logger->read_position);
+                while ((ssize_t) (write_position - read_position) > 0 &&
+                       !atomic_compare_exchange_weak (&logger->read_position,
+                                                      &read_position, write_position)) {
+                }
+
+                if (offset + number_of_bytes_written < length)
+                        return false;
+        }
 
-        logger->buffer = realloc (logger->buffer, logger->buffer_capacity);
         return true;
 }
 
-static void
-ply_logger_decapitate_buffer (ply_logger_t *logger,
-                              size_t        bytes_in_head)
+static bool
+ply_logger_flush_buffer (ply_logger_t *logger)
 {
+        bool flushed;
+        int error;
+
         assert (logger != NULL);
 
-        bytes_in_head = MIN (logger->buffer_size, bytes_in_head);
+        /* If we crashed while draining, the lock is already ours
+         */
+        error = pthread_mutex_lock (&logger->drain_mutex);
 
-        if (bytes_in_head == logger->buffer_size) {
-                logger->buffer_size = 0;
-        } else {
-                memmove (logger->buffer, logger->buffer + bytes_in_head,
-                         logger->buffer_size - bytes_in_head);
-                logger->buffer_size -= bytes_in_head;
-        }
+        flushed = ply_logger_drain_buffer (logger);
+
+        if (error == 0)
+                pthread_mutex_unlock (&logger->drain_mutex);
+
+        return flushed;
 }
 
 static bool
@@ -200,28 +332,154 @@ ply_logger_buffer (ply_logger_t *logger,
                    const char   *string,
                    size_t        length)
 {
+        size_t read_position, write_position, oldest_position, start, offset;
+
         assert (logger != NULL);
 
-        if ((logger->buffer_size + length) >= logger->buffer_capacity) {
-                if (!ply_logger_increase_buffer_size (logger)) {
-                        ply_logger_decapitate_buffer (logger, length);
+        if (length > PLY_LOGGER_MAX_BUFFER_CAPACITY) {
+                atomic_fetch_add (&logger->number_of_dropped_bytes,
+                                  length - PLY_LOGGER_MAX_BUFFER_CAPACITY);
+                string += length - PLY_LOGGER_MAX_BUFFER_CAPACITY;
+                length = PLY_LOGGER_MAX_BUFFER_CAPACITY;
+        }
 
-                        if ((logger->buffer_size + length) >= logger->buffer_capacity)
-                                if (!ply_logger_increase_buffer_size (logger))
-                                        return false;
+        write_position = atomic_load_explicit (&logger->write_position,
+                                               memory_order_relaxed);
+
+        /* Make room by giving up on the oldest bytes, before touching them
+         */
+        oldest_position = write_position + length - PLY_LOGGER_MAX_BUFFER_CAPACITY;
+        read_position = atomic_load (&logger->read_position);
+        while ((ssize_t) (oldest_position - read_position) > 0) {
+                if (atomic_compare_exchange_weak (&logger->read_position,
+                                                  &read_position, oldest_position)) {
+                        atomic_fetch_add (&logger->number_of_dropped_bytes,
+                                          oldest_position - read_position);
+                        break;
                 }
         }
 
-        assert (logger->buffer_size + length < logger->buffer_capacity);
+        start = write_position % PLY_LOGGER_MAX_BUFFER_CAPACITY;
+        offset = MIN (length, PLY_LOGGER_MAX_BUFFER_CAPACITY - start);
+        memcpy (logger->buffer + start, string, offset);
+        memcpy (logger->buffer, string + offset, length - offset);
 
-        memcpy (logger->buffer + logger->buffer_size,
-                string, length);
+        atomic_store (&logger->write_position, write_position + length);
 
-        logger->buffer_size += length;
+        return true;
+}
+
+static void *
+ply_logger_writer_thread (void *user_data)
+{
+        ply_logger_t *logger = user_data;
+        uint64_t value;
+        bool flushed;
+
+        while (!atomic_load (&logger->writer_should_stop)) {
+                flushed = ply_logger_flush_buffer (logger);
+
+                atomic_store (&logger->writer_is_waiting, true);
+
+                /* Bytes that failed to write stay queued, so don't spin on
+                 * them; try again when more messages come in
+                 */
+                if ((flushed && atomic_load (&logger->read_position) != atomic_load (&logger->write_position)) ||
+                    atomic_load (&logger->writer_should_stop)) {
+                        atomic_store (&logger->writer_is_waiting, false);
+                        continue;
+                }
+
+                if (read (logger->writer_wakeup_fd, &value, sizeof(value)) < 0 &&
+                    errno != EINTR && errno != EAGAIN)
+                        break;
+
+                atomic_store (&logger->writer_is_waiting, false);
+        }
+
+        return NULL;
+}
+
+static void
+ply_logger_wake_writer (ply_logger_t *logger)
+{
+        uint64_t value = 1;
+
+        if (!atomic_exchange (&logger->writer_is_waiting, false))
+                return;
+
+        write (logger->writer_wakeup_fd, &value, sizeof(value));
+}
+
+bool
+ply_logger_start_writer_thread (ply_logger_t *logger)
+{
+        assert (logger != NULL);
+
+        if (logger->has_writer_thread)
+                return true;
+
+        logger->writer_wakeup_fd = eventfd (0, EFD_CLOEXEC);
+
+        if (logger->writer_wakeup_fd < 0)
+                return false;
+
+        atomic_store (&logger->writer_should_stop, false);
+        atomic_store (&logger->writer_is_waiting, false);
+
+        if (pthread_create (&logger->writer_thread, NULL,
+                            ply_logger_writer_thread, logger) != 0) {
+                close (logger->writer_wakeup_fd);
+                logger->writer_wakeup_fd = -1;
+                return false;
+        }
+
+        logger->has_writer_thread = true;
 
         return true;
 }
 
+void
+ply_logger_stop_writer_thread (ply_logger_t *logger)
+{
+        uint64_t value = 1;
+
+        assert (logger != NULL);
+
+        if (!logger->has_writer_thread)
+                return;
+
+        atomic_store (&logger->writer_should_stop, true);
+        write (logger->writer_wakeup_fd, &value, sizeof(value));
+        pthread_join (logger->writer_thread, NULL);
+
+        close (logger->writer_wakeup_fd);
+        logger->writer_wakeup_fd = -1;
+        logger->has_writer_thread = false;
+}
+
+void
+ply_logger_schedule_flush (ply_logger_t *logger)
+{
+        assert (logger != NULL);
+
+        if (redirected_thread_messages != NULL)
+                return;
+
+        if (logger->has_writer_thread) {
+                ply_logger_wake_writer (logger);
+                return;
+        }
+
+        ply_logger_flush (logger);
+}
+
+void
+ply_logger_redirect_thread_messages (ply_buffer_t *buffer)
+{
+        redirected_thread_messages = buffer;
+}
+
 ply_logger_t *
 ply_logger_new (void)
 {
@@ -235,9 +493,23 @@ ply_logger_new (void)
         logger->is_enabled = true;
         logger->tracing_is_enabled = false;
 
-        logger->buffer_capacity = 4096;
-        logger->buffer = calloc (1, logger->buffer_capacity);
-        logger->buffer_size = 0;
+        logger->buffer = calloc (1, PLY_LOGGER_MAX_BUFFER_CAPACITY);
+        logger->drain_buffer = calloc (1, PLY_LOGGER_MAX_BUFFER_CAPACITY);
+        atomic_init (&logger->read_position, 0);
+        atomic_init (&logger->write_position, 0);
+        atomic_init (&logger->number_of_dropped_bytes, 0);
+        logger->writer_wakeup_fd = -1;
+        atomic_init (&logger->writer_is_waiting, false);
+        atomic_init (&logger->writer_should_stop, false);
+
+        {
+                pthread_mutexattr_t attributes;
+
+                pthread_mutexattr_init (&attributes);
+                pthread_mutexattr_settype (&attributes, PTHREAD_MUTEX_ERRORCHECK);
+                pthread_mutex_init (&logger->drain_mutex, &attributes);
+                pthread_mutexattr_destroy (&attributes);
+        }
 
         logger->filters = ply_list_new ();
 
@@ -298,6 +570,8 @@ ply_logger_free (ply_logger_t *logger)
         if (logger == NULL)
                 return;
 
+        ply_logger_stop_writer_thread (logger);
+
         if (logger->output_fd >= 0) {
                 if (ply_logger_is_logging (logger))
                         ply_logger_flush (logger);
@@ -306,7 +580,10 @@ ply_logger_free (ply_logger_t *logger)
 
         ply_logger_free_filters (logger);
 
+        pthread_mutex_destroy (&logger->drain_mutex);
+
         free (logger->filename);
+        free (logger->drain_buffer);
         free (logger->buffer);
         free (logger);
 }
@@ -340,7 +617,9 @@ ply_logger_open_file (ply_logger_t *logger,
                 /* This uses uname -v date format */
                 strftime (header, sizeof(header),
                           "------------ %a %b %d %T %Z %Y ------------\n", tm);
-                ply_logger_write (logger, header, strlen (header), true);
+                pthread_mutex_lock (&logger->drain_mutex);
+                ply_logger_write_message (logger, header, strlen (header));
+                pthread_mutex_unlock (&logger->drain_mutex);
         }
 
         return true;
@@ -354,8 +633,11 @@ ply_logger_close_file (ply_logger_t *logger)
         if (logger->output_fd < 0)
                 return;
 
+        pthread_mutex_lock (&logger->drain_mutex);
         close (logger->output_fd);
-        ply_logger_set_output_fd (logger, -1);
+        logger->output_fd = -1;
+        logger->output_fd_is_terminal = false;
+        pthread_mutex_unlock (&logger->drain_mutex);
 }
 
 void
@@ -364,8 +646,12 @@ ply_logger_set_output_fd (ply_logger_t *logger,
 {
         assert (logger != NULL);
 
+        /* Don't pull the fd out from under the writer thread
+         */
+        pthread_mutex_lock (&logger->drain_mutex);
         logger->output_fd = fd;
         logger->output_fd_is_terminal = isatty (fd);
+        pthread_mutex_unlock (&logger->drain_mutex);
 }
 
 int
@@ -505,6 +791,11 @@ ply_logger_inject_bytes (ply_logger_t *logger,
         assert (bytes != NULL);
         assert (number_of_bytes != 0);
 
+        if (redirected_thread_messages != NULL) {
+                ply_buffer_append_bytes (redirected_thread_messages, bytes, number_of_bytes);
+                return;
+        }
+
         filtered_bytes = NULL;
         filtered_size = 0;
         node = ply_list_get_first_node (logger->filters);
@@ -549,7 +840,60 @@ ply_logger_inject_bytes (ply_logger_t *logger,
                 || (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_EVERY_TIME));
 
         if (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_EVERY_TIME)
-                ply_logger_flush (logger);
+                ply_logger_schedule_flush (logger);
+}
+
+void
+ply_logger_set_writes_records (ply_logger_t *logger,
+                               bool          writes_records)
+{
+        assert (logger != NULL);
+
+        logger->writes_records = writes_records;
+}
+
+bool
+ply_logger_writes_records (ply_logger_t *logger)
+{
+        assert (logger != NULL);
+
+        return logger->writes_records;
+}
+
+void
+ply_logger_inject_record (ply_logger_t           *logger,
+                          ply_log_record_source_t source,
+                          const void             *bytes,
+                          size_t                  number_of_bytes)
+{
+        uint8_t header[PLY_LOG_RECORD_HEADER_SIZE];
+
+        assert (logger != NULL);
+        assert (logger->writes_records);
+        assert (bytes != NULL);
+
+        if (!ply_logger_is_logging (logger))
+                return;
+
+        /* Filters work on text, so records skip them
+         */
+        while (number_of_bytes > 0) {
+                size_t payload_size;
+
+                /* Keep whole records well inside the ring */
+                payload_size = MIN (number_of_bytes, PLY_LOGGER_MAX_BUFFER_CAPACITY / 4);
+                ply_log_record_fill_header (header, source,
+                                            ply_log_record_get_timestamp (),
+                                            payload_size);
+                ply_logger_buffer (logger, (const char *) header, sizeof(header));
+                ply_logger_buffer (logger, bytes, payload_size);
+
+                bytes = (const char *) bytes + payload_size;
+                number_of_bytes -= payload_size;
+        }
+
+        if (logger->flush_policy == PLY_LOGGER_FLUSH_POLICY_EVERY_TIME)
+                ply_logger_schedule_flush (logger);
 }
 
 void
@@ -29,6 +29,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "ply-buffer.h"
+#include "ply-log-record.h"
+
 typedef struct _ply_logger ply_logger_t;
 
 typedef enum
@@ -54,6 +57,21 @@ void ply_logger_set_output_fd (ply_logger_t *logger,
                                int           fd);
 int ply_logger_get_output_fd (ply_logger_t *logger);
 bool ply_logger_flush (ply_logger_t *logger);
+
+/* Once a writer thread is running, buffered bytes get written out in the
+ * background and ply_logger_schedule_flush () doesn't block.
+ * ply_logger_flush () still waits for everything buffered so far to be
+ * written.  Only one thread may inject messages at a time.
+ */
+bool ply_logger_start_writer_thread (ply_logger_t *logger);
+void ply_logger_stop_writer_thread (ply_logger_t *logger);
+void ply_logger_schedule_flush (ply_logger_t *logger);
+
+/* Until called again with NULL, messages injected from the calling thread
+ * into any logger are appended to buffer instead.  Other threads can
+ * collect their messages this way and hand them to the injecting thread.
+ */
+void ply_logger_redirect_thread_messages (ply_buffer_t *buffer);
 void ply_logger_set_flush_policy (ply_logger_t             *logger,
                                   ply_logger_flush_policy_t policy);
 ply_logger_flush_policy_t ply_logger_get_flush_policy (ply_logger_t *logger);
@@ -62,6 +80,17 @@ bool ply_logger_is_logging (ply_logger_t *logger);
 void ply_logger_inject_bytes (ply_logger_t *logger,
                               const void   *bytes,
                               size_t        number_of_bytes);
+
+/* Makes the log a stream of ply_log_record_t records instead of plain
+ * text.  Messages from the logger itself become daemon records.
+ */
+void ply_logger_set_writes_records (ply_logger_t *logger,
+                                    bool          writes_records);
+bool ply_logger_writes_records (ply_logger_t *logger);
+void ply_logger_inject_record (ply_logger_t           *logger,
+                               ply_log_record_source_t source,
+                               const void             *bytes,
+                               size_t                  number_of_bytes);
 void ply_logger_add_filter (ply_logger_t               *logger,
                             ply_logger_filter_handler_t filter_handler,
                             void                       *user_data);
@@ -94,7 +123,7 @@ bool ply_logger_is_tracing_to_terminal (ply_logger_t *logger);
                         struct timespec timespec = { 0, 0 };                                   \
                         char buf[128];                                                         \
                         clock_gettime (CLOCK_MONOTONIC, &timespec);                            \
-                        ply_logger_flush (logger);                                             \
+                        ply_logger_schedule_flush (logger);                                    \
                         snprintf (buf, sizeof(buf),                                            \
                                   "%02d:%02d:%02d.%03d %s:%d:%s",                              \
                                   (int) (timespec.tv_sec / 3600),                               \
@@ -106,7 +135,7 @@ bool ply_logger_is_tracing_to_terminal (ply_logger_t *logger);
                         ply_logger_inject (logger,                                             \
                                            "%-75.75s: " format "\n",                           \
                                            buf, ## args);                                      \
-                        ply_logger_flush (logger);                                             \
+                        ply_logger_schedule_flush (logger);                                    \
                         errno = _old_errno;                                                    \
                 }                                                                        \
         }                                                                            \
@@ -0,0 +1,278 @@
+/* ply-phase-tracer.c - startup phase timestamps
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-phase-tracer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ply-buffer.h"
+#include "ply-log-record.h"
+#include "ply-utils.h"
+
+typedef struct
+{
+        const char *phase;
+        uint64_t    timestamp;
+        pid_t       thread_id;
+        char        type;
+        char        detail[PLY_PHASE_TRACER_MAX_DETAIL_SIZE];
+
+        /* Set last, so readers skip events that are still being filled in */
+        bool        is_complete;
+} ply_phase_event_t;
+
+static ply_phase_event_t events[PLY_PHASE_TRACER_MAX_EVENTS];
+static unsigned int number_of_events;
+static ply_phase_event_t marks[PLY_PHASE_TRACER_MAX_MARKS];
+static unsigned int number_of_marks;
+static unsigned int number_of_dropped_events;
+
+static void
+ply_phase_tracer_add_event (char        type,
+                            const char *phase,
+                            const char *detail)
+{
+        ply_phase_event_t *event;
+        unsigned int index;
+
+        if (type == 'i') {
+                index = __atomic_fetch_add (&number_of_marks, 1, __ATOMIC_RELAXED);
+
+                if (index >= PLY_PHASE_TRACER_MAX_MARKS) {
+                        __atomic_fetch_add (&number_of_dropped_events, 1, __ATOMIC_RELAXED);
+                        return;
+                }
+
+                event = &marks[index];
+        } else {
+                index = __atomic_fetch_add (&number_of_events, 1, __ATOMIC_RELAXED);
+
+                if (index >= PLY_PHASE_TRACER_MAX_EVENTS) {
+                        __atomic_fetch_add (&number_of_dropped_events, 1, __ATOMIC_RELAXED);
+                        return;
+                }
+
+                event = &events[index];
+        }
+        event->timestamp = ply_log_record_get_timestamp ();
+        event->thread_id = syscall (SYS_gettid);
+        event->type = type;
+        event->phase = phase;
+
+        /* Keep the end of long details, that's the telling part of a path.
+         * Cut on a character boundary, so the JSON stays valid UTF-8.
+         */
+        if (detail != NULL) {
+                size_t length;
+
+                length = strlen (detail);
+
+                if (length >= sizeof(event->detail)) {
+                        detail += length - (sizeof(event->detail) - 1);
+
+                        while ((*detail & 0xC0) == 0x80)
+                                detail++;
+                }
+
+                strcpy (event->detail, detail);
+        }
+
+        __atomic_store_n (&event->is_complete, true, __ATOMIC_RELEASE);
+}
+
+void
+ply_phase_tracer_begin (const char *phase,
+                        const char *detail)
+{
+        ply_phase_tracer_add_event ('B', phase, detail);
+}
+
+void
+ply_phase_tracer_end (const char *phase,
+                      const char *detail)
+{
+        ply_phase_tracer_add_event ('E', phase, detail);
+}
+
+void
+ply_phase_tracer_mark (const char *phase,
+                       const char *detail)
+{
+        ply_phase_tracer_add_event ('i', phase, detail);
+}
+
+static bool
+ply_phase_tracer_event_is_complete (ply_phase_event_t *event)
+{
+        return __atomic_load_n (&event->is_complete, __ATOMIC_ACQUIRE);
+}
+
+typedef struct
+{
+        unsigned int event_index;
+        unsigned int number_of_events;
+        unsigned int mark_index;
+        unsigned int number_of_marks;
+} ply_phase_tracer_iter_t;
+
+static void
+ply_phase_tracer_iter_init (ply_phase_tracer_iter_t *iter)
+{
+        iter->event_index = 0;
+        iter->number_of_events = MIN (__atomic_load_n (&number_of_events, __ATOMIC_RELAXED),
+                                      PLY_PHASE_TRACER_MAX_EVENTS);
+        iter->mark_index = 0;
+        iter->number_of_marks = MIN (__atomic_load_n (&number_of_marks, __ATOMIC_RELAXED),
+                                     PLY_PHASE_TRACER_MAX_MARKS);
+}
+
+/* Walks phases and marks together in time order, skipping events that
+ * are still being filled in
+ */
+static ply_phase_event_t *
+ply_phase_tracer_iter_next (ply_phase_tracer_iter_t *iter)
+{
+        ply_phase_event_t *event, *mark;
+
+        while (iter->event_index < iter->number_of_events ||
+               iter->mark_index < iter->number_of_marks) {
+                event = NULL;
+                mark = NULL;
+
+                if (iter->event_index < iter->number_of_events)
+                        event = &events[iter->event_index];
+
+                if (iter->mark_index < iter->number_of_marks)
+                        mark = &marks[iter->mark_index];
+
+                if (mark != NULL &&
+                    (event == NULL || !ply_phase_tracer_event_is_complete (mark) ||
+                     (ply_phase_tracer_event_is_complete (event) &&
+                      mark->timestamp < event->timestamp))) {
+                        iter->mark_index++;
+                        event = mark;
+                } else {
+                        iter->event_index++;
+                }
+
+                if (ply_phase_tracer_event_is_complete (event))
+                        return event;
+        }
+
+        return NULL;
+}
+
+void
+ply_phase_tracer_append_text (ply_buffer_t *buffer)
+{
+        ply_phase_tracer_iter_t iter;
+        ply_phase_event_t *event;
+
+        ply_phase_tracer_iter_init (&iter);
+
+        while ((event = ply_phase_tracer_iter_next (&iter)) != NULL) {
+                const char *type;
+
+                switch (event->type) {
+                case 'B':
+                        type = "begin";
+                        break;
+                case 'E':
+                        type = "end";
+                        break;
+                default:
+                        type = "mark";
+                        break;
+                }
+
+                ply_buffer_append (buffer, "%llu.%06llu %-5s %s%s%s\n",
+                                   (unsigned long long) (event->timestamp / 1000000),
+                                   (unsigned long long) (event->timestamp % 1000000),
+                                   type, event->phase,
+                                   event->detail[0] != '\0' ? " " : "",
+                                   event->detail);
+        }
+
+        if (number_of_dropped_events > 0)
+                ply_buffer_append (buffer, "(%u events dropped)\n", number_of_dropped_events);
+}
+
+static void
+ply_phase_tracer_append_json_string (ply_buffer_t *buffer,
+                                     const char   *string)
+{
+        const char *p;
+
+        ply_buffer_append_bytes (buffer, "\"", 1);
+
+        for (p = string; *p != '\0'; p++) {
+                if (*p == '"' || *p == '\\')
+                        ply_buffer_append (buffer, "\\%c", *p);
+                else if ((unsigned char) *p < 0x20)
+                        ply_buffer_append (buffer, "\\u%04x", (unsigned char) *p);
+                else
+                        ply_buffer_append_bytes (buffer, p, 1);
+        }
+
+        ply_buffer_append_bytes (buffer, "\"", 1);
+}
+
+void
+ply_phase_tracer_append_json (ply_buffer_t *buffer)
+{
+        ply_phase_tracer_iter_t iter;
+        ply_phase_event_t *event;
+        bool is_first = true;
+        pid_t pid;
+
+        ply_phase_tracer_iter_init (&iter);
+        pid = getpid ();
+
+        ply_buffer_append (buffer, "{\"traceEvents\":[");
+
+        while ((event = ply_phase_tracer_iter_next (&iter)) != NULL) {
+                ply_buffer_append (buffer, "%s\n{\"name\":", is_first ? "" : ",");
+                ply_phase_tracer_append_json_string (buffer, event->phase);
+                ply_buffer_append (buffer,
+                                   ",\"cat\":\"startup\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%d",
+                                   event->type, (unsigned long long) event->timestamp,
+                                   (int) pid, (int) event->thread_id);
+
+                /* Instant events only show up on their own thread's track */
+                if (event->type == 'i')
+                        ply_buffer_append (buffer, ",\"s\":\"t\"");
+
+                if (event->detail[0] != '\0') {
+                        ply_buffer_append (buffer, ",\"args\":{\"detail\":");
+                        ply_phase_tracer_append_json_string (buffer, event->detail);
+                        ply_buffer_append (buffer, "}");
+                }
+
+                ply_buffer_append (buffer, "}");
+                is_first = false;
+        }
+
+        ply_buffer_append (buffer, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":%u}}\n",
+                           number_of_dropped_events);
+}
@@ -0,0 +1,53 @@
+/* ply-phase-tracer.h - startup phase timestamps
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_PHASE_TRACER_H
+#define PLY_PHASE_TRACER_H
+
+#include "ply-buffer.h"
+
+/* Records when startup phases begin and end, so it's possible to see
+ * where the time between exec and the first frame goes.  Events go in a
+ * fixed size array and are never freed, so recording is cheap and safe
+ * from any thread.  Marks get slots of their own, so milestones like the
+ * first frame are kept even once phases have filled theirs.  Phase names
+ * must outlive the process (string literals), details are copied,
+ * keeping the end if they're too long.
+ */
+#define PLY_PHASE_TRACER_MAX_EVENTS 512
+#define PLY_PHASE_TRACER_MAX_MARKS 16
+#define PLY_PHASE_TRACER_MAX_DETAIL_SIZE 40
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+void ply_phase_tracer_begin (const char *phase,
+                             const char *detail);
+void ply_phase_tracer_end (const char *phase,
+                           const char *detail);
+/* For things that happen at a point in time, like the first frame */
+void ply_phase_tracer_mark (const char *phase,
+                            const char *detail);
+
+/* One line per event, with CLOCK_MONOTONIC timestamps in seconds */
+void ply_phase_tracer_append_text (ply_buffer_t *buffer);
+
+/* Chrome trace event format, for chrome://tracing or Perfetto */
+void ply_phase_tracer_append_json (ply_buffer_t *buffer);
+#endif
+
+#endif /* PLY_PHASE_TRACER_H */
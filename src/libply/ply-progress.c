@@ -28,15 +28,20 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 
+#include "ply-buffer.h"
+#include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-progress.h"
@@ -50,28 +55,72 @@
 #define DEFAULT_BOOT_DURATION 60.0
 #endif
 
+#define PLY_PROGRESS_CACHE_MAGIC   0x676f7270 /* "prog" */
+#define PLY_PROGRESS_CACHE_VERSION 1
 
-struct _ply_progress
-{
-        double      start_time;
-        double      pause_time;
-        double      scalar;
-        double      last_percentage;
-        double      last_percentage_time;
-        double      dead_time;
-        double      next_message_percentage;
-        ply_list_t *current_message_list;
-        ply_list_t *previous_message_list;
-        uint32_t    paused : 1;
-};
+/* How much this boot's timing of a message counts against the history.
+ * Messages seen in only a few boots are averaged evenly until they have
+ * enough history for this weight to take over.
+ */
+#define MESSAGE_TIME_SMOOTHING 0.3
 
+/* Messages that don't show up for this many boots in a row are forgotten */
+#define MAX_MISSED_BOOTS 3
+
+/* How far one message can move the boot length estimate, once it has been
+ * seen in enough boots to be trusted fully
+ */
+#define MAX_SCALAR_WEIGHT      0.5
+#define BOOTS_FOR_FULL_WEIGHT  3
+
+/* For messages from this boot time is in seconds, for messages from the
+ * cache it's the fraction of the boot that had passed when they showed up.
+ */
 typedef struct
 {
         double   time;
         char    *string;
+        uint32_t number_of_boots;
+        uint32_t missed_boots;
         uint32_t disabled : 1;
+        uint32_t was_seen : 1;
 } ply_progress_message_t;
 
+struct _ply_progress
+{
+        double                   start_time;
+        double                   pause_time;
+        double                   scalar;
+        double                   last_percentage;
+        double                   last_percentage_time;
+        double                   dead_time;
+        double                   next_message_percentage;
+        double                   reached_message_percentage;
+        ply_list_t              *current_message_list;
+        ply_hashtable_t         *current_messages;
+        ply_hashtable_t         *previous_messages;
+        ply_progress_message_t **sorted_previous_messages;
+        size_t                   number_of_previous_messages;
+        uint32_t                 paused : 1;
+};
+
+typedef struct
+{
+        uint32_t magic;
+        uint32_t version;
+        uint32_t number_of_messages;
+        uint32_t reserved;
+} ply_progress_cache_header_t;
+
+/* Followed by string_length bytes of message, without a terminator */
+typedef struct
+{
+        double   time;
+        uint32_t number_of_boots;
+        uint16_t missed_boots;
+        uint16_t string_length;
+} ply_progress_cache_entry_t;
+
 ply_progress_t *
 ply_progress_new (void)
 {
@@ -85,12 +134,40 @@ ply_progress_new (void)
         progress->last_percentage_time = 0.0;
         progress->dead_time = 0.0;
         progress->next_message_percentage = 0.25;
+        progress->reached_message_percentage = 0.0;
         progress->current_message_list = ply_list_new ();
-        progress->previous_message_list = ply_list_new ();
+        progress->current_messages = ply_hashtable_new (ply_hashtable_string_hash,
+                                                        ply_hashtable_string_compare);
+        progress->previous_messages = ply_hashtable_new (ply_hashtable_string_hash,
+                                                         ply_hashtable_string_compare);
         progress->paused = false;
         return progress;
 }
 
+static void
+ply_progress_message_free (ply_progress_message_t *message)
+{
+        free (message->string);
+        free (message);
+}
+
+static void
+ply_progress_clear_previous_messages (ply_progress_t *progress)
+{
+        size_t i;
+
+        for (i = 0; i < progress->number_of_previous_messages; i++)
+                ply_progress_message_free (progress->sorted_previous_messages[i]);
+
+        free (progress->sorted_previous_messages);
+        progress->sorted_previous_messages = NULL;
+        progress->number_of_previous_messages = 0;
+
+        ply_hashtable_free (progress->previous_messages);
+        progress->previous_messages = ply_hashtable_new (ply_hashtable_string_hash,
+                                                         ply_hashtable_string_compare);
+}
+
 void
 ply_progress_free (ply_progress_t *progress)
 {
@@ -103,135 +180,334 @@ ply_progress_free (ply_progress_t *progress)
                 ply_progress_message_t *message = ply_list_node_get_data (node);
                 next_node = ply_list_get_next_node (progress->current_message_list, node);
 
-                free (message->string);
-                free (message);
+                ply_progress_message_free (message);
                 node = next_node;
         }
         ply_list_free (progress->current_message_list);
+        ply_hashtable_free (progress->current_messages);
 
-        node = ply_list_get_first_node (progress->previous_message_list);
-
-        while (node) {
-                ply_list_node_t *next_node;
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (progress->previous_message_list, node);
-
-                free (message->string);
-                free (message);
-                node = next_node;
-        }
-        ply_list_free (progress->previous_message_list);
+        ply_progress_clear_previous_messages (progress);
+        ply_hashtable_free (progress->previous_messages);
         free (progress);
         return;
 }
 
+static int
+ply_progress_message_compare (const void *a,
+                              const void *b)
+{
+        const ply_progress_message_t *message_a = *(ply_progress_message_t *const *) a;
+        const ply_progress_message_t *message_b = *(ply_progress_message_t *const *) b;
+
+        if (message_a->time < message_b->time)
+                return -1;
+        if (message_a->time > message_b->time)
+                return 1;
+        return 0;
+}
 
+/* Finds the earliest message expected after time that hasn't shown up yet.
+ * Units that start in parallel or in a different order than last boot have
+ * already been seen, so they're skipped instead of pulling the target back.
+ */
 static ply_progress_message_t *
-ply_progress_message_search (ply_list_t *message_list,
-                             const char *string)
+ply_progress_message_search_next (ply_progress_t *progress,
+                                  double          time)
 {
-        ply_list_node_t *node;
+        size_t low = 0, high = progress->number_of_previous_messages;
 
-        node = ply_list_get_first_node (message_list);
+        while (low < high) {
+                size_t middle = low + (high - low) / 2;
 
-        while (node) {
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                if (strcmp (string, message->string) == 0)
+                if (progress->sorted_previous_messages[middle]->time <= time)
+                        low = middle + 1;
+                else
+                        high = middle;
+        }
+
+        for (; low < progress->number_of_previous_messages; low++) {
+                ply_progress_message_t *message = progress->sorted_previous_messages[low];
+
+                if (!message->was_seen)
                         return message;
-                node = ply_list_get_next_node (message_list, node);
         }
+
         return NULL;
 }
 
+static void
+ply_progress_add_previous_message (ply_progress_t *progress,
+                                   ply_list_t     *messages,
+                                   double          time,
+                                   const char     *string,
+                                   size_t          string_length,
+                                   uint32_t        number_of_boots,
+                                   uint32_t        missed_boots)
+{
+        ply_progress_message_t *message;
+
+        message = calloc (1, sizeof(ply_progress_message_t));
+        message->time = time;
+        message->string = strndup (string, string_length);
+        message->number_of_boots = number_of_boots;
+        message->missed_boots = missed_boots;
 
-static ply_progress_message_t *
-ply_progress_message_search_next (ply_list_t *message_list,
-                                  double      time)
+        if (ply_hashtable_lookup (progress->previous_messages, message->string) != NULL) {
+                ply_progress_message_free (message);
+                return;
+        }
+
+        ply_hashtable_insert (progress->previous_messages, message->string, message);
+        ply_list_append_data (messages, message);
+}
+
+static bool
+ply_progress_parse_cache (ply_progress_t *progress,
+                          ply_list_t     *messages,
+                          const char     *contents,
+                          size_t          size)
 {
-        ply_list_node_t *node;
+        ply_progress_cache_header_t header;
+        size_t offset;
+        uint32_t i;
+
+        if (size < sizeof(header))
+                return false;
+
+        memcpy (&header, contents, sizeof(header));
+
+        if (header.magic != PLY_PROGRESS_CACHE_MAGIC ||
+            header.version != PLY_PROGRESS_CACHE_VERSION)
+                return false;
+
+        offset = sizeof(header);
+        for (i = 0; i < header.number_of_messages; i++) {
+                ply_progress_cache_entry_t entry;
+
+                if (size - offset < sizeof(entry))
+                        break;
+                memcpy (&entry, contents + offset, sizeof(entry));
+                offset += sizeof(entry);
+
+                if (size - offset < entry.string_length)
+                        break;
+
+                if (isfinite (entry.time))
+                        ply_progress_add_previous_message (progress, messages,
+                                                           entry.time,
+                                                           contents + offset,
+                                                           entry.string_length,
+                                                           entry.number_of_boots,
+                                                           entry.missed_boots);
+                offset += entry.string_length;
+        }
 
-        node = ply_list_get_first_node (message_list);
-        ply_progress_message_t *best = NULL;
+        if (i < header.number_of_messages) {
+                ply_trace ("progress cache is truncated");
+        }
 
-        while (node) {
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                if (message->time > time && (!best || message->time < best->time))
-                        best = message;
-                node = ply_list_get_next_node (message_list, node);
+        return true;
+}
+
+/* Caches from before the binary format are "fraction:message" lines */
+static void
+ply_progress_parse_text_cache (ply_progress_t *progress,
+                               ply_list_t     *messages,
+                               const char     *contents,
+                               size_t          size)
+{
+        const char *line = contents, *end = contents + size;
+
+        while (line < end) {
+                const char *end_of_line, *colon;
+                char *end_of_number;
+                double time;
+
+                end_of_line = memchr (line, '\n', end - line);
+                if (end_of_line == NULL)
+                        end_of_line = end;
+
+                time = strtod (line, &end_of_number);
+                colon = end_of_number;
+
+                if (colon == line || colon >= end_of_line || *colon != ':')
+                        break;
+
+                ply_progress_add_previous_message (progress, messages, time,
+                                                   colon + 1, end_of_line - colon - 1,
+                                                   1, 0);
+                line = end_of_line + 1;
         }
-        return best;
 }
 
 void
 ply_progress_load_cache (ply_progress_t *progress,
                          const char     *filename)
 {
-        FILE *fp;
+        ply_list_t *messages;
+        ply_list_node_t *node;
+        struct stat file_info;
+        char *contents;
+        size_t i;
+        int fd;
 
-        fp = fopen (filename, "r");
-        if (fp == NULL)
+        fd = open (filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
                 return;
 
-        while (1) {
-                int items_matched;
-                double time;
-                int string_size = 81;
-                char *string;
-                char colon;
-                int i = 0;
-
-                items_matched = fscanf (fp, "%lf", &time);
-                if (items_matched < 1) break;
-                items_matched = fscanf (fp, "%c", &colon);
-                if (items_matched < 1 || colon != ':') break;
-
-                string = malloc (sizeof(char) * string_size);
-                while (1) {
-                        if (i >= string_size) {
-                                string_size *= 2;
-                                string = realloc (string, sizeof(char) * string_size);
-                        }
-                        items_matched = fscanf (fp, "%c", &string[i]);
-                        if (items_matched < 1 || string[i] == '\n') {
-                                string[i] = '\0';
-                                break;
-                        }
-                        i++;
-                }
-                ply_progress_message_t *message = malloc (sizeof(ply_progress_message_t));
-                message->time = time;
-                message->string = string;
-                ply_list_append_data (progress->previous_message_list, message);
+        if (fstat (fd, &file_info) < 0 || file_info.st_size <= 0) {
+                close (fd);
+                return;
+        }
+
+        contents = malloc (file_info.st_size + 1);
+        if (!ply_read (fd, contents, file_info.st_size)) {
+                ply_trace ("could not read progress cache %s: %m", filename);
+                free (contents);
+                close (fd);
+                return;
+        }
+        close (fd);
+        contents[file_info.st_size] = '\0';
+
+        /* Loading again, like after switching root, replaces the history */
+        ply_progress_clear_previous_messages (progress);
+
+        messages = ply_list_new ();
+        if (!ply_progress_parse_cache (progress, messages, contents, file_info.st_size))
+                ply_progress_parse_text_cache (progress, messages, contents, file_info.st_size);
+        free (contents);
+
+        progress->number_of_previous_messages = ply_list_get_length (messages);
+        progress->sorted_previous_messages = calloc (progress->number_of_previous_messages,
+                                                     sizeof(ply_progress_message_t *));
+        i = 0;
+        ply_list_foreach (messages, node) {
+                progress->sorted_previous_messages[i++] = ply_list_node_get_data (node);
         }
-        fclose (fp);
+        ply_list_free (messages);
+
+        qsort (progress->sorted_previous_messages,
+               progress->number_of_previous_messages,
+               sizeof(ply_progress_message_t *),
+               ply_progress_message_compare);
+
+        ply_trace ("loaded %zu messages from progress cache %s",
+                   progress->number_of_previous_messages, filename);
 }
 
+static void
+ply_progress_append_cache_entry (ply_buffer_t *buffer,
+                                 double        time,
+                                 const char   *string,
+                                 uint32_t      number_of_boots,
+                                 uint32_t      missed_boots)
+{
+        ply_progress_cache_entry_t entry = { 0 };
+        size_t string_length;
+
+        string_length = MIN (strlen (string), UINT16_MAX);
+
+        entry.time = time;
+        entry.number_of_boots = number_of_boots;
+        entry.missed_boots = missed_boots;
+        entry.string_length = string_length;
+
+        ply_buffer_append_bytes (buffer, &entry, sizeof(entry));
+        ply_buffer_append_bytes (buffer, string, string_length);
+}
+
+/* Blends this boot's timings into the history.  Messages that didn't show
+ * up this boot are kept, in case they come back, until they've been
+ * missing for too long.
+ */
 void
 ply_progress_save_cache (ply_progress_t *progress,
                          const char     *filename)
 {
-        FILE *fp;
+        ply_progress_cache_header_t header = { 0 };
+        ply_buffer_t *buffer;
         ply_list_node_t *node;
+        char *temporary_filename = NULL;
         double cur_time = ply_progress_get_time (progress);
+        bool written;
+        size_t i;
+        int fd;
 
         ply_trace ("saving progress cache to %s", filename);
 
-        fp = fopen (filename, "w");
-        if (fp == NULL) {
+        buffer = ply_buffer_new ();
+
+        ply_list_foreach (progress->current_message_list, node) {
+                ply_progress_message_t *message = ply_list_node_get_data (node);
+                ply_progress_message_t *previous_message;
+                double time = message->time / cur_time;
+                uint32_t number_of_boots = 1;
+
+                if (message->disabled)
+                        continue;
+
+                previous_message = ply_hashtable_lookup (progress->previous_messages,
+                                                         message->string);
+
+                if (previous_message != NULL) {
+                        double weight;
+
+                        number_of_boots = previous_message->number_of_boots + 1;
+                        weight = MAX (MESSAGE_TIME_SMOOTHING, 1.0 / number_of_boots);
+                        time = previous_message->time + weight * (time - previous_message->time);
+                }
+
+                ply_progress_append_cache_entry (buffer, time, message->string,
+                                                 number_of_boots, 0);
+                header.number_of_messages++;
+        }
+
+        for (i = 0; i < progress->number_of_previous_messages; i++) {
+                ply_progress_message_t *message = progress->sorted_previous_messages[i];
+
+                if (ply_hashtable_lookup (progress->current_messages, message->string) != NULL)
+                        continue;
+
+                if (message->missed_boots + 1 >= MAX_MISSED_BOOTS)
+                        continue;
+
+                ply_progress_append_cache_entry (buffer, message->time, message->string,
+                                                 message->number_of_boots,
+                                                 message->missed_boots + 1);
+                header.number_of_messages++;
+        }
+
+        header.magic = PLY_PROGRESS_CACHE_MAGIC;
+        header.version = PLY_PROGRESS_CACHE_VERSION;
+
+        if (asprintf (&temporary_filename, "%s.tmp", filename) < 0) {
+                temporary_filename = NULL;
                 ply_trace ("failed to save cache: %m");
-                return;
+                goto out;
         }
 
-        node = ply_list_get_first_node (progress->current_message_list);
+        fd = open (temporary_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+                ply_trace ("failed to save cache: %m");
+                goto out;
+        }
 
-        while (node) {
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                double percentage = message->time / cur_time;
-                if (!message->disabled)
-                        fprintf (fp, "%.3lf:%s\n", percentage, message->string);
-                node = ply_list_get_next_node (progress->current_message_list, node);
+        /* The data has to be on disk before the rename is, or a crash can
+         * leave an empty cache in place of the old one
+         */
+        written = ply_write (fd, &header, sizeof(header)) &&
+                  ply_write (fd, ply_buffer_get_bytes (buffer), ply_buffer_get_size (buffer)) &&
+                  fsync (fd) == 0;
+        close (fd);
+
+        if (!written || rename (temporary_filename, filename) < 0) {
+                ply_trace ("failed to save cache: %m");
+                unlink (temporary_filename);
         }
-        fclose (fp);
+out:
+        free (temporary_filename);
+        ply_buffer_free (buffer);
 }
 
 
@@ -297,33 +573,64 @@ ply_progress_unpause (ply_progress_t *progress)
         return;
 }
 
+/* Pulls the boot length estimate toward what this message implies, trusting
+ * messages with a longer history more.
+ */
+static void
+ply_progress_update_scalar (ply_progress_t         *progress,
+                            ply_progress_message_t *message)
+{
+        double elapsed_time, weight;
+
+        elapsed_time = ply_progress_get_time (progress) - progress->dead_time;
+        if (elapsed_time <= 0)
+                return;
+
+        weight = MAX_SCALAR_WEIGHT * MIN (message->number_of_boots, BOOTS_FOR_FULL_WEIGHT) / BOOTS_FOR_FULL_WEIGHT;
+        progress->scalar += weight * (message->time / elapsed_time - progress->scalar);
+}
+
+/* Remembers when each message shows up this boot, and uses how far into
+ * earlier boots it showed up to correct the predicted boot length.
+ */
 void
 ply_progress_status_update (ply_progress_t *progress,
                             const char     *status)
 {
         ply_progress_message_t *message, *message_next;
 
-        message = ply_progress_message_search (progress->current_message_list, status);
+        message = ply_hashtable_lookup (progress->current_messages, (void *) status);
         if (message) {
+                /* Remove duplicates as they confuse things */
                 message->disabled = true;
-        }                                               /* Remove duplicates as they confuse things*/
-        else {
-                message = ply_progress_message_search (progress->previous_message_list, status);
-                if (message) {
-                        message_next = ply_progress_message_search_next (progress->previous_message_list, message->time);
-                        if (message_next)
-                                progress->next_message_percentage = message_next->time;
-                        else
-                                progress->next_message_percentage = 1;
-
-                        progress->scalar += message->time / (ply_progress_get_time (progress) - progress->dead_time);
-                        progress->scalar /= 2;
-                }
-                message = malloc (sizeof(ply_progress_message_t));
-                message->time = ply_progress_get_time (progress);
-                message->string = strdup (status);
-                message->disabled = false;
-                ply_list_append_data (progress->current_message_list, message);
+                return;
         }
-}
 
+        message = ply_hashtable_lookup (progress->previous_messages, (void *) status);
+
+        /* Messages that usually come earlier than ones already seen belong to
+         * units running in parallel, and shouldn't move progress backwards.
+         */
+        if (message && !message->was_seen &&
+            message->time >= progress->reached_message_percentage) {
+                progress->reached_message_percentage = message->time;
+
+                message->was_seen = true;
+                message_next = ply_progress_message_search_next (progress, message->time);
+                if (message_next)
+                        progress->next_message_percentage = message_next->time;
+                else
+                        progress->next_message_percentage = 1;
+
+                ply_progress_update_scalar (progress, message);
+        } else if (message) {
+                message->was_seen = true;
+        }
+
+        message = calloc (1, sizeof(ply_progress_message_t));
+        message->time = ply_progress_get_time (progress);
+        message->string = strdup (status);
+        message->disabled = false;
+        ply_list_append_data (progress->current_message_list, message);
+        ply_hashtable_insert (progress->current_messages, message->string, message);
+}
@@ -41,6 +41,21 @@
 #include "ply-logger.h"
 #include "ply-utils.h"
 
+#define PLY_TERMINAL_SESSION_READ_SIZE (8 * 1024)
+
+/* Stop draining after this much, so a console flood can't starve the
+ * rest of the event loop
+ */
+#define PLY_TERMINAL_SESSION_MAX_READ_PER_WAKEUP (256 * 1024)
+
+/* The log is written out once this much is waiting or the delay has
+ * passed, whichever comes first.  It has to stay well below the logger's
+ * buffer capacity, or unwritten output would get overwritten.
+ */
+#define PLY_TERMINAL_SESSION_LOG_FLUSH_SIZE (16 * 1024)
+#define PLY_TERMINAL_SESSION_LOG_FLUSH_DELAY (0.25)
+#define PLY_TERMINAL_SESSION_LOG_FLUSH_SLACK (0.125)
+
 struct _ply_terminal_session
 {
         int                                   pseudoterminal_master_fd;
@@ -50,6 +65,9 @@ struct _ply_terminal_session
         ply_fd_watch_t                       *fd_watch;
         ply_terminal_session_flags_t          attach_flags;
 
+        size_t                                number_of_unflushed_bytes;
+        ply_timeout_watch_t                  *log_flush_timeout;
+
         ply_terminal_session_output_handler_t output_handler;
         ply_terminal_session_hangup_handler_t hangup_handler;
         void                                 *user_data;
@@ -61,6 +79,7 @@ struct _ply_terminal_session
 
 static void ply_terminal_session_start_logging (ply_terminal_session_t *session);
 static void ply_terminal_session_stop_logging (ply_terminal_session_t *session);
+static void ply_terminal_session_flush_log (ply_terminal_session_t *session);
 
 ply_terminal_session_t *
 ply_terminal_session_new (const char *const *argv)
@@ -100,6 +119,7 @@ ply_terminal_session_detach_from_event_loop (ply_terminal_session_t *session)
 {
         assert (session != NULL);
         session->loop = NULL;
+        session->log_flush_timeout = NULL;
 }
 
 void
@@ -293,29 +313,102 @@ ply_terminal_session_log_bytes (ply_terminal_session_t *session,
         assert (bytes != NULL);
         assert (number_of_bytes != 0);
 
-        ply_logger_inject_bytes (session->logger, bytes, number_of_bytes);
+        if (ply_logger_writes_records (session->logger))
+                ply_logger_inject_record (session->logger, PLY_LOG_RECORD_SOURCE_CONSOLE,
+                                          bytes, number_of_bytes);
+        else
+                ply_logger_inject_bytes (session->logger, bytes, number_of_bytes);
+        session->number_of_unflushed_bytes += number_of_bytes;
 
         if (session->output_handler != NULL)
                 session->output_handler (session->user_data,
                                          bytes, number_of_bytes, session);
 }
 
+static void
+ply_terminal_session_flush_log (ply_terminal_session_t *session)
+{
+        if (session->log_flush_timeout != NULL) {
+                ply_event_loop_stop_watching_timeout (session->loop,
+                                                      session->log_flush_timeout);
+                session->log_flush_timeout = NULL;
+        }
+
+        if (session->number_of_unflushed_bytes == 0)
+                return;
+
+        /* On failure the bytes stay queued in the logger, so keep
+         * counting them toward the next flush
+         */
+        if (ply_logger_flush (session->logger))
+                session->number_of_unflushed_bytes = 0;
+}
+
+static void
+on_log_flush_timeout (ply_terminal_session_t *session)
+{
+        session->log_flush_timeout = NULL;
+        ply_terminal_session_flush_log (session);
+}
+
+static void
+ply_terminal_session_schedule_log_flush (ply_terminal_session_t *session)
+{
+        if (session->number_of_unflushed_bytes >= PLY_TERMINAL_SESSION_LOG_FLUSH_SIZE ||
+            session->loop == NULL) {
+                ply_terminal_session_flush_log (session);
+                return;
+        }
+
+        if (session->number_of_unflushed_bytes == 0 ||
+            session->log_flush_timeout != NULL)
+                return;
+
+        session->log_flush_timeout =
+                ply_event_loop_watch_for_timeout_with_slack (session->loop,
+                                                             PLY_TERMINAL_SESSION_LOG_FLUSH_DELAY,
+                                                             PLY_TERMINAL_SESSION_LOG_FLUSH_SLACK,
+                                                             (ply_event_loop_timeout_handler_t)
+                                                             on_log_flush_timeout, session);
+}
+
 static void
 ply_terminal_session_on_new_data (ply_terminal_session_t *session,
                                   int                     session_fd)
 {
-        uint8_t buffer[4096];
+        uint8_t buffer[PLY_TERMINAL_SESSION_READ_SIZE];
+        size_t total_bytes_read = 0;
         ssize_t bytes_read;
+        int bytes_ready;
 
         assert (session != NULL);
         assert (session_fd >= 0);
 
-        bytes_read = read (session_fd, buffer, sizeof(buffer));
+        /* The pty is blocking, so only go back for more while it says
+         * there's more to get
+         */
+        do {
+                bytes_read = read (session_fd, buffer, sizeof(buffer));
+
+                if (bytes_read <= 0)
+                        break;
 
-        if (bytes_read > 0)
                 ply_terminal_session_log_bytes (session, buffer, bytes_read);
+                total_bytes_read += bytes_read;
 
-        ply_logger_flush (session->logger);
+                if (session->number_of_unflushed_bytes >= PLY_TERMINAL_SESSION_LOG_FLUSH_SIZE)
+                        ply_terminal_session_flush_log (session);
+
+                /* The output handler may have detached us */
+                if (session->fd_watch == NULL)
+                        break;
+
+                if (ioctl (session_fd, FIONREAD, &bytes_ready) < 0)
+                        bytes_ready = 0;
+        } while (bytes_ready > 0 &&
+                 total_bytes_read < PLY_TERMINAL_SESSION_MAX_READ_PER_WAKEUP);
+
+        ply_terminal_session_schedule_log_flush (session);
 }
 
 static void
@@ -336,7 +429,7 @@ ply_terminal_session_on_hangup (ply_terminal_session_t *session)
         attach_flags = session->attach_flags;
         created_terminal_device = session->created_terminal_device;
 
-        ply_logger_flush (session->logger);
+        ply_terminal_session_flush_log (session);
 
         session->is_running = false;
         ply_trace ("stopping terminal logging");
@@ -391,6 +484,7 @@ ply_terminal_session_stop_logging (ply_terminal_session_t *session)
         assert (session->logger != NULL);
 
         ply_trace ("stopping logging of incoming console messages");
+        ply_terminal_session_flush_log (session);
         if (ply_logger_is_logging (session->logger))
                 ply_logger_toggle_logging (session->logger);
 
@@ -413,8 +507,10 @@ ply_terminal_session_open_log (ply_terminal_session_t *session,
 
         ply_save_errno ();
         log_is_opened = ply_logger_open_file (session->logger, filename);
-        if (log_is_opened)
+        if (log_is_opened) {
                 ply_logger_flush (session->logger);
+                session->number_of_unflushed_bytes = 0;
+        }
         ply_restore_errno ();
 
         return log_is_opened;
@@ -426,6 +522,56 @@ ply_terminal_session_close_log (ply_terminal_session_t *session)
         assert (session != NULL);
         assert (session->logger != NULL);
 
+        ply_terminal_session_flush_log (session);
+
         return ply_logger_close_file (session->logger);
 }
 
+void
+ply_terminal_session_write_to_log (ply_terminal_session_t *session,
+                                   const char             *bytes,
+                                   size_t                  number_of_bytes)
+{
+        assert (session != NULL);
+        assert (session->logger != NULL);
+
+        if (number_of_bytes == 0)
+                return;
+
+        if (ply_logger_writes_records (session->logger))
+                ply_logger_inject_record (session->logger, PLY_LOG_RECORD_SOURCE_DAEMON,
+                                          bytes, number_of_bytes);
+        else
+                ply_logger_inject_bytes (session->logger, bytes, number_of_bytes);
+        session->number_of_unflushed_bytes += number_of_bytes;
+        ply_terminal_session_flush_log (session);
+}
+
+void
+ply_terminal_session_set_log_records (ply_terminal_session_t *session,
+                                      bool                    should_log_records)
+{
+        assert (session != NULL);
+        assert (session->logger != NULL);
+
+        ply_logger_set_writes_records (session->logger, should_log_records);
+}
+
+void
+ply_terminal_session_add_record_to_log (ply_terminal_session_t *session,
+                                        ply_log_record_source_t source,
+                                        const char             *bytes,
+                                        size_t                  number_of_bytes)
+{
+        assert (session != NULL);
+        assert (session->logger != NULL);
+
+        if (number_of_bytes == 0 ||
+            !ply_logger_writes_records (session->logger))
+                return;
+
+        ply_logger_inject_record (session->logger, source, bytes, number_of_bytes);
+        session->number_of_unflushed_bytes += number_of_bytes;
+        ply_terminal_session_schedule_log_flush (session);
+}
+
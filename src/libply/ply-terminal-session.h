@@ -28,6 +28,7 @@
 
 #include "ply-event-loop.h"
 #include "ply-buffer.h"
+#include "ply-log-record.h"
 
 typedef struct _ply_terminal_session ply_terminal_session_t;
 
@@ -68,6 +69,19 @@ int ply_terminal_session_get_fd (ply_terminal_session_t *session);
 bool ply_terminal_session_open_log (ply_terminal_session_t *session,
                                     const char             *filename);
 void ply_terminal_session_close_log (ply_terminal_session_t *session);
+void ply_terminal_session_write_to_log (ply_terminal_session_t *session,
+                                        const char             *bytes,
+                                        size_t                  number_of_bytes);
+
+/* Switches the log over to ply_log_record_t records.  Records added with
+ * ply_terminal_session_add_record_to_log () are dropped unless it's on.
+ */
+void ply_terminal_session_set_log_records (ply_terminal_session_t *session,
+                                           bool                    should_log_records);
+void ply_terminal_session_add_record_to_log (ply_terminal_session_t *session,
+                                             ply_log_record_source_t source,
+                                             const char             *bytes,
+                                             size_t                  number_of_bytes);
 #endif
 
 #endif /* PLY_TERMINAL_SESSION_H */
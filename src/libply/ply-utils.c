@@ -31,6 +31,7 @@
 #include <limits.h>
 #include <locale.h>
 #include <poll.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -81,8 +82,8 @@
 #define SECURE_BOOT_GLOBAL_VARIABLES_FILE EFI_VARIABLES_PATH "SecureBoot-" EFI_GLOBAL_VARIABLES_GUID
 #define IS_SECURE_BOOT_ENABLED(sb_config) ((sb_config) == 0x1)
 
-static int errno_stack[PLY_ERRNO_STACK_SIZE];
-static int errno_stack_position = 0;
+static __thread int errno_stack[PLY_ERRNO_STACK_SIZE];
+static __thread int errno_stack_position = 0;
 
 static int overridden_device_scale = 0;
 
@@ -108,12 +109,12 @@ ply_open_unidirectional_pipe (int *sender_fd,
 }
 
 static int
-ply_open_unix_socket (void)
+ply_open_unix_socket (int socket_type)
 {
         int fd;
         const int should_pass_credentials = true;
 
-        fd = socket (PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        fd = socket (PF_UNIX, socket_type | SOCK_CLOEXEC, 0);
 
         if (fd < 0)
                 return -1;
@@ -181,7 +182,7 @@ ply_connect_to_unix_socket (const char            *path,
         assert (path != NULL);
         assert (path[0] != '\0');
 
-        fd = ply_open_unix_socket ();
+        fd = ply_open_unix_socket (SOCK_STREAM);
 
         if (fd < 0)
                 return -1;
@@ -212,7 +213,7 @@ ply_listen_to_unix_socket (const char            *path,
         assert (path != NULL);
         assert (path[0] != '\0');
 
-        fd = ply_open_unix_socket ();
+        fd = ply_open_unix_socket (SOCK_STREAM);
 
         if (fd < 0)
                 return -1;
@@ -249,6 +250,81 @@ ply_listen_to_unix_socket (const char            *path,
         return fd;
 }
 
+/* Datagram sockets are non-blocking, and the listening end gets the
+ * sender's credentials as SCM_CREDENTIALS ancillary data on every message
+ */
+int
+ply_listen_to_unix_datagram_socket (const char            *path,
+                                    ply_unix_socket_type_t type)
+{
+        struct sockaddr *address;
+        size_t address_size;
+        int fd;
+
+        assert (path != NULL);
+        assert (path[0] != '\0');
+
+        fd = ply_open_unix_socket (SOCK_DGRAM | SOCK_NONBLOCK);
+
+        if (fd < 0)
+                return -1;
+
+        address = create_unix_address_from_path (path, type, &address_size);
+
+        if (bind (fd, address, address_size) < 0) {
+                ply_save_errno ();
+                free (address);
+                close (fd);
+                ply_restore_errno ();
+
+                return -1;
+        }
+
+        free (address);
+
+        if (type == PLY_UNIX_SOCKET_TYPE_CONCRETE) {
+                if (fchmod (fd, 0600) < 0) {
+                        ply_save_errno ();
+                        close (fd);
+                        ply_restore_errno ();
+                        return -1;
+                }
+        }
+
+        return fd;
+}
+
+int
+ply_connect_to_unix_datagram_socket (const char            *path,
+                                     ply_unix_socket_type_t type)
+{
+        struct sockaddr *address;
+        size_t address_size;
+        int fd;
+
+        assert (path != NULL);
+        assert (path[0] != '\0');
+
+        fd = ply_open_unix_socket (SOCK_DGRAM | SOCK_NONBLOCK);
+
+        if (fd < 0)
+                return -1;
+
+        address = create_unix_address_from_path (path, type, &address_size);
+
+        if (connect (fd, address, address_size) < 0) {
+                ply_save_errno ();
+                free (address);
+                close (fd);
+                ply_restore_errno ();
+
+                return -1;
+        }
+        free (address);
+
+        return fd;
+}
+
 bool
 ply_get_credentials_from_fd (int    fd,
                              pid_t *pid,
@@ -536,13 +612,75 @@ ply_character_device_exists (const char *device)
         return S_ISCHR (file_info.st_mode);
 }
 
+static const ply_built_in_module_t *built_in_modules;
+
+void
+ply_set_built_in_modules (const ply_built_in_module_t *modules)
+{
+        built_in_modules = modules;
+}
+
+static const ply_built_in_module_t *
+ply_find_built_in_module (const char *module_path)
+{
+        size_t path_length;
+        int i;
+
+        if (built_in_modules == NULL)
+                return NULL;
+
+        path_length = strlen (module_path);
+
+        for (i = 0; built_in_modules[i].module_name != NULL; i++) {
+                size_t name_length;
+
+                name_length = strlen (built_in_modules[i].module_name);
+
+                if (name_length >= path_length)
+                        continue;
+
+                if (module_path[path_length - name_length - 1] != '/')
+                        continue;
+
+                if (strcmp (module_path + path_length - name_length,
+                            built_in_modules[i].module_name) == 0)
+                        return &built_in_modules[i];
+        }
+
+        return NULL;
+}
+
+static bool
+ply_module_is_built_in (ply_module_handle_t *handle)
+{
+        int i;
+
+        if (built_in_modules == NULL)
+                return false;
+
+        for (i = 0; built_in_modules[i].module_name != NULL; i++) {
+                if (handle == (ply_module_handle_t *) &built_in_modules[i])
+                        return true;
+        }
+
+        return false;
+}
+
 ply_module_handle_t *
 ply_open_module (const char *module_path)
 {
+        const ply_built_in_module_t *built_in_module;
         ply_module_handle_t *handle;
 
         assert (module_path != NULL);
 
+        built_in_module = ply_find_built_in_module (module_path);
+
+        if (built_in_module != NULL) {
+                ply_trace ("Using built-in module \"%s\"", built_in_module->module_name);
+                return (ply_module_handle_t *) built_in_module;
+        }
+
         handle = (ply_module_handle_t *) dlopen (module_path,
                                                  RTLD_NODELETE | RTLD_NOW | RTLD_LOCAL);
 
@@ -581,6 +719,19 @@ ply_module_look_up_function (ply_module_handle_t *handle,
         assert (handle != NULL);
         assert (function_name != NULL);
 
+        if (ply_module_is_built_in (handle)) {
+                const ply_built_in_module_t *built_in_module;
+
+                built_in_module = (const ply_built_in_module_t *) handle;
+
+                if (strcmp (built_in_module->function_name, function_name) != 0) {
+                        errno = ELIBACC;
+                        return NULL;
+                }
+
+                return built_in_module->function;
+        }
+
         dlerror ();
         function = (ply_module_function_t) dlsym (handle, function_name);
 
@@ -597,6 +748,9 @@ ply_module_look_up_function (ply_module_handle_t *handle,
 void
 ply_close_module (ply_module_handle_t *handle)
 {
+        if (ply_module_is_built_in (handle))
+                return;
+
         dlclose (handle);
 }
 
@@ -874,7 +1028,7 @@ ply_set_device_scale (int device_scale)
  * If we have guessed the scale once, keep guessing to avoid
  * changing the scale on simpledrm -> native driver switch.
  */
-static bool guess_device_scale;
+static atomic_bool guess_device_scale;
 
 static int
 get_device_scale (uint32_t width,
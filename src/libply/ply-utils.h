@@ -46,6 +46,16 @@
 typedef intptr_t ply_module_handle_t;
 typedef void (*ply_module_function_t) (void);
 
+/* A plugin linked into the program. module_name is the module path
+ * relative to the plugin directory, like "renderers/drm.so".
+ */
+typedef struct
+{
+        const char           *module_name;
+        const char           *function_name;
+        ply_module_function_t function;
+} ply_built_in_module_t;
+
 typedef intptr_t ply_daemon_handle_t;
 
 typedef enum
@@ -65,6 +75,10 @@ int ply_connect_to_unix_socket (const char            *path,
                                 ply_unix_socket_type_t type);
 int ply_listen_to_unix_socket (const char            *path,
                                ply_unix_socket_type_t type);
+int ply_connect_to_unix_datagram_socket (const char            *path,
+                                         ply_unix_socket_type_t type);
+int ply_listen_to_unix_datagram_socket (const char            *path,
+                                        ply_unix_socket_type_t type);
 bool ply_get_credentials_from_fd (int    fd,
                                   pid_t *pid,
                                   uid_t *uid,
@@ -96,6 +110,10 @@ bool ply_directory_exists (const char *dir);
 bool ply_file_exists (const char *file);
 bool ply_character_device_exists (const char *device);
 
+/* Registers a table, terminated by an entry with a NULL module_name, of
+ * modules that ply_open_module () should resolve without dlopen ()
+ */
+void ply_set_built_in_modules (const ply_built_in_module_t *modules);
 ply_module_handle_t *ply_open_module (const char *module_path);
 ply_module_handle_t *ply_open_built_in_module (void);
 
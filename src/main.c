@@ -45,11 +45,14 @@
 #include "ply-command-parser.h"
 #include "ply-boot-server.h"
 #include "ply-boot-splash.h"
+#include "ply-built-in-plugins.h"
 #include "ply-device-manager.h"
 #include "ply-event-loop.h"
+#include "ply-flush-pool.h"
 #include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-phase-tracer.h"
 #include "ply-renderer.h"
 #include "ply-terminal-session.h"
 #include "ply-trigger.h"
@@ -59,6 +62,12 @@
 #define BOOT_DURATION_FILE     PLYMOUTH_TIME_DIRECTORY "/boot-duration"
 #define SHUTDOWN_DURATION_FILE PLYMOUTH_TIME_DIRECTORY "/shutdown-duration"
 
+/* Status and system update progress reach the splash at most once per
+ * interval, and updates arriving in between replace the pending one
+ */
+#define STATUS_UPDATES_PER_SECOND 30
+#define STATUS_UPDATE_INTERVAL    (1.0 / STATUS_UPDATES_PER_SECOND)
+
 typedef struct
 {
         const char    *keys;
@@ -79,6 +88,7 @@ typedef struct
         ply_event_loop_t       *loop;
         ply_boot_server_t      *boot_server;
         ply_boot_splash_t      *boot_splash;
+        ply_boot_splash_t      *reloaded_boot_splash;
         ply_terminal_session_t *session;
         ply_buffer_t           *boot_buffer;
         ply_progress_t         *progress;
@@ -94,11 +104,19 @@ typedef struct
         ply_trigger_t          *deactivate_trigger;
         ply_trigger_t          *quit_trigger;
 
+        ply_timeout_watch_t    *status_update_timeout;
+        char                   *pending_status;
+        int                     pending_system_update_progress;
+        double                  last_status_update_time;
+        unsigned long           number_of_status_updates;
+        unsigned long           number_of_status_updates_shown;
+
         double                  start_time;
         double                  splash_delay;
         double                  device_timeout;
 
         uint32_t                no_boot_log : 1;
+        uint32_t                has_structured_boot_log : 1;
         uint32_t                showing_details : 1;
         uint32_t                system_initialized : 1;
         uint32_t                is_redirected : 1;
@@ -110,6 +128,7 @@ typedef struct
         uint32_t                should_force_details : 1;
         uint32_t                should_force_default_splash : 1;
         uint32_t                splash_is_becoming_idle : 1;
+        uint32_t                reloaded_boot_splash_is_stale : 1;
 
         char                   *override_splash_path;
         char                   *system_default_splash_path;
@@ -120,11 +139,14 @@ typedef struct
 } state_t;
 
 static void show_splash (state_t *state);
+static void reload_splash (state_t *state);
 static ply_boot_splash_t *load_built_in_theme (state_t *state);
 static ply_boot_splash_t *load_theme (state_t    *state,
                                       const char *theme_path);
 static ply_boot_splash_t *show_theme (state_t    *state,
                                       const char *theme_path);
+static bool show_loaded_theme (state_t           *state,
+                               ply_boot_splash_t *splash);
 
 static void attach_splash_to_devices (state_t           *state,
                                       ply_boot_splash_t *splash);
@@ -137,6 +159,9 @@ static void update_display (state_t *state);
 static void on_error_message (ply_buffer_t *debug_buffer,
                               const void   *bytes,
                               size_t        number_of_bytes);
+static void on_trace_message (state_t    *state,
+                              const void *bytes,
+                              size_t      number_of_bytes);
 static ply_buffer_t *debug_buffer;
 static char *debug_buffer_path = NULL;
 static char *boot_log_file = NULL;
@@ -179,16 +204,95 @@ on_session_hangup (state_t *state)
         ply_trace ("got hang up on terminal session fd");
 }
 
+static void
+show_pending_status_updates (state_t *state)
+{
+        char *status;
+        int progress;
+
+        status = state->pending_status;
+        state->pending_status = NULL;
+        progress = state->pending_system_update_progress;
+        state->pending_system_update_progress = -1;
+
+        state->last_status_update_time = ply_get_timestamp ();
+
+        if (state->boot_splash == NULL) {
+                free (status);
+                return;
+        }
+
+        if (status != NULL) {
+                ply_boot_splash_update_status (state->boot_splash, status);
+                state->number_of_status_updates_shown++;
+                free (status);
+        }
+
+        if (progress >= 0) {
+                ply_trace ("setting system update to '%i'", progress);
+                if (!ply_boot_splash_system_update (state->boot_splash, progress))
+                        ply_trace ("failed to update splash");
+        }
+}
+
+static void
+on_status_update_timeout (state_t *state)
+{
+        state->status_update_timeout = NULL;
+        show_pending_status_updates (state);
+}
+
+/* Updates tend to come in bursts of hundreds during boot, far faster
+ * than the splash can usefully redraw, so only the newest one per
+ * interval gets shown.  An update after a quiet spell goes out at once.
+ */
+static void
+schedule_status_update (state_t *state)
+{
+        double time_since_last_update;
+
+        if (state->status_update_timeout != NULL)
+                return;
+
+        time_since_last_update = ply_get_timestamp () - state->last_status_update_time;
+
+        if (time_since_last_update >= STATUS_UPDATE_INTERVAL) {
+                show_pending_status_updates (state);
+                return;
+        }
+
+        state->status_update_timeout =
+                ply_event_loop_watch_for_timeout_with_slack (state->loop,
+                                                             STATUS_UPDATE_INTERVAL - time_since_last_update,
+                                                             PLY_EVENT_LOOP_FRAME_SLACK (STATUS_UPDATES_PER_SECOND),
+                                                             (ply_event_loop_timeout_handler_t)
+                                                             on_status_update_timeout,
+                                                             state);
+}
+
 static void
 on_update (state_t    *state,
            const char *status)
 {
         ply_trace ("updating status to '%s'", status);
+
+        /* The progress model learns from every update, even ones that
+         * never make it to the screen
+         */
         ply_progress_status_update (state->progress,
                                     status);
-        if (state->boot_splash != NULL)
-                ply_boot_splash_update_status (state->boot_splash,
-                                               status);
+        if (state->session != NULL)
+                ply_terminal_session_add_record_to_log (state->session,
+                                                        PLY_LOG_RECORD_SOURCE_STATUS,
+                                                        status, strlen (status));
+        state->number_of_status_updates++;
+
+        if (state->boot_splash == NULL)
+                return;
+
+        free (state->pending_status);
+        state->pending_status = strdup (status);
+        schedule_status_update (state);
 }
 
 static void
@@ -235,11 +339,8 @@ on_system_update (state_t *state,
                 return;
         }
 
-        ply_trace ("setting system update to '%i'", progress);
-        if (!ply_boot_splash_system_update (state->boot_splash, progress)) {
-                ply_trace ("failed to update splash");
-                return;
-        }
+        state->pending_system_update_progress = progress;
+        schedule_status_update (state);
 }
 
 static void
@@ -292,30 +393,35 @@ get_theme_path (const char *splash_string,
         return false;
 }
 
+/* plymouthd.conf and the defaults files are parsed through the key file
+ * cache, so a reload only parses the ones that changed on disk.
+ */
 static bool
 load_settings (state_t    *state,
                const char *path,
                char      **theme_path)
 {
-        ply_key_file_t *key_file = NULL;
-        bool settings_loaded = false;
-        char *scale_string = NULL;
-        char *splash_string = NULL;
+        ply_key_file_t *key_file;
+        const char *scale_string;
+        const char *splash_string;
+        const char *flush_threads_string;
 
         ply_trace ("Trying to load %s", path);
-        key_file = ply_key_file_new (path);
+        ply_phase_tracer_begin ("load-settings", path);
+        key_file = ply_key_file_load_cached (path);
 
-        if (!ply_key_file_load (key_file))
-                goto out;
+        if (key_file == NULL) {
+                ply_phase_tracer_end ("load-settings", path);
+                return false;
+        }
 
-        splash_string = ply_key_file_get_value (key_file, "Daemon", "Theme");
+        splash_string = ply_key_file_peek_value (key_file, "Daemon", "Theme");
 
         if (splash_string != NULL) {
-                char *configured_theme_dir;
-                configured_theme_dir = ply_key_file_get_value (key_file, "Daemon",
-                                                               "ThemeDir");
+                const char *configured_theme_dir;
+                configured_theme_dir = ply_key_file_peek_value (key_file, "Daemon",
+                                                                "ThemeDir");
                 get_theme_path (splash_string, configured_theme_dir, theme_path);
-                free (configured_theme_dir);
         }
 
         if (isnan (state->splash_delay)) {
@@ -328,19 +434,19 @@ load_settings (state_t    *state,
                 ply_trace ("Device timeout is set to %lf", state->device_timeout);
         }
 
-        scale_string = ply_key_file_get_value (key_file, "Daemon", "DeviceScale");
+        scale_string = ply_key_file_peek_value (key_file, "Daemon", "DeviceScale");
 
-        if (scale_string != NULL) {
+        if (scale_string != NULL)
                 ply_set_device_scale (strtoul (scale_string, NULL, 0));
-                free (scale_string);
-        }
 
-        settings_loaded = true;
-out:
-        free (splash_string);
-        ply_key_file_free (key_file);
+        flush_threads_string = ply_key_file_peek_value (key_file, "Daemon", "FlushThreads");
+
+        if (flush_threads_string != NULL)
+                ply_flush_pool_set_default_number_of_threads (strtoul (flush_threads_string, NULL, 0));
 
-        return settings_loaded;
+        ply_phase_tracer_end ("load-settings", path);
+
+        return true;
 }
 
 static void
@@ -406,6 +512,17 @@ find_force_scale (state_t *state)
                 ply_set_device_scale (strtoul (scale_string, NULL, 0));
 }
 
+static void
+find_flush_threads (state_t *state)
+{
+        const char *flush_threads_string;
+
+        flush_threads_string = ply_kernel_command_line_get_string_after_prefix ("plymouth.flush-threads=");
+
+        if (flush_threads_string != NULL)
+                ply_flush_pool_set_default_number_of_threads (strtoul (flush_threads_string, NULL, 0));
+}
+
 static void
 find_system_default_splash (state_t *state)
 {
@@ -923,26 +1040,130 @@ plymouth_should_show_default_splash (state_t *state)
 }
 
 static void
-on_reload (state_t *state)
+set_pixel_displays_paused (state_t *state,
+                           bool     is_paused)
 {
-        ply_trace ("reloading");
+        ply_list_t *pixel_displays;
+        ply_list_node_t *node;
+
+        pixel_displays = ply_device_manager_get_pixel_displays (state->device_manager);
+        ply_list_foreach (pixel_displays, node) {
+                ply_pixel_display_t *pixel_display;
+
+                pixel_display = ply_list_node_get_data (node);
+
+                if (is_paused)
+                        ply_pixel_display_pause_updates (pixel_display);
+                else
+                        ply_pixel_display_unpause_updates (pixel_display);
+        }
+}
+
+/* Swaps the reloaded splash in with the displays paused, so the old splash
+ * stays on screen until the new one has drawn its first frame.
+ */
+static void
+on_reloaded_splash_loaded (state_t           *state,
+                           bool               is_loaded,
+                           ply_boot_splash_t *splash)
+{
+        state->reloaded_boot_splash = NULL;
+
+        if (state->reloaded_boot_splash_is_stale) {
+                ply_trace ("reloaded again while loading, dropping reloaded splash");
+                state->reloaded_boot_splash_is_stale = false;
+                ply_boot_splash_free (splash);
+                reload_splash (state);
+                return;
+        }
+
+        if (state->boot_splash == NULL || state->is_inactive ||
+            !state->is_shown || state->showing_details) {
+                ply_trace ("splash changed while reloading, dropping reloaded splash");
+                ply_boot_splash_free (splash);
+                return;
+        }
+
+        if (!is_loaded) {
+                ply_trace ("could not load reloaded splash, falling back");
+                ply_boot_splash_free (splash);
+                splash = NULL;
+        }
+
+        set_pixel_displays_paused (state, true);
+
+        ply_boot_splash_hide (state->boot_splash);
+        ply_boot_splash_free (state->boot_splash);
+        state->boot_splash = NULL;
+
+        if (splash != NULL) {
+                ply_boot_splash_attach_to_event_loop (splash, state->loop);
+                ply_boot_splash_attach_progress (splash, state->progress);
+
+                if (show_loaded_theme (state, splash)) {
+                        state->boot_splash = splash;
+                        show_messages (state);
+                        update_display (state);
+                }
+        }
+
+        if (state->boot_splash == NULL)
+                show_default_splash (state);
+
+        set_pixel_displays_paused (state, false);
+}
+
+static bool
+reload_splash_in_background (state_t *state)
+{
+        ply_boot_splash_t *splash;
+        const char *theme_path;
+
+        if (state->override_splash_path != NULL)
+                theme_path = state->override_splash_path;
+        else if (state->system_default_splash_path != NULL)
+                theme_path = state->system_default_splash_path;
+        else if (state->distribution_default_splash_path != NULL)
+                theme_path = state->distribution_default_splash_path;
+        else
+                theme_path = PLYMOUTH_THEME_PATH "default.plymouth";
+
+        ply_trace ("Loading boot splash theme '%s' in background", theme_path);
+
+        splash = ply_boot_splash_new (theme_path,
+                                      PLYMOUTH_PLUGIN_PATH,
+                                      state->boot_buffer);
+
+        if (!ply_boot_splash_load_in_background (splash,
+                                                 state->loop,
+                                                 (ply_boot_splash_on_loaded_handler_t)
+                                                 on_reloaded_splash_loaded,
+                                                 state)) {
+                ply_trace ("could not load splash in background: %m");
+                ply_boot_splash_free (splash);
+                return false;
+        }
+
+        state->reloaded_boot_splash = splash;
+
+        return true;
+}
+
+static void
+reload_splash (state_t *state)
+{
+        /* The current splash keeps running until the new one is ready */
+        if (state->boot_splash != NULL && !state->is_inactive &&
+            state->is_shown && !state->showing_details &&
+            reload_splash_in_background (state))
+                return;
+
         if (state->boot_splash != NULL) {
                 ply_boot_splash_hide (state->boot_splash);
                 ply_boot_splash_free (state->boot_splash);
                 state->boot_splash = NULL;
         }
 
-        free (state->override_splash_path);
-        state->override_splash_path = NULL;
-        free (state->system_default_splash_path);
-        state->system_default_splash_path = NULL;
-        free (state->distribution_default_splash_path);
-        state->distribution_default_splash_path = NULL;
-
-        find_override_splash (state);
-        find_system_default_splash (state);
-        find_distribution_default_splash (state);
-
         if (state->is_inactive) {
                 ply_trace ("reload while inactive");
                 return;
@@ -960,6 +1181,33 @@ on_reload (state_t *state)
         }
 }
 
+static void
+on_reload (state_t *state)
+{
+        ply_trace ("reloading");
+
+        free (state->override_splash_path);
+        state->override_splash_path = NULL;
+        free (state->system_default_splash_path);
+        state->system_default_splash_path = NULL;
+        free (state->distribution_default_splash_path);
+        state->distribution_default_splash_path = NULL;
+
+        find_override_splash (state);
+        find_system_default_splash (state);
+        find_distribution_default_splash (state);
+
+        /* Joining the loading thread would block the event loop, so let
+         * it finish and start over from its completion handler
+         */
+        if (state->reloaded_boot_splash != NULL) {
+                ply_trace ("splash from earlier reload is still loading");
+                state->reloaded_boot_splash_is_stale = true;
+                return;
+        }
+
+        reload_splash (state);
+}
 
 static void
 on_show_splash (state_t *state)
@@ -1398,6 +1646,58 @@ on_reactivate (state_t *state)
         update_display (state);
 }
 
+static char *
+on_get_stats (state_t *state)
+{
+        ply_buffer_t *buffer;
+        char *device_stats, *stats;
+
+        buffer = ply_buffer_new ();
+
+        ply_event_loop_append_stats (state->loop, buffer, "loop");
+
+        ply_buffer_append (buffer, "status.updates=%lu\n", state->number_of_status_updates);
+        ply_buffer_append (buffer, "status.updates-shown=%lu\n", state->number_of_status_updates_shown);
+
+        if (state->device_manager != NULL) {
+                device_stats = ply_device_manager_get_stats (state->device_manager);
+                ply_buffer_append_bytes (buffer, device_stats, strlen (device_stats));
+                free (device_stats);
+        }
+
+        stats = ply_buffer_steal_bytes (buffer);
+        ply_buffer_free (buffer);
+
+        return stats;
+}
+
+static void
+write_stats_to_log (state_t *state)
+{
+        ply_buffer_t *phases;
+        char *stats;
+
+        if (state->device_manager == NULL)
+                return;
+
+        stats = on_get_stats (state);
+        ply_trace ("statistics:\n%s", stats);
+
+        phases = ply_buffer_new ();
+        ply_phase_tracer_append_text (phases);
+        ply_trace ("startup phases:\n%s", ply_buffer_get_bytes (phases));
+        ply_buffer_free (phases);
+
+        if (state->session != NULL) {
+                const char *header = "plymouth statistics:\n";
+
+                ply_terminal_session_write_to_log (state->session, header, strlen (header));
+                ply_terminal_session_write_to_log (state->session, stats, strlen (stats));
+        }
+
+        free (stats);
+}
+
 static void
 on_quit (state_t       *state,
          bool           retain_splash,
@@ -1425,6 +1725,8 @@ on_quit (state_t       *state,
         state->quit_trigger = quit_trigger;
         state->should_retain_splash = retain_splash;
 
+        write_stats_to_log (state);
+
         ply_trace ("closing log");
         if (state->session != NULL)
                 ply_terminal_session_close_log (state->session);
@@ -1485,6 +1787,7 @@ start_boot_server (state_t *state)
                                       (ply_boot_server_quit_handler_t) on_quit,
                                       (ply_boot_server_has_active_vt_handler_t) on_has_active_vt,
                                       (ply_boot_server_reload_handler_t) on_reload,
+                                      (ply_boot_server_get_stats_handler_t) on_get_stats,
                                       state);
 
         if (!ply_boot_server_listen (server)) {
@@ -1797,7 +2100,9 @@ load_theme (state_t    *state,
                                       PLYMOUTH_PLUGIN_PATH,
                                       state->boot_buffer);
 
+        ply_phase_tracer_begin ("load-splash", theme_path);
         is_loaded = ply_boot_splash_load (splash);
+        ply_phase_tracer_end ("load-splash", theme_path);
 
         if (!is_loaded) {
                 ply_save_errno ();
@@ -1815,6 +2120,29 @@ load_theme (state_t    *state,
         return splash;
 }
 
+static bool
+show_loaded_theme (state_t           *state,
+                   ply_boot_splash_t *splash)
+{
+        attach_splash_to_devices (state, splash);
+        if (ply_boot_splash_uses_pixel_displays (splash))
+                ply_device_manager_activate_renderers (state->device_manager);
+
+        ply_phase_tracer_begin ("show-splash", NULL);
+        if (!ply_boot_splash_show (splash, state->mode)) {
+                ply_save_errno ();
+                ply_phase_tracer_end ("show-splash", NULL);
+                ply_boot_splash_free (splash);
+                ply_restore_errno ();
+                return false;
+        }
+        ply_phase_tracer_end ("show-splash", NULL);
+
+        ply_device_manager_activate_keyboards (state->device_manager);
+
+        return true;
+}
+
 static ply_boot_splash_t *
 show_theme (state_t    *state,
             const char *theme_path)
@@ -1829,18 +2157,8 @@ show_theme (state_t    *state,
         if (splash == NULL)
                 return NULL;
 
-        attach_splash_to_devices (state, splash);
-        if (ply_boot_splash_uses_pixel_displays (splash))
-                ply_device_manager_activate_renderers (state->device_manager);
-
-        if (!ply_boot_splash_show (splash, state->mode)) {
-                ply_save_errno ();
-                ply_boot_splash_free (splash);
-                ply_restore_errno ();
+        if (!show_loaded_theme (state, splash))
                 return NULL;
-        }
-
-        ply_device_manager_activate_keyboards (state->device_manager);
 
         return splash;
 }
@@ -1864,6 +2182,7 @@ attach_to_running_session (state_t *state)
                 session = ply_terminal_session_new (NULL);
 
                 ply_terminal_session_attach_to_event_loop (session, state->loop);
+                ply_terminal_session_set_log_records (session, state->has_structured_boot_log);
         } else {
                 session = state->session;
                 ply_trace ("session already created");
@@ -1973,6 +2292,12 @@ check_verbosity (state_t *state)
                 ply_trace ("tracing shouldn't be enabled!");
         }
 
+        /* Keep slow consoles from holding up the event loop
+         */
+        if (ply_is_tracing () &&
+            !ply_logger_start_writer_thread (ply_logger_get_error_default ()))
+                ply_trace ("could not start log writer thread: %m");
+
         if (debug_buffer != NULL) {
                 if (debug_buffer_path == NULL) {
                         if (state->mode == PLY_BOOT_SPLASH_MODE_SHUTDOWN ||
@@ -2007,6 +2332,18 @@ check_logging (state_t *state)
                 ply_trace ("logging won't be enabled!");
         else
                 ply_trace ("logging will be enabled!");
+
+        if (!state->no_boot_log &&
+            ply_kernel_command_line_has_argument ("plymouth.structured-boot-log")) {
+                ply_trace ("boot log will be written as timestamped records");
+                state->has_structured_boot_log = true;
+
+                if (ply_is_tracing ())
+                        ply_logger_add_filter (ply_logger_get_error_default (),
+                                               (ply_logger_filter_handler_t)
+                                               on_trace_message,
+                                               state);
+        }
 }
 
 static bool
@@ -2104,6 +2441,19 @@ on_error_message (ply_buffer_t *debug_buffer,
         ply_buffer_append_bytes (debug_buffer, bytes, number_of_bytes);
 }
 
+static void
+on_trace_message (state_t    *state,
+                  const void *bytes,
+                  size_t      number_of_bytes)
+{
+        if (state->session == NULL)
+                return;
+
+        ply_terminal_session_add_record_to_log (state->session,
+                                                PLY_LOG_RECORD_SOURCE_TRACE,
+                                                bytes, number_of_bytes);
+}
+
 static void
 dump_debug_buffer_to_file (void)
 {
@@ -2132,6 +2482,10 @@ on_crash (int signum)
         int fd;
         static const char *show_cursor_sequence = "\033[?25h";
 
+        /* Get out whatever the log writer thread didn't get to yet */
+        if (ply_is_tracing ())
+                ply_logger_flush (ply_logger_get_error_default ());
+
         fd = open ("/dev/tty1", O_RDWR | O_NOCTTY);
         if (fd < 0) fd = open ("/dev/hvc0", O_RDWR | O_NOCTTY);
 
@@ -2232,11 +2586,17 @@ main (int    argc,
         char *mode_string = NULL;
         char *kernel_command_line = NULL;
         char *tty = NULL;
+        char *renderer_string = NULL;
         ply_device_manager_flags_t device_manager_flags = PLY_DEVICE_MANAGER_FLAGS_NONE;
 
+        ply_phase_tracer_mark ("main", NULL);
+
         state.start_time = ply_get_timestamp ();
+        state.pending_system_update_progress = -1;
         state.command_parser = ply_command_parser_new ("plymouthd", "Splash server");
 
+        ply_set_built_in_modules (ply_built_in_plugins);
+
         state.loop = ply_event_loop_get_default ();
 
         /* Initialize the translations if they are available (!initrd) */
@@ -2258,6 +2618,7 @@ main (int    argc,
                                         "graphical-boot", "Use graphical splashes even if the kernel console is not a VT", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         NULL);
 
+        ply_phase_tracer_begin ("parse-command-line", NULL);
         if (!ply_command_parser_parse_arguments (state.command_parser, state.loop, argv, argc)) {
                 char *help_string;
 
@@ -2268,6 +2629,7 @@ main (int    argc,
                 free (help_string);
                 return EX_USAGE;
         }
+        ply_phase_tracer_end ("parse-command-line", NULL);
 
         ply_command_parser_get_options (state.command_parser,
                                         "help", &should_help,
@@ -2440,6 +2802,17 @@ main (int    argc,
             state.mode != PLY_BOOT_SPLASH_MODE_REBOOT)
                 device_manager_flags |= PLY_DEVICE_MANAGER_FLAGS_FORCE_FRAME_BUFFER;
 
+        if (ply_kernel_command_line_has_argument ("plymouth.early-display") ||
+            ply_kernel_command_line_get_string_after_prefix ("plymouth.early-display=") != NULL)
+                device_manager_flags |= PLY_DEVICE_MANAGER_FLAGS_EARLY_DISPLAY;
+
+        renderer_string = ply_kernel_command_line_get_key_value ("plymouth.renderer=");
+        if (renderer_string != NULL && strcmp (renderer_string, "offscreen") == 0) {
+                device_manager_flags |= PLY_DEVICE_MANAGER_FLAGS_OFFSCREEN;
+                device_manager_flags |= PLY_DEVICE_MANAGER_FLAGS_IGNORE_UDEV;
+        }
+        free (renderer_string);
+
         if (!plymouth_should_show_default_splash (&state)) {
                 /* don't bother listening for udev events or setting up a graphical renderer
                  * if we're forcing details */
@@ -2451,6 +2824,7 @@ main (int    argc,
         }
 
         find_force_scale (&state);
+        find_flush_threads (&state);
 
         load_devices (&state, device_manager_flags);
 
@@ -2458,6 +2832,9 @@ main (int    argc,
         exit_code = ply_event_loop_run (state.loop);
         ply_trace ("exited event loop");
 
+        ply_boot_splash_free (state.reloaded_boot_splash);
+        state.reloaded_boot_splash = NULL;
+
         ply_boot_splash_free (state.boot_splash);
         state.boot_splash = NULL;
 
@@ -2480,6 +2857,7 @@ main (int    argc,
         }
 
         ply_free_error_log ();
+        ply_key_file_free_cache ();
 
         free (state.override_splash_path);
         free (state.system_default_splash_path);
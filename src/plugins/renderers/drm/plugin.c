@@ -36,6 +36,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <libgen.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -44,6 +45,7 @@
 #include <unistd.h>
 
 #include <drm.h>
+#include <drm_fourcc.h>
 #include <drm_mode.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -51,6 +53,7 @@
 #include "ply-array.h"
 #include "ply-buffer.h"
 #include "ply-event-loop.h"
+#include "ply-flush-pool.h"
 #include "ply-input-device.h"
 #include "ply-list.h"
 #include "ply-logger.h"
@@ -65,6 +68,11 @@
 
 #define BYTES_PER_PIXEL (4)
 
+/* How long copies queued on the flush threads get to run alongside the
+ * rest of the main loop iteration before they're joined
+ */
+#define PLY_FLUSH_COMPLETION_DELAY (0.001)
+
 /* For builds with libdrm < 2.4.89 */
 #ifndef DRM_MODE_ROTATE_0
 #define DRM_MODE_ROTATE_0 (1 << 0)
@@ -86,6 +94,9 @@ struct _ply_renderer_head
         uint32_t                scan_out_buffer_id;
         bool                    scan_out_buffer_needs_reset;
         bool                    uses_hw_rotation;
+        bool                    can_skip_modeset;
+        bool                    shows_console_buffer;
+        bool                    flush_is_pending;
 
         int                     gamma_size;
         uint16_t               *gamma;
@@ -126,8 +137,12 @@ typedef struct
         uint32_t                    connector_type;
         uint32_t                    controller_id;
         uint32_t                    possible_controllers;
+        drmModeConnection           connection;
+        uint32_t                    width_mm;
+        uint32_t                    height_mm;
         int                         device_scale;
         int                         link_status;
+        uint32_t                    link_status_prop_id;
         ply_pixel_buffer_rotation_t rotation;
         bool                        tiled;
         bool                        connected;
@@ -135,6 +150,35 @@ typedef struct
         bool                        is_non_desktop;
 } ply_output_t;
 
+/* What a full probe found out about a connector, kept in
+ * PLYMOUTH_RUNTIME_DIR so the next plymouthd can skip the probe if the
+ * kernel still reports the same thing.
+ */
+#define PLY_PROBE_CACHE_MAGIC 0x43504c50 /* "PLPC" */
+#define PLY_PROBE_CACHE_VERSION 2
+
+typedef struct
+{
+        uint32_t magic;
+        uint32_t version;
+        char     driver_name[32];
+        uint32_t number_of_controllers;
+        uint32_t number_of_connectors;
+} ply_probe_cache_header_t;
+
+typedef struct
+{
+        drmModeModeInfo mode;
+        uint32_t        connector_id;
+        uint32_t        connection;
+        uint32_t        width_mm;
+        uint32_t        height_mm;
+        int32_t         rotation;
+        uint32_t        link_status_prop_id;
+        uint8_t         tiled;
+        uint8_t         is_non_desktop;
+} ply_probe_cache_entry_t;
+
 struct _ply_renderer_backend
 {
         ply_event_loop_t           *loop;
@@ -143,14 +187,22 @@ struct _ply_renderer_backend
         int                         device_fd;
         bool                        simpledrm;
         char                       *device_name;
+        char                       *driver_name;
         drmModeRes                 *resources;
 
+        ply_probe_cache_entry_t    *probe_cache;
+        int                         probe_cache_len;
+
         ply_renderer_input_source_t input_source;
         ply_list_t                 *heads;
         ply_hashtable_t            *heads_by_controller_id;
 
         ply_hashtable_t            *output_buffers;
 
+        ply_flush_pool_t           *flush_pool;
+        ply_flush_pool_batch_t      flush_batch;
+        ply_list_t                 *heads_with_pending_flush;
+
         ply_output_t               *outputs;
         int                         outputs_len;
         int                         connected_count;
@@ -162,6 +214,8 @@ struct _ply_renderer_backend
         uint32_t                    is_active : 1;
         uint32_t                    requires_explicit_flushing : 1;
         uint32_t                    input_source_is_open : 1;
+        uint32_t                    flush_completion_is_scheduled : 1;
+        uint32_t                    uses_probe_cache : 1;
 
         int                         panel_width;
         int                         panel_height;
@@ -177,6 +231,8 @@ static bool open_input_source (ply_renderer_backend_t      *backend,
                                ply_renderer_input_source_t *input_source);
 static void flush_head (ply_renderer_backend_t *backend,
                         ply_renderer_head_t    *head);
+static void finish_pending_flushes (ply_renderer_backend_t *backend);
+static void on_flush_completion_timeout (ply_renderer_backend_t *backend);
 
 static bool
 ply_renderer_buffer_map (ply_renderer_backend_t *backend,
@@ -286,7 +342,7 @@ static ply_renderer_buffer_t *
 get_buffer_from_id (ply_renderer_backend_t *backend,
                     uint32_t                id)
 {
-        static ply_renderer_buffer_t *buffer;
+        ply_renderer_buffer_t *buffer;
 
         buffer = ply_hashtable_lookup (backend->output_buffers, (void *) (uintptr_t) id);
 
@@ -516,9 +572,8 @@ ply_renderer_connector_get_properties (ply_renderer_backend_t *backend,
                                        drmModeConnector       *connector,
                                        ply_output_t           *output)
 {
-        int i, primary_id, rotation_prop_id;
         drmModePropertyPtr prop;
-        uint64_t rotation;
+        int i;
 
         output->rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
         output->tiled = false;
@@ -540,6 +595,7 @@ ply_renderer_connector_get_properties (ply_renderer_backend_t *backend,
                 if ((prop->flags & DRM_MODE_PROP_ENUM) &&
                     strcmp (prop->name, "link-status") == 0) {
                         output->link_status = connector->prop_values[i];
+                        output->link_status_prop_id = prop->prop_id;
                         ply_trace ("link-status %d", output->link_status);
                 }
                 if (strcmp (prop->name, "non-desktop") == 0) {
@@ -548,6 +604,40 @@ ply_renderer_connector_get_properties (ply_renderer_backend_t *backend,
 
                 drmModeFreeProperty (prop);
         }
+}
+
+/* The link status can change at any time, so unlike the rest of the
+ * properties it doesn't come from the probe cache.  Only its property id
+ * gets cached, so it can be found in the values the connector came with.
+ */
+static void
+ply_renderer_connector_get_link_status (drmModeConnector *connector,
+                                        uint32_t          link_status_prop_id,
+                                        ply_output_t     *output)
+{
+        int i;
+
+        if (link_status_prop_id == 0)
+                return;
+
+        output->link_status_prop_id = link_status_prop_id;
+
+        for (i = 0; i < connector->count_props; i++) {
+                if (connector->props[i] != link_status_prop_id)
+                        continue;
+
+                output->link_status = connector->prop_values[i];
+                ply_trace ("link-status %d", output->link_status);
+                break;
+        }
+}
+
+static void
+check_for_hw_rotation (ply_renderer_backend_t *backend,
+                       ply_output_t           *output)
+{
+        int primary_id, rotation_prop_id;
+        uint64_t rotation;
 
         /* If the firmware setup the plane to use hw 180° rotation, then we keep
          * the hw rotation. This avoids a flicker and avoids the splash turning
@@ -569,8 +659,11 @@ static bool
 ply_renderer_head_add_connector (ply_renderer_head_t *head,
                                  ply_output_t        *output)
 {
-        if (output->link_status == DRM_MODE_LINK_STATUS_BAD)
+        /* A bad link only gets retrained by a modeset */
+        if (output->link_status == DRM_MODE_LINK_STATUS_BAD) {
                 head->scan_out_buffer_needs_reset = true;
+                head->can_skip_modeset = false;
+        }
 
         if (output->mode.hdisplay != head->area.width || output->mode.vdisplay != head->area.height) {
                 ply_trace ("Tried to add connector with resolution %dx%d to %dx%d head",
@@ -591,10 +684,134 @@ ply_renderer_head_add_connector (ply_renderer_head_t *head,
         return true;
 }
 
+static void
+close_buffer_handles (ply_renderer_backend_t *backend,
+                      drmModeFB2             *buffer)
+{
+        struct drm_gem_close close_request;
+        int i, j;
+
+        for (i = 0; i < 4; i++) {
+                if (buffer->handles[i] == 0)
+                        continue;
+
+                /* Planes of one buffer can share a handle */
+                for (j = 0; j < i; j++) {
+                        if (buffer->handles[j] == buffer->handles[i])
+                                break;
+                }
+                if (j < i)
+                        continue;
+
+                memset (&close_request, 0, sizeof(close_request));
+                close_request.handle = buffer->handles[i];
+                drmIoctl (backend->device_fd, DRM_IOCTL_GEM_CLOSE, &close_request);
+        }
+}
+
+/* Copies the frame buffer the firmware is scanning out into the head's
+ * pixel buffer.  This only works for linear 32bpp buffers the driver lets
+ * us map, which covers firmware frame buffers on simpledrm and most
+ * drivers that take them over.
+ */
+static bool
+ply_renderer_head_copy_console_buffer (ply_renderer_backend_t *backend,
+                                       ply_renderer_head_t    *head)
+{
+#ifdef HAVE_DRM_MODE_GET_FB2
+        struct drm_mode_map_dumb map_request;
+        drmModeFB2 *buffer;
+        uint32_t *bytes;
+        char *map_address;
+        size_t map_size;
+        int primary_id, rotation_prop_id;
+        uint64_t rotation;
+        unsigned long i, y;
+        bool copied = false;
+
+        if (head->console_buffer_id == 0)
+                return false;
+
+        if (ply_pixel_buffer_get_device_rotation (head->pixel_buffer) != PLY_PIXEL_BUFFER_ROTATE_UPRIGHT)
+                return false;
+
+        /* The plane rotation gets cleared when we take over, so a rotated
+         * console buffer would show up the wrong way around
+         */
+        if (!head->uses_hw_rotation &&
+            get_primary_plane_rotation (backend, head->controller_id,
+                                        &primary_id, &rotation_prop_id,
+                                        &rotation) &&
+            rotation != DRM_MODE_ROTATE_0)
+                return false;
+
+        buffer = drmModeGetFB2 (backend->device_fd, head->console_buffer_id);
+        if (buffer == NULL) {
+                ply_trace ("Could not look up console buffer %u: %m", head->console_buffer_id);
+                return false;
+        }
+
+        if ((buffer->pixel_format != DRM_FORMAT_XRGB8888 &&
+             buffer->pixel_format != DRM_FORMAT_ARGB8888) ||
+            ((buffer->flags & DRM_MODE_FB_MODIFIERS) &&
+             buffer->modifier != DRM_FORMAT_MOD_LINEAR) ||
+            buffer->width != head->area.width ||
+            buffer->height != head->area.height ||
+            buffer->handles[0] == 0) {
+                ply_trace ("Console buffer %u isn't a linear %ldx%ld 32bpp buffer",
+                           head->console_buffer_id, head->area.width, head->area.height);
+                goto out;
+        }
+
+        memset (&map_request, 0, sizeof(map_request));
+        map_request.handle = buffer->handles[0];
+        if (drmIoctl (backend->device_fd, DRM_IOCTL_MODE_MAP_DUMB, &map_request) < 0) {
+                ply_trace ("Could not map console buffer %u: %m", head->console_buffer_id);
+                goto out;
+        }
+
+        map_size = buffer->offsets[0] + (size_t) buffer->pitches[0] * buffer->height;
+        map_address = mmap (0, map_size, PROT_READ, MAP_SHARED,
+                            backend->device_fd, map_request.offset);
+        if (map_address == MAP_FAILED) {
+                ply_trace ("Could not map console buffer %u: %m", head->console_buffer_id);
+                goto out;
+        }
+
+        /* Scan out memory is usually uncached, so read it a row at a time
+         * and fix up the alpha channel once it is in our own buffer
+         */
+        bytes = ply_pixel_buffer_get_argb32_data (head->pixel_buffer);
+        for (y = 0; y < head->area.height; y++) {
+                memcpy (bytes + y * head->area.width,
+                        map_address + buffer->offsets[0] + y * buffer->pitches[0],
+                        head->area.width * BYTES_PER_PIXEL);
+        }
+        munmap (map_address, map_size);
+
+        for (i = 0; i < head->area.width * head->area.height; i++) {
+                bytes[i] |= 0xff000000;
+        }
+
+        ply_trace ("Copied console buffer %u into %ldx%ld renderer head",
+                   head->console_buffer_id, head->area.width, head->area.height);
+        head->shows_console_buffer = true;
+        copied = true;
+out:
+        close_buffer_handles (backend, buffer);
+        drmModeFreeFB2 (buffer);
+
+        return copied;
+#else
+        return false;
+#endif
+}
+
 static ply_renderer_head_t *
 ply_renderer_head_new (ply_renderer_backend_t *backend,
                        ply_output_t           *output,
                        uint32_t                console_buffer_id,
+                       bool                    console_mode_matches,
                        int                     gamma_size)
 {
         ply_renderer_head_t *head;
@@ -608,6 +825,7 @@ ply_renderer_head_new (ply_renderer_backend_t *backend,
         head->console_buffer_id = console_buffer_id;
         head->connector0_mode = output->mode;
         head->uses_hw_rotation = output->uses_hw_rotation;
+        head->can_skip_modeset = console_mode_matches;
 
         head->area.x = 0;
         head->area.y = 0;
@@ -638,6 +856,15 @@ ply_renderer_head_new (ply_renderer_backend_t *backend,
         /* Delay flush till first actual draw */
         ply_region_clear (ply_pixel_buffer_get_updated_areas (head->pixel_buffer));
 
+        /* Start from whatever the firmware left on screen, so the first
+         * flush shows the same picture until the splash draws over it.
+         * The whole head stays dirty so it all makes it into our buffer.
+         */
+        if (head->can_skip_modeset &&
+            ply_renderer_head_copy_console_buffer (backend, head))
+                ply_region_add_rectangle (ply_pixel_buffer_get_updated_areas (head->pixel_buffer),
+                                          &head->area);
+
         /*
          * On devices without a builtin display, use the info from the first
          * enumerated output as panel info to sensure correct BGRT scaling.
@@ -724,6 +951,25 @@ ply_renderer_head_set_scan_out_buffer (ply_renderer_backend_t *backend,
                 head->gamma = NULL;
         }
 
+        /* The controller already shows this mode on these connectors, so
+         * flipping to our buffer is enough.  Later resets need a full
+         * modeset, since something else may have changed the mode.
+         */
+        if (head->can_skip_modeset) {
+                head->can_skip_modeset = false;
+
+                if (drmModePageFlip (backend->device_fd, head->controller_id,
+                                     buffer_id, 0, NULL) == 0) {
+                        ply_trace ("Flipped head with controller id %d to our buffer without a modeset",
+                                   head->controller_id);
+                        ply_renderer_head_clear_plane_rotation (backend, head);
+                        return true;
+                }
+
+                ply_trace ("Couldn't flip head with controller id %d to our buffer, setting mode: %m",
+                           head->controller_id);
+        }
+
         /* Tell the controller to use the allocated scan out buffer on each connectors
          */
         if (drmModeSetCrtc (backend->device_fd, head->controller_id, buffer_id,
@@ -770,6 +1016,9 @@ static void
 ply_renderer_head_unmap (ply_renderer_backend_t *backend,
                          ply_renderer_head_t    *head)
 {
+        if (head->flush_is_pending)
+                finish_pending_flushes (backend);
+
         ply_trace ("unmapping %ldx%ld renderer head", head->area.width, head->area.height);
         unmap_buffer (backend, head->scan_out_buffer_id);
 
@@ -864,6 +1113,8 @@ free_heads (ply_renderer_backend_t *backend)
 {
         ply_list_node_t *node;
 
+        finish_pending_flushes (backend);
+
         node = ply_list_get_first_node (backend->heads);
         while (node != NULL) {
                 ply_list_node_t *next_node;
@@ -905,6 +1156,9 @@ create_backend (const char     *device_name,
         backend->output_buffers = ply_hashtable_new (ply_hashtable_direct_hash,
                                                      ply_hashtable_direct_compare);
         backend->heads_by_controller_id = ply_hashtable_new (NULL, NULL);
+        backend->flush_pool = ply_flush_pool_get_default ();
+        backend->heads_with_pending_flush = ply_list_new ();
+        backend->uses_probe_cache = ply_kernel_command_line_has_argument ("plymouth.drm-probe-cache");
 
         return backend;
 }
@@ -922,8 +1176,10 @@ destroy_backend (ply_renderer_backend_t *backend)
         free_heads (backend);
 
         free (backend->device_name);
+        free (backend->driver_name);
         ply_hashtable_free (backend->output_buffers);
         ply_hashtable_free (backend->heads_by_controller_id);
+        ply_list_free (backend->heads_with_pending_flush);
         ply_list_free (backend->input_source.input_devices);
 
         free (backend->outputs);
@@ -952,6 +1208,8 @@ activate (ply_renderer_backend_t *backend)
 static void
 deactivate (ply_renderer_backend_t *backend)
 {
+        finish_pending_flushes (backend);
+
         ply_trace ("dropping master");
         drmDropMaster (backend->device_fd);
         backend->is_active = false;
@@ -989,6 +1247,9 @@ load_driver (ply_renderer_backend_t *backend)
                 if (strcmp (version->name, "simpledrm") == 0)
                         backend->simpledrm = true;
 
+                free (backend->driver_name);
+                backend->driver_name = strdup (version->name);
+
                 drmFreeVersion (version);
         }
 
@@ -1189,6 +1450,41 @@ get_active_mode (ply_renderer_backend_t *backend,
         return mode;
 }
 
+static ply_probe_cache_entry_t *
+get_probe_cache_entry (ply_renderer_backend_t *backend,
+                       uint32_t                connector_id)
+{
+        int i;
+
+        for (i = 0; i < backend->probe_cache_len; i++) {
+                if (backend->probe_cache[i].connector_id == connector_id)
+                        return &backend->probe_cache[i];
+        }
+
+        return NULL;
+}
+
+/* The connector state the kernel already has is good enough if it still
+ * matches what we saw when we last probed
+ */
+static bool
+probe_cache_entry_matches_connector (ply_renderer_backend_t  *backend,
+                                     ply_probe_cache_entry_t *entry,
+                                     drmModeConnector        *connector)
+{
+        if (connector->connection != entry->connection)
+                return false;
+
+        if (connector->connection != DRM_MODE_CONNECTED)
+                return true;
+
+        if (connector->mmWidth != entry->width_mm ||
+            connector->mmHeight != entry->height_mm)
+                return false;
+
+        return find_matching_connector_mode (backend, connector, &entry->mode) != NULL;
+}
+
 static void
 get_output_info (ply_renderer_backend_t *backend,
                  uint32_t                connector_id,
@@ -1196,21 +1492,54 @@ get_output_info (ply_renderer_backend_t *backend,
 {
         drmModeModeInfo *mode = NULL;
         drmModeConnector *connector;
+        ply_probe_cache_entry_t *cache_entry;
         bool has_90_rotation = false;
 
         memset (output, 0, sizeof(*output));
         output->connector_id = connector_id;
 
-        connector = drmModeGetConnector (backend->device_fd, connector_id);
+        cache_entry = get_probe_cache_entry (backend, connector_id);
+        if (cache_entry != NULL) {
+                connector = drmModeGetConnectorCurrent (backend->device_fd, connector_id);
+
+                if (connector != NULL &&
+                    !probe_cache_entry_matches_connector (backend, cache_entry, connector)) {
+                        ply_trace ("connector %u changed since it was cached, probing it", connector_id);
+                        drmModeFreeConnector (connector);
+                        connector = NULL;
+                        cache_entry = NULL;
+                }
+        } else {
+                connector = NULL;
+        }
+
+        if (connector == NULL)
+                connector = drmModeGetConnector (backend->device_fd, connector_id);
         if (connector == NULL)
                 return;
 
+        output->connection = connector->connection;
+        output->width_mm = connector->mmWidth;
+        output->height_mm = connector->mmHeight;
+
         if (connector->connection != DRM_MODE_CONNECTED ||
             connector->count_modes <= 0)
                 goto out;
 
         output_get_controller_info (backend, connector, output);
-        ply_renderer_connector_get_properties (backend, connector, output);
+
+        if (cache_entry != NULL) {
+                output->rotation = cache_entry->rotation;
+                output->tiled = cache_entry->tiled;
+                output->is_non_desktop = cache_entry->is_non_desktop;
+                ply_renderer_connector_get_link_status (connector,
+                                                        cache_entry->link_status_prop_id,
+                                                        output);
+        } else {
+                ply_renderer_connector_get_properties (backend, connector, output);
+        }
+        check_for_hw_rotation (backend, output);
+
         /* ignore non-desktop outputs */
         if (output->is_non_desktop)
                 goto out;
@@ -1218,7 +1547,10 @@ get_output_info (ply_renderer_backend_t *backend,
             output->rotation == PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE)
                 has_90_rotation = true;
 
-        if (!output->tiled)
+        if (cache_entry != NULL)
+                mode = find_matching_connector_mode (backend, connector, &cache_entry->mode);
+
+        if (!mode && !output->tiled)
                 mode = get_preferred_mode (connector);
 
         if (!mode && output->controller_id)
@@ -1402,6 +1734,7 @@ create_heads_for_active_connectors (ply_renderer_backend_t *backend,
 {
         int i, j, number_of_setup_outputs, outputs_len;
         ply_output_t *outputs;
+        uint32_t *console_controller_ids;
         bool changed = false;
 
         /* Step 1:
@@ -1417,10 +1750,17 @@ create_heads_for_active_connectors (ply_renderer_backend_t *backend,
         outputs = calloc (backend->resources->count_connectors, sizeof(*outputs));
         outputs_len = backend->resources->count_connectors;
 
+        console_controller_ids = calloc (outputs_len, sizeof(uint32_t));
+
         backend->connected_count = 0;
         for (i = 0; i < outputs_len; i++) {
                 get_output_info (backend, backend->resources->connectors[i], &outputs[i]);
 
+                /* Remember which controller lit each output before we
+                 * start shuffling them around
+                 */
+                console_controller_ids[i] = outputs[i].controller_id;
+
                 if (check_if_output_has_changed (backend, &outputs[i]))
                         changed = true;
 
@@ -1493,6 +1833,7 @@ create_heads_for_active_connectors (ply_renderer_backend_t *backend,
                 ply_renderer_head_t *head;
                 uint32_t controller_id;
                 uint32_t console_buffer_id;
+                bool console_mode_matches;
                 int gamma_size;
 
                 if (!outputs[i].controller_id)
@@ -1504,6 +1845,10 @@ create_heads_for_active_connectors (ply_renderer_backend_t *backend,
 
                 controller_id = controller->crtc_id;
                 console_buffer_id = controller->buffer_id;
+                console_mode_matches = !change &&
+                                       controller->mode_valid &&
+                                       console_controller_ids[i] == controller_id &&
+                                       modes_are_equal (&controller->mode, &outputs[i].mode);
                 gamma_size = controller->gamma_size;
                 drmModeFreeCrtc (controller);
 
@@ -1513,14 +1858,21 @@ create_heads_for_active_connectors (ply_renderer_backend_t *backend,
                 if (head == NULL) {
                         head = ply_renderer_head_new (backend, &outputs[i],
                                                       console_buffer_id,
+                                                      console_mode_matches,
                                                       gamma_size);
                         changed = true;
                 } else {
                         if (ply_renderer_head_add_connector (head, &outputs[i]))
                                 changed = true;
+
+                        /* A flip won't light up a connector that's still dark */
+                        if (!console_mode_matches)
+                                head->can_skip_modeset = false;
                 }
         }
 
+        free (console_controller_ids);
+
         backend->outputs_len = outputs_len;
         backend->outputs = outputs;
 
@@ -1563,6 +1915,151 @@ has_32bpp_support (ply_renderer_backend_t *backend)
         return true;
 }
 
+static char *
+get_probe_cache_path (ply_renderer_backend_t *backend)
+{
+        char *device_name, *path;
+        int result;
+
+        device_name = strdup (backend->device_name);
+        result = asprintf (&path, PLYMOUTH_RUNTIME_DIR "/drm-probe-cache-%s", basename (device_name));
+        free (device_name);
+
+        if (result < 0)
+                return NULL;
+
+        return path;
+}
+
+static void
+fill_probe_cache_header (ply_renderer_backend_t   *backend,
+                         ply_probe_cache_header_t *header)
+{
+        memset (header, 0, sizeof(*header));
+        header->magic = PLY_PROBE_CACHE_MAGIC;
+        header->version = PLY_PROBE_CACHE_VERSION;
+        if (backend->driver_name != NULL)
+                strncpy (header->driver_name, backend->driver_name, sizeof(header->driver_name) - 1);
+        header->number_of_controllers = backend->resources->count_crtcs;
+        header->number_of_connectors = backend->resources->count_connectors;
+}
+
+static void
+load_probe_cache (ply_renderer_backend_t *backend)
+{
+        ply_probe_cache_header_t header, expected_header;
+        ply_probe_cache_entry_t *entries;
+        char *path;
+        int fd, i;
+
+        path = get_probe_cache_path (backend);
+        if (path == NULL)
+                return;
+
+        fd = open (path, O_RDONLY | O_CLOEXEC);
+        free (path);
+
+        if (fd < 0)
+                return;
+
+        fill_probe_cache_header (backend, &expected_header);
+        if (!ply_read (fd, &header, sizeof(header)) ||
+            memcmp (&header, &expected_header, sizeof(header)) != 0) {
+                ply_trace ("probe cache doesn't match device, ignoring it");
+                close (fd);
+                return;
+        }
+
+        entries = calloc (header.number_of_connectors, sizeof(ply_probe_cache_entry_t));
+        if (!ply_read (fd, entries, header.number_of_connectors * sizeof(ply_probe_cache_entry_t))) {
+                ply_trace ("probe cache is truncated, ignoring it");
+                free (entries);
+                close (fd);
+                return;
+        }
+        close (fd);
+
+        for (i = 0; i < backend->resources->count_connectors; i++) {
+                if (entries[i].connector_id != backend->resources->connectors[i]) {
+                        ply_trace ("probe cache has different connectors, ignoring it");
+                        free (entries);
+                        return;
+                }
+        }
+
+        ply_trace ("using probe cache for %d connectors", backend->resources->count_connectors);
+        backend->probe_cache = entries;
+        backend->probe_cache_len = header.number_of_connectors;
+}
+
+static void
+free_probe_cache (ply_renderer_backend_t *backend)
+{
+        free (backend->probe_cache);
+        backend->probe_cache = NULL;
+        backend->probe_cache_len = 0;
+}
+
+static void
+save_probe_cache (ply_renderer_backend_t *backend)
+{
+        ply_probe_cache_header_t header;
+        ply_probe_cache_entry_t *entries;
+        char *path, *temporary_path;
+        bool written;
+        int fd, i;
+
+        if (backend->outputs_len != backend->resources->count_connectors)
+                return;
+
+        fill_probe_cache_header (backend, &header);
+
+        entries = calloc (backend->outputs_len, sizeof(ply_probe_cache_entry_t));
+        for (i = 0; i < backend->outputs_len; i++) {
+                ply_output_t *output = &backend->outputs[i];
+
+                entries[i].mode = output->mode;
+                entries[i].connector_id = output->connector_id;
+                entries[i].connection = output->connection;
+                entries[i].width_mm = output->width_mm;
+                entries[i].height_mm = output->height_mm;
+                /* Cache what the connector says, not what we do about it */
+                entries[i].rotation = output->uses_hw_rotation ?
+                                      PLY_PIXEL_BUFFER_ROTATE_UPSIDE_DOWN :
+                                      output->rotation;
+                entries[i].link_status_prop_id = output->link_status_prop_id;
+                entries[i].tiled = output->tiled;
+                entries[i].is_non_desktop = output->is_non_desktop;
+        }
+
+        path = get_probe_cache_path (backend);
+        if (path == NULL || asprintf (&temporary_path, "%s.tmp", path) < 0) {
+                temporary_path = NULL;
+                goto out;
+        }
+
+        fd = open (temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) {
+                ply_trace ("could not create %s: %m", temporary_path);
+                goto out;
+        }
+
+        /* The rename is only safe once the entries are on disk */
+        written = ply_write (fd, &header, sizeof(header)) &&
+                  ply_write (fd, entries, backend->outputs_len * sizeof(ply_probe_cache_entry_t)) &&
+                  fsync (fd) == 0;
+        close (fd);
+
+        if (!written || rename (temporary_path, path) < 0) {
+                ply_trace ("could not write %s: %m", path);
+                unlink (temporary_path);
+        }
+out:
+        free (temporary_path);
+        free (path);
+        free (entries);
+}
+
 static bool
 query_device (ply_renderer_backend_t *backend)
 {
@@ -1578,14 +2075,21 @@ query_device (ply_renderer_backend_t *backend)
                 return false;
         }
 
+        if (backend->uses_probe_cache)
+                load_probe_cache (backend);
+
         if (!create_heads_for_active_connectors (backend, false)) {
                 ply_trace ("Could not initialize heads");
                 ret = false;
         } else if (!has_32bpp_support (backend)) {
                 ply_trace ("Device doesn't support 32bpp framebuffer");
                 ret = false;
+        } else if (backend->uses_probe_cache) {
+                save_probe_cache (backend);
         }
 
+        free_probe_cache (backend);
+
         drmModeFreeResources (backend->resources);
         backend->resources = NULL;
 
@@ -1597,6 +2101,8 @@ handle_change_event (ply_renderer_backend_t *backend)
 {
         bool ret = true;
 
+        finish_pending_flushes (backend);
+
         backend->resources = drmModeGetResources (backend->device_fd);
         if (backend->resources == NULL) {
                 ply_trace ("Could not get card resources for change event");
@@ -1605,6 +2111,9 @@ handle_change_event (ply_renderer_backend_t *backend)
 
         ret = create_heads_for_active_connectors (backend, true);
 
+        if (backend->uses_probe_cache)
+                save_probe_cache (backend);
+
         drmModeFreeResources (backend->resources);
         backend->resources = NULL;
 
@@ -1689,6 +2198,123 @@ reset_scan_out_buffer_if_needed (ply_renderer_backend_t *backend,
         return did_reset;
 }
 
+static void
+finish_flush (ply_renderer_backend_t *backend,
+              ply_renderer_head_t    *head)
+{
+        if (reset_scan_out_buffer_if_needed (backend, head))
+                ply_trace ("Needed to reset scan out buffer on %ldx%ld renderer head",
+                           head->area.width, head->area.height);
+
+        end_flush (backend, head->scan_out_buffer_id);
+
+        ply_renderer_note_flushed_frame (backend->device_name);
+}
+
+static void
+on_flush_completion_timeout (ply_renderer_backend_t *backend)
+{
+        backend->flush_completion_is_scheduled = false;
+        finish_pending_flushes (backend);
+}
+
+static void
+finish_pending_flushes (ply_renderer_backend_t *backend)
+{
+        ply_list_node_t *node;
+
+        if (backend->flush_completion_is_scheduled) {
+                ply_event_loop_stop_watching_for_timeout (backend->loop,
+                                                          (ply_event_loop_timeout_handler_t)
+                                                          on_flush_completion_timeout,
+                                                          backend);
+                backend->flush_completion_is_scheduled = false;
+        }
+
+        if (ply_list_get_length (backend->heads_with_pending_flush) == 0)
+                return;
+
+        /* The copies have to land in the scan out buffers before the
+         * controllers get pointed at them and before they get marked dirty
+         */
+        ply_flush_pool_wait (backend->flush_pool, &backend->flush_batch);
+
+        node = ply_list_get_first_node (backend->heads_with_pending_flush);
+        while (node != NULL) {
+                ply_renderer_head_t *head;
+
+                head = (ply_renderer_head_t *) ply_list_node_get_data (node);
+
+                finish_flush (backend, head);
+
+                /* Drop the mapping reference taken when the copies were queued */
+                unmap_buffer (backend, head->scan_out_buffer_id);
+                head->flush_is_pending = false;
+
+                node = ply_list_get_next_node (backend->heads_with_pending_flush, node);
+        }
+
+        ply_list_remove_all_nodes (backend->heads_with_pending_flush);
+}
+
+static bool
+queue_flush (ply_renderer_backend_t *backend,
+             ply_renderer_head_t    *head,
+             ply_list_t             *areas_to_flush)
+{
+        ply_list_node_t *node;
+        uint32_t *shadow_buffer;
+        char *map_address;
+        bool queued = false;
+
+        /* Keep the dumb buffer mapped until the worker threads are done with it */
+        if (!map_buffer (backend, head->scan_out_buffer_id))
+                return false;
+
+        map_address = begin_flush (backend, head->scan_out_buffer_id);
+        shadow_buffer = ply_pixel_buffer_get_argb32_data (head->pixel_buffer);
+
+        node = ply_list_get_first_node (areas_to_flush);
+        while (node != NULL) {
+                ply_rectangle_t *area_to_flush;
+
+                area_to_flush = (ply_rectangle_t *) ply_list_node_get_data (node);
+
+                ply_flush_pool_queue_copy (backend->flush_pool,
+                                           &backend->flush_batch,
+                                           &map_address[area_to_flush->y * head->row_stride + area_to_flush->x * BYTES_PER_PIXEL],
+                                           head->row_stride,
+                                           (char *) &shadow_buffer[area_to_flush->y * head->area.width + area_to_flush->x],
+                                           head->area.width * BYTES_PER_PIXEL,
+                                           area_to_flush->width * BYTES_PER_PIXEL,
+                                           area_to_flush->height);
+                queued = true;
+
+                node = ply_list_get_next_node (areas_to_flush, node);
+        }
+
+        if (!queued) {
+                unmap_buffer (backend, head->scan_out_buffer_id);
+                return false;
+        }
+
+        head->flush_is_pending = true;
+        ply_list_append_data (backend->heads_with_pending_flush, head);
+
+        /* Other heads usually get drawn in the same main loop iteration,
+         * so let their copies run alongside this one and join afterward.
+         */
+        if (!backend->flush_completion_is_scheduled) {
+                ply_event_loop_watch_for_timeout (backend->loop, PLY_FLUSH_COMPLETION_DELAY,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  on_flush_completion_timeout,
+                                                  backend);
+                backend->flush_completion_is_scheduled = true;
+        }
+
+        return true;
+}
+
 static void
 flush_head (ply_renderer_backend_t *backend,
             ply_renderer_head_t    *head)
@@ -1710,6 +2336,9 @@ flush_head (ply_renderer_backend_t *backend,
                 ply_terminal_set_mode (backend->terminal, PLY_TERMINAL_MODE_GRAPHICS);
                 ply_terminal_set_unbuffered_input (backend->terminal);
         }
+        /* Whatever gets flushed now is the splash's, not the firmware's */
+        head->shows_console_buffer = false;
+
         pixel_buffer = head->pixel_buffer;
         updated_region = ply_pixel_buffer_get_updated_areas (pixel_buffer);
         areas_to_flush = ply_region_get_sorted_rectangle_list (updated_region);
@@ -1720,6 +2349,18 @@ flush_head (ply_renderer_backend_t *backend,
                         return;
         }
 
+        if (backend->flush_pool != NULL) {
+                if (head->flush_is_pending)
+                        finish_pending_flushes (backend);
+
+                /* If the copies couldn't be queued, keep the damage so
+                 * the next flush tries again
+                 */
+                if (queue_flush (backend, head, areas_to_flush))
+                        ply_region_clear (updated_region);
+                return;
+        }
+
         map_address = begin_flush (backend, head->scan_out_buffer_id);
 
         node = ply_list_get_first_node (areas_to_flush);
@@ -1732,13 +2373,8 @@ flush_head (ply_renderer_backend_t *backend,
                 node = ply_list_get_next_node (areas_to_flush, node);
         }
 
-        if (dirty) {
-                if (reset_scan_out_buffer_if_needed (backend, head))
-                        ply_trace ("Needed to reset scan out buffer on %ldx%ld renderer head",
-                                   head->area.width, head->area.height);
-
-                end_flush (backend, head->scan_out_buffer_id);
-        }
+        if (dirty)
+                finish_flush (backend, head);
 
         ply_region_clear (updated_region);
 }
@@ -1756,9 +2392,25 @@ get_buffer_for_head (ply_renderer_backend_t *backend,
         if (head->backend != backend)
                 return NULL;
 
+        /* Callers draw into the shadow buffer, so it can't still be
+         * getting copied out by the flush threads
+         */
+        if (head->flush_is_pending)
+                finish_pending_flushes (backend);
+
         return head->pixel_buffer;
 }
 
+static bool
+head_shows_firmware_image (ply_renderer_backend_t *backend,
+                           ply_renderer_head_t    *head)
+{
+        if (head->backend != backend)
+                return false;
+
+        return head->shows_console_buffer;
+}
+
 static bool
 has_input_source (ply_renderer_backend_t      *backend,
                   ply_renderer_input_source_t *input_source)
@@ -2058,6 +2710,7 @@ ply_renderer_backend_get_interface (void)
                 .flush_head                   = flush_head,
                 .get_heads                    = get_heads,
                 .get_buffer_for_head          = get_buffer_for_head,
+                .head_shows_firmware_image    = head_shows_firmware_image,
                 .get_input_source             = get_input_source,
                 .open_input_source            = open_input_source,
                 .set_handler_for_input_source = set_handler_for_input_source,
@@ -612,6 +612,8 @@ flush_head (ply_renderer_backend_t *backend,
         }
 
         ply_region_clear (updated_region);
+
+        ply_renderer_note_flushed_frame (backend->device_name);
 }
 
 static void
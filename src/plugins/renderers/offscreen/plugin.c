@@ -0,0 +1,646 @@
+/* plugin.c - offscreen renderer plugin
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * This renderer draws into plain memory instead of a display device, so
+ * splashes can be exercised and benchmarked on machines without one.  It
+ * is configured from the kernel command line:
+ *
+ *   plymouth.offscreen-heads=WIDTHxHEIGHT[@SCALE][:ROTATION][,...]
+ *   plymouth.offscreen-dump=DIRECTORY
+ *   plymouth.offscreen-dump-format=png|raw
+ *
+ * where ROTATION is one of 0, 90, 180 or 270.  When a dump directory is
+ * given, every flushed frame of every head is written to it.  Raw dumps
+ * are tightly packed 32-bit little endian ARGB rows.
+ */
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <png.h>
+
+#include "ply-buffer.h"
+#include "ply-event-loop.h"
+#include "ply-flush-pool.h"
+#include "ply-list.h"
+#include "ply-logger.h"
+#include "ply-rectangle.h"
+#include "ply-region.h"
+#include "ply-utils.h"
+
+#include "ply-renderer.h"
+#include "ply-renderer-plugin.h"
+
+#define BYTES_PER_PIXEL (4)
+/* Pad rows the way most scan out buffers are */
+#define ROW_STRIDE_ALIGNMENT (64)
+
+#define DEFAULT_HEADS "1024x768"
+
+typedef enum
+{
+        PLY_OFFSCREEN_DUMP_FORMAT_PNG,
+        PLY_OFFSCREEN_DUMP_FORMAT_RAW,
+} ply_offscreen_dump_format_t;
+
+struct _ply_renderer_head
+{
+        ply_renderer_backend_t     *backend;
+        ply_pixel_buffer_t         *pixel_buffer;
+        ply_rectangle_t             area;
+
+        int                         index;
+        int                         scale;
+        ply_pixel_buffer_rotation_t rotation;
+
+        char                       *frame;
+        unsigned long               row_stride;
+        unsigned long               frame_count;
+};
+
+struct _ply_renderer_input_source
+{
+        ply_buffer_t                       *key_buffer;
+        ply_renderer_input_source_handler_t handler;
+        void                               *user_data;
+};
+
+struct _ply_renderer_backend
+{
+        ply_event_loop_t           *loop;
+        ply_renderer_input_source_t input_source;
+        ply_list_t                 *heads;
+
+        ply_flush_pool_t           *flush_pool;
+        ply_flush_pool_batch_t      flush_batch;
+
+        char                       *dump_directory;
+        ply_offscreen_dump_format_t dump_format;
+
+        unsigned long               number_of_flushes;
+        unsigned long               number_of_rectangles;
+        unsigned long long          number_of_bytes;
+        double                      flush_time;
+
+        uint32_t                    is_active : 1;
+};
+
+ply_renderer_plugin_interface_t *ply_renderer_backend_get_interface (void);
+
+static bool
+parse_rotation (const char                  *string,
+                ply_pixel_buffer_rotation_t *rotation)
+{
+        switch (strtol (string, NULL, 10)) {
+        case 0:
+                *rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
+                return true;
+        case 90:
+                *rotation = PLY_PIXEL_BUFFER_ROTATE_CLOCKWISE;
+                return true;
+        case 180:
+                *rotation = PLY_PIXEL_BUFFER_ROTATE_UPSIDE_DOWN;
+                return true;
+        case 270:
+                *rotation = PLY_PIXEL_BUFFER_ROTATE_COUNTER_CLOCKWISE;
+                return true;
+        }
+
+        return false;
+}
+
+static ply_renderer_head_t *
+ply_renderer_head_new (ply_renderer_backend_t     *backend,
+                       unsigned long               width,
+                       unsigned long               height,
+                       int                         scale,
+                       ply_pixel_buffer_rotation_t rotation)
+{
+        ply_renderer_head_t *head;
+
+        head = calloc (1, sizeof(ply_renderer_head_t));
+
+        head->backend = backend;
+        head->index = ply_list_get_length (backend->heads);
+        head->area.width = width;
+        head->area.height = height;
+        head->scale = scale;
+        head->rotation = rotation;
+
+        head->pixel_buffer = ply_pixel_buffer_new_with_device_rotation (width, height, rotation);
+        ply_pixel_buffer_set_device_scale (head->pixel_buffer, scale);
+        ply_pixel_buffer_fill_with_color (head->pixel_buffer, NULL,
+                                          0.0, 0.0, 0.0, 1.0);
+
+        ply_trace ("Creating %ldx%ld offscreen head (scale %d, rotation %d)",
+                   head->area.width, head->area.height, scale, rotation);
+
+        ply_list_append_data (backend->heads, head);
+
+        return head;
+}
+
+static void
+ply_renderer_head_free (ply_renderer_head_t *head)
+{
+        ply_pixel_buffer_free (head->pixel_buffer);
+        free (head->frame);
+        free (head);
+}
+
+static bool
+add_head_from_string (ply_renderer_backend_t *backend,
+                      const char             *string)
+{
+        ply_pixel_buffer_rotation_t rotation = PLY_PIXEL_BUFFER_ROTATE_UPRIGHT;
+        unsigned long width, height;
+        int scale = 0;
+        char *end;
+
+        width = strtoul (string, &end, 10);
+        if (*end != 'x')
+                return false;
+
+        height = strtoul (end + 1, &end, 10);
+
+        if (*end == '@')
+                scale = strtol (end + 1, &end, 10);
+
+        if (*end == ':') {
+                if (!parse_rotation (end + 1, &rotation))
+                        return false;
+        }
+
+        if (width == 0 || height == 0)
+                return false;
+
+        if (scale <= 0)
+                scale = ply_guess_device_scale (width, height);
+
+        ply_renderer_head_new (backend, width, height, scale, rotation);
+
+        return true;
+}
+
+static ply_renderer_backend_t *
+create_backend (const char     *device_name,
+                ply_terminal_t *terminal)
+{
+        ply_renderer_backend_t *backend;
+        char *dump_format;
+
+        backend = calloc (1, sizeof(ply_renderer_backend_t));
+
+        backend->loop = ply_event_loop_get_default ();
+        backend->heads = ply_list_new ();
+        backend->input_source.key_buffer = ply_buffer_new ();
+        backend->flush_pool = ply_flush_pool_get_default ();
+
+        backend->dump_directory = ply_kernel_command_line_get_key_value ("plymouth.offscreen-dump=");
+        backend->dump_format = PLY_OFFSCREEN_DUMP_FORMAT_PNG;
+
+        dump_format = ply_kernel_command_line_get_key_value ("plymouth.offscreen-dump-format=");
+        if (dump_format != NULL && strcmp (dump_format, "raw") == 0)
+                backend->dump_format = PLY_OFFSCREEN_DUMP_FORMAT_RAW;
+        free (dump_format);
+
+        return backend;
+}
+
+static void
+destroy_backend (ply_renderer_backend_t *backend)
+{
+        ply_list_node_t *node;
+
+        node = ply_list_get_first_node (backend->heads);
+        while (node != NULL) {
+                ply_renderer_head_t *head;
+
+                head = (ply_renderer_head_t *) ply_list_node_get_data (node);
+                ply_renderer_head_free (head);
+                node = ply_list_get_next_node (backend->heads, node);
+        }
+
+        ply_list_free (backend->heads);
+        ply_buffer_free (backend->input_source.key_buffer);
+        free (backend->dump_directory);
+        free (backend);
+}
+
+static bool
+open_device (ply_renderer_backend_t *backend)
+{
+        if (backend->dump_directory != NULL &&
+            mkdir (backend->dump_directory, 0755) < 0 && errno != EEXIST) {
+                ply_trace ("could not create dump directory %s: %m",
+                           backend->dump_directory);
+                free (backend->dump_directory);
+                backend->dump_directory = NULL;
+        }
+
+        return true;
+}
+
+static const char *
+get_device_name (ply_renderer_backend_t *backend)
+{
+        return "offscreen";
+}
+
+static void
+close_device (ply_renderer_backend_t *backend)
+{
+        if (backend->number_of_flushes == 0)
+                return;
+
+        ply_trace ("offscreen renderer flushed %lu times: %lu rectangles, "
+                   "%llu bytes, %.3f ms total, %.3f ms per flush",
+                   backend->number_of_flushes,
+                   backend->number_of_rectangles,
+                   backend->number_of_bytes,
+                   backend->flush_time * 1000.0,
+                   backend->flush_time * 1000.0 / backend->number_of_flushes);
+}
+
+static bool
+query_device (ply_renderer_backend_t *backend)
+{
+        char *heads_string, *head_string, *save_pointer = NULL;
+
+        assert (backend != NULL);
+
+        if (ply_list_get_first_node (backend->heads) != NULL)
+                return true;
+
+        heads_string = ply_kernel_command_line_get_key_value ("plymouth.offscreen-heads=");
+        if (heads_string == NULL)
+                heads_string = strdup (DEFAULT_HEADS);
+
+        for (head_string = strtok_r (heads_string, ",", &save_pointer);
+             head_string != NULL;
+             head_string = strtok_r (NULL, ",", &save_pointer)) {
+                if (!add_head_from_string (backend, head_string))
+                        ply_trace ("ignoring malformed offscreen head '%s'", head_string);
+        }
+
+        free (heads_string);
+
+        return ply_list_get_first_node (backend->heads) != NULL;
+}
+
+static bool
+map_to_device (ply_renderer_backend_t *backend)
+{
+        ply_list_node_t *node;
+
+        node = ply_list_get_first_node (backend->heads);
+        while (node != NULL) {
+                ply_renderer_head_t *head;
+
+                head = (ply_renderer_head_t *) ply_list_node_get_data (node);
+
+                if (head->frame == NULL) {
+                        head->row_stride = head->area.width * BYTES_PER_PIXEL;
+                        head->row_stride = (head->row_stride + ROW_STRIDE_ALIGNMENT - 1) & ~(ROW_STRIDE_ALIGNMENT - 1);
+                        head->frame = calloc (head->area.height, head->row_stride);
+                }
+
+                node = ply_list_get_next_node (backend->heads, node);
+        }
+
+        backend->is_active = true;
+
+        return true;
+}
+
+static void
+unmap_from_device (ply_renderer_backend_t *backend)
+{
+        ply_list_node_t *node;
+
+        node = ply_list_get_first_node (backend->heads);
+        while (node != NULL) {
+                ply_renderer_head_t *head;
+
+                head = (ply_renderer_head_t *) ply_list_node_get_data (node);
+                free (head->frame);
+                head->frame = NULL;
+
+                node = ply_list_get_next_node (backend->heads, node);
+        }
+}
+
+static void
+activate (ply_renderer_backend_t *backend)
+{
+        backend->is_active = true;
+}
+
+static void
+deactivate (ply_renderer_backend_t *backend)
+{
+        backend->is_active = false;
+}
+
+static void
+dump_head_as_raw (ply_renderer_head_t *head,
+                  FILE                *fp)
+{
+        unsigned long y;
+
+        for (y = 0; y < head->area.height; y++) {
+                fwrite (head->frame + y * head->row_stride,
+                        BYTES_PER_PIXEL, head->area.width, fp);
+        }
+}
+
+static bool
+dump_head_as_png (ply_renderer_head_t *head,
+                  FILE                *fp)
+{
+        png_struct *png;
+        png_info *info;
+        unsigned long y;
+
+        png = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        if (png == NULL)
+                return false;
+
+        info = png_create_info_struct (png);
+        if (info == NULL) {
+                png_destroy_write_struct (&png, NULL);
+                return false;
+        }
+
+        if (setjmp (png_jmpbuf (png)) != 0) {
+                png_destroy_write_struct (&png, &info);
+                return false;
+        }
+
+        png_init_io (png, fp);
+        png_set_IHDR (png, info, head->area.width, head->area.height, 8,
+                      PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                      PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        /* Keep the output fast, these are written every frame */
+        png_set_compression_level (png, 1);
+        png_write_info (png, info);
+
+        /* Pixels are 0xAARRGGBB in native (little) endian order */
+        png_set_bgr (png);
+        png_set_filler (png, 0, PNG_FILLER_AFTER);
+
+        for (y = 0; y < head->area.height; y++) {
+                png_write_row (png, (png_byte *) head->frame + y * head->row_stride);
+        }
+
+        png_write_end (png, info);
+        png_destroy_write_struct (&png, &info);
+
+        return true;
+}
+
+static void
+dump_head (ply_renderer_backend_t *backend,
+           ply_renderer_head_t    *head)
+{
+        char *filename;
+        FILE *fp;
+
+        asprintf (&filename, "%s/head%d-%06lu.%s",
+                  backend->dump_directory, head->index, head->frame_count,
+                  backend->dump_format == PLY_OFFSCREEN_DUMP_FORMAT_RAW ? "raw" : "png");
+
+        fp = fopen (filename, "we");
+        if (fp == NULL) {
+                ply_trace ("could not open %s: %m", filename);
+                free (filename);
+                return;
+        }
+
+        if (backend->dump_format == PLY_OFFSCREEN_DUMP_FORMAT_RAW)
+                dump_head_as_raw (head, fp);
+        else if (!dump_head_as_png (head, fp))
+                ply_trace ("could not write %s", filename);
+
+        fclose (fp);
+        free (filename);
+}
+
+static void
+flush_head (ply_renderer_backend_t *backend,
+            ply_renderer_head_t    *head)
+{
+        ply_region_t *updated_region;
+        ply_list_t *areas_to_flush;
+        ply_list_node_t *node;
+        uint32_t *shadow_buffer;
+        unsigned long number_of_rectangles = 0, number_of_bytes = 0;
+        double start_time, flush_time;
+
+        assert (backend != NULL);
+
+        if (!backend->is_active || head->frame == NULL)
+                return;
+
+        start_time = ply_get_timestamp ();
+
+        updated_region = ply_pixel_buffer_get_updated_areas (head->pixel_buffer);
+        areas_to_flush = ply_region_get_sorted_rectangle_list (updated_region);
+        shadow_buffer = ply_pixel_buffer_get_argb32_data (head->pixel_buffer);
+
+        node = ply_list_get_first_node (areas_to_flush);
+        while (node != NULL) {
+                ply_rectangle_t *area_to_flush;
+                const char *src;
+                char *dst;
+                unsigned long y;
+
+                area_to_flush = (ply_rectangle_t *) ply_list_node_get_data (node);
+
+                dst = &head->frame[area_to_flush->y * head->row_stride + area_to_flush->x * BYTES_PER_PIXEL];
+                src = (const char *) &shadow_buffer[area_to_flush->y * head->area.width + area_to_flush->x];
+
+                if (backend->flush_pool != NULL) {
+                        ply_flush_pool_queue_copy (backend->flush_pool,
+                                                   &backend->flush_batch,
+                                                   dst, head->row_stride,
+                                                   src, head->area.width * BYTES_PER_PIXEL,
+                                                   area_to_flush->width * BYTES_PER_PIXEL,
+                                                   area_to_flush->height);
+                } else {
+                        for (y = 0; y < area_to_flush->height; y++) {
+                                memcpy (dst, src, area_to_flush->width * BYTES_PER_PIXEL);
+                                dst += head->row_stride;
+                                src += head->area.width * BYTES_PER_PIXEL;
+                        }
+                }
+
+                number_of_rectangles++;
+                number_of_bytes += area_to_flush->width * area_to_flush->height * BYTES_PER_PIXEL;
+
+                node = ply_list_get_next_node (areas_to_flush, node);
+        }
+
+        if (backend->flush_pool != NULL)
+                ply_flush_pool_wait (backend->flush_pool, &backend->flush_batch);
+
+        ply_region_clear (updated_region);
+
+        if (number_of_rectangles == 0)
+                return;
+
+        flush_time = ply_get_timestamp () - start_time;
+
+        backend->number_of_flushes++;
+        backend->number_of_rectangles += number_of_rectangles;
+        backend->number_of_bytes += number_of_bytes;
+        backend->flush_time += flush_time;
+
+        ply_trace ("flushed %lu rectangles (%lu bytes) to offscreen head %d in %.3f ms",
+                   number_of_rectangles, number_of_bytes, head->index, flush_time * 1000.0);
+
+        if (backend->dump_directory != NULL)
+                dump_head (backend, head);
+
+        head->frame_count++;
+
+        ply_renderer_note_flushed_frame (get_device_name (backend));
+}
+
+static ply_list_t *
+get_heads (ply_renderer_backend_t *backend)
+{
+        return backend->heads;
+}
+
+static ply_pixel_buffer_t *
+get_buffer_for_head (ply_renderer_backend_t *backend,
+                     ply_renderer_head_t    *head)
+{
+        if (head->backend != backend)
+                return NULL;
+
+        return head->pixel_buffer;
+}
+
+static bool
+has_input_source (ply_renderer_backend_t      *backend,
+                  ply_renderer_input_source_t *input_source)
+{
+        return input_source == &backend->input_source;
+}
+
+static ply_renderer_input_source_t *
+get_input_source (ply_renderer_backend_t *backend)
+{
+        return &backend->input_source;
+}
+
+static bool
+open_input_source (ply_renderer_backend_t      *backend,
+                   ply_renderer_input_source_t *input_source)
+{
+        assert (backend != NULL);
+        assert (has_input_source (backend, input_source));
+
+        return true;
+}
+
+static void
+set_handler_for_input_source (ply_renderer_backend_t             *backend,
+                              ply_renderer_input_source_t        *input_source,
+                              ply_renderer_input_source_handler_t handler,
+                              void                               *user_data)
+{
+        assert (backend != NULL);
+        assert (has_input_source (backend, input_source));
+
+        input_source->handler = handler;
+        input_source->user_data = user_data;
+}
+
+static void
+close_input_source (ply_renderer_backend_t      *backend,
+                    ply_renderer_input_source_t *input_source)
+{
+        assert (backend != NULL);
+        assert (has_input_source (backend, input_source));
+}
+
+static bool
+get_panel_properties (ply_renderer_backend_t      *backend,
+                      int                         *width,
+                      int                         *height,
+                      ply_pixel_buffer_rotation_t *rotation,
+                      int                         *scale)
+{
+        ply_renderer_head_t *head;
+        ply_list_node_t *node;
+
+        node = ply_list_get_first_node (backend->heads);
+        if (node == NULL)
+                return false;
+
+        head = (ply_renderer_head_t *) ply_list_node_get_data (node);
+
+        *width = head->area.width;
+        *height = head->area.height;
+        *rotation = head->rotation;
+        *scale = head->scale;
+
+        return true;
+}
+
+ply_renderer_plugin_interface_t *
+ply_renderer_backend_get_interface (void)
+{
+        static ply_renderer_plugin_interface_t plugin_interface =
+        {
+                .create_backend               = create_backend,
+                .destroy_backend              = destroy_backend,
+                .open_device                  = open_device,
+                .close_device                 = close_device,
+                .query_device                 = query_device,
+                .map_to_device                = map_to_device,
+                .unmap_from_device            = unmap_from_device,
+                .activate                     = activate,
+                .deactivate                   = deactivate,
+                .flush_head                   = flush_head,
+                .get_heads                    = get_heads,
+                .get_buffer_for_head          = get_buffer_for_head,
+                .get_input_source             = get_input_source,
+                .open_input_source            = open_input_source,
+                .set_handler_for_input_source = set_handler_for_input_source,
+                .close_input_source           = close_input_source,
+                .get_device_name              = get_device_name,
+                .get_panel_properties         = get_panel_properties,
+        };
+
+        return &plugin_interface;
+}
@@ -459,6 +459,8 @@ flush_head (ply_renderer_backend_t *backend,
                 node = next_node;
         }
         ply_region_clear (updated_region);
+
+        ply_renderer_note_flushed_frame (get_device_name (backend));
 }
 
 static ply_list_t *
@@ -534,10 +534,11 @@ on_timeout (ply_boot_splash_plugin_t *plugin)
         sleep_time = MAX (sleep_time - (ply_get_timestamp () - plugin->now),
                           0.005);
 
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          sleep_time,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
+        ply_event_loop_watch_for_timeout_with_slack (plugin->loop,
+                                                     sleep_time,
+                                                     PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     on_timeout, plugin);
 }
 
 static void
@@ -584,10 +585,11 @@ start_animation (ply_boot_splash_plugin_t *plugin)
             plugin->mode == PLY_BOOT_SPLASH_MODE_REBOOT)
                 return;
 
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          1.0 / FRAMES_PER_SECOND,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
+        ply_event_loop_watch_for_timeout_with_slack (plugin->loop,
+                                                     1.0 / FRAMES_PER_SECOND,
+                                                     PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     on_timeout, plugin);
 }
 
 static void
@@ -221,10 +221,11 @@ on_timeout (ply_boot_splash_plugin_t *plugin)
         double sleep_time;
 
         sleep_time = 1.0 / plugin->script_plymouth_lib->refresh_rate;
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          sleep_time,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
+        ply_event_loop_watch_for_timeout_with_slack (plugin->loop,
+                                                     sleep_time,
+                                                     PLY_EVENT_LOOP_FRAME_SLACK (plugin->script_plymouth_lib->refresh_rate),
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     on_timeout, plugin);
 
         script_lib_plymouth_on_refresh (plugin->script_state,
                                         plugin->script_plymouth_lib);
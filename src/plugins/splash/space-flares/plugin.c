@@ -1162,10 +1162,11 @@ on_timeout (ply_boot_splash_plugin_t *plugin)
 
         sleep_time = 1.0 / FRAMES_PER_SECOND;
 
-        ply_event_loop_watch_for_timeout (plugin->loop,
-                                          sleep_time,
-                                          (ply_event_loop_timeout_handler_t)
-                                          on_timeout, plugin);
+        ply_event_loop_watch_for_timeout_with_slack (plugin->loop,
+                                                     sleep_time,
+                                                     PLY_EVENT_LOOP_FRAME_SLACK (FRAMES_PER_SECOND),
+                                                     (ply_event_loop_timeout_handler_t)
+                                                     on_timeout, plugin);
 }
 
 static void
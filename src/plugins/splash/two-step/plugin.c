@@ -113,6 +113,7 @@ typedef struct
         ply_trigger_t            *end_trigger;
         ply_pixel_buffer_t       *background_buffer;
         int                       animation_bottom;
+        uint32_t                  background_is_on_screen : 1;
 } view_t;
 
 typedef struct
@@ -191,6 +192,8 @@ struct _ply_boot_splash_plugin
         uint32_t                            use_firmware_background : 1;
         uint32_t                            dialog_clears_firmware_background : 1;
         uint32_t                            message_below_animation : 1;
+        uint32_t                            images_are_loaded : 1;
+        uint32_t                            background_bgrt_image_is_loaded : 1;
 };
 
 ply_boot_splash_plugin_interface_t *ply_boot_splash_plugin_get_interface (void);
@@ -392,6 +395,65 @@ out:
         return ret;
 }
 
+static bool
+load_bgrt_image (ply_boot_splash_plugin_t *plugin)
+{
+        if (plugin->background_bgrt_image == NULL)
+                return false;
+
+        if (plugin->background_bgrt_image_is_loaded)
+                return true;
+
+        ply_trace ("loading background bgrt image");
+        if (!ply_image_load (plugin->background_bgrt_image)) {
+                ply_image_free (plugin->background_bgrt_image);
+                plugin->background_bgrt_image = NULL;
+                return false;
+        }
+
+        plugin->background_bgrt_raw_width = ply_image_get_width (plugin->background_bgrt_image);
+        plugin->background_bgrt_raw_height = ply_image_get_height (plugin->background_bgrt_image);
+        plugin->background_bgrt_image_is_loaded = true;
+
+        return true;
+}
+
+/* If the renderer picked up the frame buffer the firmware left on screen,
+ * the display already shows the firmware's boot logo exactly where the
+ * firmware put it, so keep that instead of decoding the BGRT image and
+ * placing it again ourselves.
+ */
+static bool
+view_set_firmware_background (view_t *view)
+{
+        ply_renderer_t *renderer;
+        ply_renderer_head_t *head;
+        ply_pixel_buffer_t *buffer;
+        int screen_width, screen_height, screen_scale;
+
+        renderer = ply_pixel_display_get_renderer (view->display);
+        head = ply_pixel_display_get_renderer_head (view->display);
+
+        if (renderer == NULL || head == NULL ||
+            !ply_renderer_head_shows_firmware_image (renderer, head))
+                return false;
+
+        screen_width = ply_pixel_display_get_width (view->display);
+        screen_height = ply_pixel_display_get_height (view->display);
+        screen_scale = ply_pixel_display_get_device_scale (view->display);
+
+        ply_trace ("using firmware image already on %dx%d screen as background",
+                   screen_width, screen_height);
+
+        buffer = ply_renderer_get_buffer_for_head (renderer, head);
+        view->background_buffer = ply_pixel_buffer_new (screen_width * screen_scale, screen_height * screen_scale);
+        ply_pixel_buffer_set_device_scale (view->background_buffer, screen_scale);
+        ply_pixel_buffer_fill_with_buffer (view->background_buffer, buffer, 0, 0);
+        view->background_is_on_screen = true;
+
+        return true;
+}
+
 /* The Microsoft boot logo spec says that the logo must use a black background
  * and have its center at 38.2% from the screen's top (golden ratio).
  * We reproduce this exactly here so that we get a background which is an exact
@@ -423,6 +485,12 @@ view_set_bgrt_background (view_t *view)
                 return;
         }
 
+        if (view_set_firmware_background (view))
+                return;
+
+        if (!load_bgrt_image (view->plugin))
+                return;
+
         screen_width = ply_pixel_display_get_width (view->display);
         screen_height = ply_pixel_display_get_height (view->display);
         screen_scale = ply_pixel_display_get_device_scale (view->display);
@@ -635,6 +703,17 @@ view_load (view_t *view)
                 ply_pixel_buffer_free (buffer);
         }
 
+        /* The gradient never changes, so render it once and copy it on redraws */
+        if (!view->background_buffer && plugin->background_start_color != plugin->background_end_color) {
+                ply_trace ("pre-rendering background gradient for %lux%lu", screen_width, screen_height);
+
+                view->background_buffer = ply_pixel_buffer_new (screen_width * screen_scale, screen_height * screen_scale);
+                ply_pixel_buffer_set_device_scale (view->background_buffer, screen_scale);
+                ply_pixel_buffer_fill_with_gradient (view->background_buffer, NULL,
+                                                     plugin->background_start_color,
+                                                     plugin->background_end_color);
+        }
+
         if (plugin->watermark_image != NULL) {
                 view->watermark_area.width = ply_image_get_width (plugin->watermark_image);
                 view->watermark_area.height = ply_image_get_height (plugin->watermark_image);
@@ -1497,8 +1576,11 @@ draw_background (view_t             *view,
             using_fw_background && plugin->dialog_clears_firmware_background)
                 use_black_background = true;
 
+        /* The first draw over the firmware's image only adds to it */
         if (use_black_background)
                 ply_pixel_buffer_fill_with_hex_color (pixel_buffer, &area, 0);
+        else if (view->background_is_on_screen)
+                ply_trace ("leaving firmware image on screen as background");
         else if (view->background_buffer != NULL)
                 ply_pixel_buffer_fill_with_buffer (pixel_buffer, view->background_buffer, 0, 0);
         else if (plugin->background_start_color != plugin->background_end_color)
@@ -1508,6 +1590,7 @@ draw_background (view_t             *view,
         else
                 ply_pixel_buffer_fill_with_hex_color (pixel_buffer, &area,
                                                       plugin->background_start_color);
+        view->background_is_on_screen = false;
 
         if (plugin->watermark_image != NULL) {
                 uint32_t *data;
@@ -1684,16 +1767,14 @@ remove_pixel_display (ply_boot_splash_plugin_t *plugin,
         }
 }
 
+/* Also the load_assets hook, so this must not touch the loop or views */
 static bool
-show_splash_screen (ply_boot_splash_plugin_t *plugin,
-                    ply_event_loop_t         *loop,
-                    ply_buffer_t             *boot_buffer,
-                    ply_boot_splash_mode_t    mode)
+load_images (ply_boot_splash_plugin_t *plugin)
 {
         assert (plugin != NULL);
 
-        plugin->loop = loop;
-        plugin->mode = mode;
+        if (plugin->images_are_loaded)
+                return true;
 
         ply_trace ("loading lock image");
         if (!ply_image_load (plugin->lock_image))
@@ -1734,16 +1815,9 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
                 }
         }
 
-        if (plugin->background_bgrt_image != NULL) {
-                ply_trace ("loading background bgrt image");
-                if (ply_image_load (plugin->background_bgrt_image)) {
-                        plugin->background_bgrt_raw_width = ply_image_get_width (plugin->background_bgrt_image);
-                        plugin->background_bgrt_raw_height = ply_image_get_height (plugin->background_bgrt_image);
-                } else {
-                        ply_image_free (plugin->background_bgrt_image);
-                        plugin->background_bgrt_image = NULL;
-                }
-        }
+        /* The BGRT image gets loaded by the first view that can't use
+         * the firmware's image straight off the screen
+         */
 
         if (plugin->background_bgrt_fallback_image != NULL) {
                 ply_trace ("loading background bgrt fallback image");
@@ -1769,6 +1843,25 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
                 }
         }
 
+        plugin->images_are_loaded = true;
+
+        return true;
+}
+
+static bool
+show_splash_screen (ply_boot_splash_plugin_t *plugin,
+                    ply_event_loop_t         *loop,
+                    ply_buffer_t             *boot_buffer,
+                    ply_boot_splash_mode_t    mode)
+{
+        assert (plugin != NULL);
+
+        plugin->loop = loop;
+        plugin->mode = mode;
+
+        if (!load_images (plugin))
+                return false;
+
         if (!load_views (plugin)) {
                 ply_trace ("couldn't load views");
                 return false;
@@ -2085,6 +2178,7 @@ ply_boot_splash_plugin_get_interface (void)
                 .destroy_plugin       = destroy_plugin,
                 .add_pixel_display    = add_pixel_display,
                 .remove_pixel_display = remove_pixel_display,
+                .load_assets          = load_images,
                 .show_splash_screen   = show_splash_screen,
                 .update_status        = update_status,
                 .on_boot_progress     = on_boot_progress,
@@ -24,6 +24,12 @@
 
 #define PLY_BOOT_PROTOCOL_TRIMMED_ABSTRACT_SOCKET_PATH "/org/freedesktop/plymouthd"
 #define PLY_BOOT_PROTOCOL_OLD_ABSTRACT_SOCKET_PATH "/ply-boot-protocol"
+
+/* Datagram socket that takes one-way update and system-update requests,
+ * one request per datagram in either framing, and never replies
+ */
+#define PLY_BOOT_PROTOCOL_TRIMMED_ABSTRACT_UPDATE_SOCKET_PATH "/org/freedesktop/plymouthd/updates"
+#define PLY_BOOT_PROTOCOL_MAX_UPDATE_DATAGRAM_SIZE 1024
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_PING "P"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE "U"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_CHANGE_MODE "C"
@@ -47,6 +53,22 @@
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEWROOT "R"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_HAS_ACTIVE_VT "V"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_ERROR "!"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_GET_STATS "T"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_GET_STARTUP_TRACE "t"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEGOTIATE "N"
+
+/* Requests are a command byte followed by either a NUL, or an argument
+ * marker and the argument.  The original marker is followed by a one
+ * byte argument size.  The extended marker, understood by daemons that
+ * answer the negotiate request with version 2 or later, is followed by a
+ * uint32 request id and a uint32 argument size, and every reply to such
+ * a request is prefixed with its uint32 request id.  Sizes count the
+ * argument's NUL terminator, and integers are little endian.
+ */
+#define PLY_BOOT_PROTOCOL_VERSION "2"
+#define PLY_BOOT_PROTOCOL_ARGUMENT_MARKER '\002'
+#define PLY_BOOT_PROTOCOL_EXTENDED_ARGUMENT_MARKER '\003'
+#define PLY_BOOT_PROTOCOL_MAX_ARGUMENT_SIZE (64 * 1024)
 
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK "\x6"
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK "\x15"
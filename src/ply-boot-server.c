@@ -36,9 +36,22 @@
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-phase-tracer.h"
 #include "ply-trigger.h"
 #include "ply-utils.h"
 
+/* How much pipelined request data gets read, and how many replies get
+ * buffered, before they are processed or written out
+ */
+#define MAX_REQUEST_BYTES_PER_WAKEUP (256 * 1024)
+#define MAX_UNFLUSHED_REPLY_BYTES (64 * 1024)
+
+/* Update datagrams are pulled off the socket this many at a time, up to
+ * a limit per wakeup so a flood of updates can't starve the event loop
+ */
+#define UPDATE_DATAGRAMS_PER_READ 16
+#define MAX_UPDATE_DATAGRAMS_PER_WAKEUP 256
+
 typedef struct
 {
         int                fd;
@@ -47,18 +60,33 @@ typedef struct
         uid_t              uid;
         pid_t              pid;
 
+        ply_buffer_t      *requests;
+        ply_buffer_t      *replies;
+
         int                reference_count;
 
         uint32_t           credentials_read : 1;
         uint32_t           disconnected : 1;
+        uint32_t           is_batching_replies : 1;
 } ply_boot_connection_t;
 
+/* Identifies the request a reply belongs to.  Requests in the extended
+ * framing carry an id that has to be echoed back in front of the reply
+ */
+typedef struct
+{
+        ply_boot_connection_t *connection;
+        uint32_t               id;
+        uint32_t               is_extended : 1;
+} ply_boot_reply_t;
+
 struct _ply_boot_server
 {
         ply_event_loop_t                             *loop;
         ply_list_t                                   *connections;
         ply_list_t                                   *cached_passwords;
         int                                           socket_fd;
+        int                                           update_socket_fd;
 
         ply_boot_server_update_handler_t              update_handler;
         ply_boot_server_change_mode_handler_t         change_mode_handler;
@@ -81,6 +109,7 @@ struct _ply_boot_server
         ply_boot_server_quit_handler_t                quit_handler;
         ply_boot_server_has_active_vt_handler_t       has_active_vt_handler;
         ply_boot_server_reload_handler_t              reload_handler;
+        ply_boot_server_get_stats_handler_t           get_stats_handler;
         void                                         *user_data;
 
         uint32_t                                      is_listening : 1;
@@ -108,6 +137,7 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
                      ply_boot_server_quit_handler_t                quit_handler,
                      ply_boot_server_has_active_vt_handler_t       has_active_vt_handler,
                      ply_boot_server_reload_handler_t              reload_handler,
+                     ply_boot_server_get_stats_handler_t           get_stats_handler,
                      void                                         *user_data)
 {
         ply_boot_server_t *server;
@@ -116,6 +146,7 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
         server->connections = ply_list_new ();
         server->cached_passwords = ply_list_new ();
         server->loop = NULL;
+        server->update_socket_fd = -1;
         server->is_listening = false;
         server->update_handler = update_handler;
         server->change_mode_handler = change_mode_handler;
@@ -138,6 +169,7 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
         server->quit_handler = quit_handler;
         server->has_active_vt_handler = has_active_vt_handler;
         server->reload_handler = reload_handler;
+        server->get_stats_handler = get_stats_handler;
         server->user_data = user_data;
 
         return server;
@@ -171,6 +203,8 @@ ply_boot_connection_new (ply_boot_server_t *server,
         connection->fd = fd;
         connection->server = server;
         connection->watch = NULL;
+        connection->requests = ply_buffer_new ();
+        connection->replies = ply_buffer_new ();
         connection->reference_count = 1;
 
         return connection;
@@ -183,6 +217,8 @@ ply_boot_connection_free (ply_boot_connection_t *connection)
                 return;
 
         close (connection->fd);
+        ply_buffer_free (connection->requests);
+        ply_buffer_free (connection->replies);
         free (connection);
 }
 
@@ -218,6 +254,15 @@ ply_boot_server_listen (ply_boot_server_t *server)
         if (server->socket_fd < 0)
                 return false;
 
+        /* Updates can still go through the main socket if this fails
+         */
+        server->update_socket_fd =
+                ply_listen_to_unix_datagram_socket (PLY_BOOT_PROTOCOL_TRIMMED_ABSTRACT_UPDATE_SOCKET_PATH,
+                                                    PLY_UNIX_SOCKET_TYPE_TRIMMED_ABSTRACT);
+
+        if (server->update_socket_fd < 0)
+                ply_trace ("could not listen for update datagrams: %m");
+
         return true;
 }
 
@@ -227,46 +272,106 @@ ply_boot_server_stop_listening (ply_boot_server_t *server)
         assert (server != NULL);
 }
 
-static bool
-ply_boot_connection_read_request (ply_boot_connection_t *connection,
-                                  char                 **command,
-                                  char                 **argument)
+static uint32_t
+read_uint32 (const uint8_t *bytes)
 {
-        uint8_t header[2];
+        return (bytes[0] << 0) |
+               (bytes[1] << 8) |
+               (bytes[2] << 16) |
+               ((uint32_t) bytes[3] << 24);
+}
 
-        assert (connection != NULL);
-        assert (connection->fd >= 0);
+static void
+append_uint32 (ply_buffer_t *buffer,
+               uint32_t      value)
+{
+        uint8_t bytes[4];
 
-        connection->credentials_read = false;
+        bytes[0] = (value >> 0) & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = (value >> 16) & 0xFF;
+        bytes[3] = (value >> 24) & 0xFF;
 
-        if (!ply_read (connection->fd, header, sizeof(header)))
-                return false;
+        ply_buffer_append_bytes (buffer, bytes, sizeof(bytes));
+}
+
+/* Parses one request out of the start of bytes.  Returns the size of the
+ * request, 0 if it hasn't been received completely yet, or -1 if the
+ * request is malformed.
+ */
+static ssize_t
+ply_boot_server_parse_request (const uint8_t    *bytes,
+                               size_t            size,
+                               ply_boot_reply_t *reply,
+                               char            **command,
+                               char            **argument)
+{
+        size_t header_size;
+        size_t argument_size;
+        bool has_argument;
+
+        if (size < 2)
+                return 0;
+
+        reply->connection = NULL;
+        reply->id = 0;
+        reply->is_extended = false;
+
+        if (bytes[1] == PLY_BOOT_PROTOCOL_EXTENDED_ARGUMENT_MARKER) {
+                header_size = 10;
+                if (size < header_size)
+                        return 0;
+
+                reply->id = read_uint32 (bytes + 2);
+                reply->is_extended = true;
+                argument_size = read_uint32 (bytes + 6);
+
+                if (argument_size > PLY_BOOT_PROTOCOL_MAX_ARGUMENT_SIZE)
+                        return -1;
+
+                has_argument = argument_size > 0;
+        } else if (bytes[1] == PLY_BOOT_PROTOCOL_ARGUMENT_MARKER) {
+                header_size = 3;
+                if (size < header_size)
+                        return 0;
+
+                argument_size = bytes[2];
+                has_argument = true;
+        } else {
+                header_size = 2;
+                argument_size = 0;
+                has_argument = false;
+        }
+
+        if (size < header_size + argument_size)
+                return 0;
 
         *command = calloc (2, sizeof(char));
-        *command[0] = header[0];
+        (*command)[0] = bytes[0];
 
         *argument = NULL;
-        if (header[1] == '\002') {
-                uint8_t argument_size;
+        if (has_argument) {
+                *argument = calloc (argument_size + 1, sizeof(char));
+                memcpy (*argument, bytes + header_size, argument_size);
+        }
 
-                if (!ply_read (connection->fd, &argument_size, sizeof(uint8_t))) {
-                        free (*command);
-                        return false;
-                }
+        return header_size + argument_size;
+}
 
-                *argument = calloc (argument_size, sizeof(char));
+static bool
+ply_boot_connection_read_credentials (ply_boot_connection_t *connection)
+{
+        assert (connection != NULL);
+        assert (connection->fd >= 0);
 
-                if (!ply_read (connection->fd, *argument, argument_size)) {
-                        free (*argument);
-                        free (*command);
-                        return false;
-                }
-        }
+        /* The peer credentials are those of the process that connected,
+         * so they only need to be fetched once
+         */
+        if (connection->credentials_read)
+                return true;
 
         if (!ply_get_credentials_from_fd (connection->fd, &connection->pid, &connection->uid, NULL)) {
                 ply_trace ("couldn't read credentials from connection: %m");
-                free (*argument);
-                free (*command);
                 return false;
         }
         connection->credentials_read = true;
@@ -286,98 +391,158 @@ ply_boot_connection_is_from_root (ply_boot_connection_t *connection)
 }
 
 static void
-ply_boot_connection_send_answer (ply_boot_connection_t *connection,
-                                 const char            *answer)
+ply_boot_connection_flush_replies (ply_boot_connection_t *connection)
+{
+        size_t size;
+
+        size = ply_buffer_get_size (connection->replies);
+
+        if (size == 0)
+                return;
+
+        if (!connection->disconnected) {
+                if (!ply_write (connection->fd,
+                                ply_buffer_get_bytes (connection->replies),
+                                size) &&
+                    errno != EPIPE)
+                        ply_trace ("could not finish writing replies: %m");
+        }
+
+        ply_buffer_clear (connection->replies);
+}
+
+/* Queues a reply of the given type, followed by a size and the payload
+ * if payload_size isn't negative.  Replies are held back while a batch
+ * of pipelined requests is processed, so they go out in one write.
+ */
+static void
+ply_boot_reply_send_bytes (const ply_boot_reply_t *reply,
+                           const char             *response_type,
+                           const void             *payload,
+                           ssize_t                 payload_size)
+{
+        ply_boot_connection_t *connection = reply->connection;
+
+        if (connection->disconnected)
+                return;
+
+        if (reply->is_extended)
+                append_uint32 (connection->replies, reply->id);
+
+        ply_buffer_append_bytes (connection->replies,
+                                 response_type, strlen (response_type));
+
+        if (payload_size >= 0) {
+                append_uint32 (connection->replies, payload_size);
+                if (payload_size > 0)
+                        ply_buffer_append_bytes (connection->replies,
+                                                 payload, payload_size);
+        }
+
+        if (!connection->is_batching_replies ||
+            ply_buffer_get_size (connection->replies) >= MAX_UNFLUSHED_REPLY_BYTES)
+                ply_boot_connection_flush_replies (connection);
+}
+
+static void
+ply_boot_reply_send (const ply_boot_reply_t *reply,
+                     const char             *response_type)
 {
-        uint32_t size;
+        ply_boot_reply_send_bytes (reply, response_type, NULL, -1);
+}
 
+static void
+ply_boot_reply_send_answer (const ply_boot_reply_t *reply,
+                            const char             *answer)
+{
         /* splash plugin isn't able to ask for password,
          * punt to client
          */
-        if (answer == NULL) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER)))
-                        ply_trace ("could not finish writing no answer reply: %m");
-        } else {
-                size = strlen (answer);
+        if (answer == NULL)
+                ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER);
+        else
+                ply_boot_reply_send_bytes (reply,
+                                           PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER,
+                                           answer, strlen (answer));
+}
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER)) ||
-                    !ply_write_uint32 (connection->fd,
-                                       size) ||
-                    !ply_write (connection->fd,
-                                answer, size))
-                        ply_trace ("could not finish writing answer: %m");
-        }
+/* Keeps a copy of the reply around for requests that get answered later,
+ * holding a reference on the connection until then
+ */
+static ply_boot_reply_t *
+ply_boot_reply_defer (const ply_boot_reply_t *reply)
+{
+        ply_boot_reply_t *deferred_reply;
+
+        deferred_reply = calloc (1, sizeof(ply_boot_reply_t));
+        *deferred_reply = *reply;
+        ply_boot_connection_take_reference (reply->connection);
+
+        return deferred_reply;
+}
+
+static void
+ply_boot_reply_free (ply_boot_reply_t *reply)
+{
+        ply_boot_connection_drop_reference (reply->connection);
+        free (reply);
 }
 
 static void
-ply_boot_connection_on_password_answer (ply_boot_connection_t *connection,
-                                        const char            *password)
+ply_boot_connection_on_password_answer (ply_boot_reply_t *reply,
+                                        const char       *password)
 {
         ply_trace ("got password answer");
 
-        if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, password);
+        ply_boot_reply_send_answer (reply, password);
 
         if (password != NULL)
-                ply_list_append_data (connection->server->cached_passwords,
+                ply_list_append_data (reply->connection->server->cached_passwords,
                                       strdup (password));
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_reply_free (reply);
 }
 
 static void
-ply_boot_connection_on_deactivated (ply_boot_connection_t *connection)
+ply_boot_connection_on_deactivated (ply_boot_reply_t *reply)
 {
         ply_trace ("deactivated");
 
-        if (!connection->disconnected) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                        ply_trace ("could not finish writing deactivate reply: %m");
-        }
+        ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK);
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_reply_free (reply);
 }
 
 static void
-ply_boot_connection_on_quit_complete (ply_boot_connection_t *connection)
+ply_boot_connection_on_quit_complete (ply_boot_reply_t *reply)
 {
         ply_trace ("quit complete");
-        if (!connection->disconnected) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                        ply_trace ("could not finish writing quit reply: %m");
-        }
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK);
+
+        ply_boot_reply_free (reply);
 }
 
 static void
-ply_boot_connection_on_question_answer (ply_boot_connection_t *connection,
-                                        const char            *answer)
+ply_boot_connection_on_question_answer (ply_boot_reply_t *reply,
+                                        const char       *answer)
 {
         ply_trace ("got question answer: %s", answer);
-        if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, answer);
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_reply_send_answer (reply, answer);
+
+        ply_boot_reply_free (reply);
 }
 
 static void
-ply_boot_connection_on_keystroke_answer (ply_boot_connection_t *connection,
-                                         const char            *key)
+ply_boot_connection_on_keystroke_answer (ply_boot_reply_t *reply,
+                                         const char       *key)
 {
         ply_trace ("got key: %s", key);
-        if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, key);
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_reply_send_answer (reply, key);
+
+        ply_boot_reply_free (reply);
 }
 
 static void
@@ -404,33 +569,50 @@ print_connection_process_identity (ply_boot_connection_t *connection)
 }
 
 static void
-ply_boot_connection_on_request (ply_boot_connection_t *connection)
+ply_boot_server_handle_update (ply_boot_server_t *server,
+                               const char        *status)
+{
+        ply_trace ("got update request");
+        if (server->update_handler != NULL)
+                server->update_handler (server->user_data, status, server);
+}
+
+static void
+ply_boot_server_handle_system_update (ply_boot_server_t *server,
+                                      const char        *argument)
+{
+        long int value;
+        char *endptr = NULL;
+
+        value = strtol (argument, &endptr, 10);
+        if (endptr == NULL || *endptr != '\0' || value < 0 || value > 100) {
+                ply_error ("failed to parse percentage %s", argument);
+                value = 0;
+        }
+
+        ply_trace ("got system-update notification %li%%", value);
+
+        if (server->system_update_handler != NULL)
+                server->system_update_handler (server->user_data, value, server);
+}
+
+static void
+ply_boot_connection_handle_request (ply_boot_connection_t  *connection,
+                                    const ply_boot_reply_t *reply,
+                                    char                   *command,
+                                    char                   *argument)
 {
         ply_boot_server_t *server;
-        char *command, *argument;
 
         assert (connection != NULL);
-        assert (connection->fd >= 0);
 
         server = connection->server;
         assert (server != NULL);
 
-        if (!ply_boot_connection_read_request (connection,
-                                               &command, &argument)) {
-                ply_trace ("could not read connection request");
-                return;
-        }
-
-        if (ply_is_tracing ())
-                print_connection_process_identity (connection);
-
         if (!ply_boot_connection_is_from_root (connection)) {
                 ply_error ("request came from non-root user");
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                        ply_trace ("could not finish writing is-not-root nak: %m");
+                ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK);
 
                 free (argument);
                 free (command);
@@ -438,23 +620,14 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
         }
 
         if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE) == 0) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)) &&
-                    errno != EPIPE)
-                        ply_trace ("could not finish writing update reply: %m");
+                ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK);
 
-                ply_trace ("got update request");
-                if (server->update_handler != NULL)
-                        server->update_handler (server->user_data, argument, server);
+                ply_boot_server_handle_update (server, argument);
                 free (argument);
                 free (command);
                 return;
         } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_CHANGE_MODE) == 0) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                        ply_trace ("could not finish writing update reply: %m");
+                ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK);
 
                 ply_trace ("got change mode notification");
                 if (server->change_mode_handler != NULL)
@@ -463,23 +636,9 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 free (command);
                 return;
         } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_UPDATE) == 0) {
-                long int value;
-                char *endptr = NULL;
-
-                value = strtol (argument, &endptr, 10);
-                if (endptr == NULL || *endptr != '\0' || value < 0 || value > 100) {
-                        ply_error ("failed to parse percentage %s", argument);
-                        value = 0;
-                }
+                ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK);
 
-                ply_trace ("got system-update notification %li%%", value);
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                        ply_trace ("could not finish writing update reply: %m");
-
-                if (server->system_update_handler != NULL)
-                        server->system_update_handler (server->user_data, value, server);
+                ply_boot_server_handle_system_update (server, argument);
                 free (argument);
                 free (command);
                 return;
@@ -509,8 +668,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (deactivate_trigger,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_deactivated,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_reply_defer (reply));
 
                 if (server->deactivate_handler != NULL)
                         server->deactivate_handler (server->user_data, deactivate_trigger, server);
@@ -537,8 +695,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (quit_trigger,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_quit_complete,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_reply_defer (reply));
 
                 if (server->quit_handler != NULL)
                         server->quit_handler (server->user_data, retain_splash, quit_trigger, server);
@@ -561,8 +718,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (answer,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_password_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_reply_defer (reply));
 
                 if (server->ask_for_password_handler != NULL) {
                         server->ask_for_password_handler (server->user_data,
@@ -581,7 +737,6 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_list_node_t *node;
                 ply_buffer_t *buffer;
                 size_t buffer_size;
-                uint32_t size;
 
                 ply_trace ("got cached password request");
 
@@ -615,23 +770,14 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 if (buffer_size == 0) {
                         ply_trace ("Responding with 'no answer' reply since there are currently "
                                    "no cached answers");
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER)))
-                                ply_trace ("could not finish writing no answer reply: %m");
+                        ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER);
                 } else {
-                        size = buffer_size;
-
                         ply_trace ("writing %d cached answers",
                                    ply_list_get_length (server->cached_passwords));
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS)) ||
-                            !ply_write_uint32 (connection->fd,
-                                               size) ||
-                            !ply_write (connection->fd,
-                                        ply_buffer_get_bytes (buffer), size))
-                                ply_trace ("could not finish writing cached answer reply: %m");
+                        ply_boot_reply_send_bytes (reply,
+                                                   PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS,
+                                                   ply_buffer_get_bytes (buffer),
+                                                   buffer_size);
                 }
 
                 ply_buffer_free (buffer);
@@ -646,8 +792,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (answer,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_question_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_reply_defer (reply));
 
                 if (server->ask_question_handler != NULL) {
                         server->ask_question_handler (server->user_data,
@@ -679,8 +824,7 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                 ply_trigger_add_handler (answer,
                                          (ply_trigger_handler_t)
                                          ply_boot_connection_on_keystroke_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+                                         ply_boot_reply_defer (reply));
 
                 if (server->watch_for_keystroke_handler != NULL) {
                         server->watch_for_keystroke_handler (server->user_data,
@@ -723,36 +867,138 @@ ply_boot_connection_on_request (ply_boot_connection_t *connection)
                         answer = server->has_active_vt_handler (server->user_data, server);
 
                 if (!answer) {
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                                ply_trace ("could not finish writing nak: %m");
+                        ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK);
 
                         free (argument);
                         free (command);
                         return;
                 }
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_GET_STATS) == 0) {
+                char *stats = NULL;
+
+                ply_trace ("got stats request");
+                if (server->get_stats_handler != NULL)
+                        stats = server->get_stats_handler (server->user_data, server);
+
+                ply_boot_reply_send_answer (reply, stats);
+
+                free (stats);
+                free (argument);
+                free (command);
+                return;
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_GET_STARTUP_TRACE) == 0) {
+                ply_buffer_t *buffer;
+
+                /* The phase tracer is process wide, so there's nothing to
+                 * ask the daemon for
+                 */
+                ply_trace ("got startup trace request");
+                buffer = ply_buffer_new ();
+                ply_phase_tracer_append_json (buffer);
+                ply_boot_reply_send_answer (reply, ply_buffer_get_bytes (buffer));
+                ply_buffer_free (buffer);
+
+                free (argument);
+                free (command);
+                return;
+        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEGOTIATE) == 0) {
+                ply_trace ("client speaks protocol version %s",
+                           argument != NULL ? argument : "1");
+
+                /* Older daemons reply to this with a NAK, which tells the
+                 * client to stick to the original framing
+                 */
+                ply_boot_reply_send_answer (reply, PLY_BOOT_PROTOCOL_VERSION);
+
+                free (argument);
+                free (command);
+                return;
         } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PING) != 0) {
                 ply_error ("received unknown command '%s' from client", command);
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                        ply_trace ("could not finish writing ping reply: %m");
+                ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK);
 
                 free (argument);
                 free (command);
                 return;
         }
 
-        if (!ply_write (connection->fd,
-                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                ply_trace ("could not finish writing ack: %m");
+        ply_boot_reply_send (reply, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK);
         free (argument);
         free (command);
 }
 
+static void
+ply_boot_connection_on_request (ply_boot_connection_t *connection)
+{
+        const uint8_t *bytes;
+        size_t size, offset;
+        ssize_t request_size = 0;
+        bool is_connected;
+
+        assert (connection != NULL);
+        assert (connection->fd >= 0);
+
+        is_connected = ply_buffer_append_from_socket (connection->requests,
+                                                      connection->fd,
+                                                      MAX_REQUEST_BYTES_PER_WAKEUP) >= 0;
+
+        if (ply_buffer_get_size (connection->requests) == 0) {
+                if (!is_connected)
+                        ply_trace ("could not read connection request");
+                return;
+        }
+
+        if (!ply_boot_connection_read_credentials (connection)) {
+                ply_buffer_clear (connection->requests);
+                return;
+        }
+
+        if (ply_is_tracing ())
+                print_connection_process_identity (connection);
+
+        /* A client may pipeline any number of requests in one write, so
+         * handle every complete request that arrived and send all the
+         * immediate replies back in one go
+         */
+        ply_boot_connection_take_reference (connection);
+        connection->is_batching_replies = true;
+
+        bytes = (const uint8_t *) ply_buffer_get_bytes (connection->requests);
+        size = ply_buffer_get_size (connection->requests);
+        offset = 0;
+        while (offset < size) {
+                ply_boot_reply_t reply;
+                char *command, *argument;
+
+                request_size = ply_boot_server_parse_request (bytes + offset,
+                                                              size - offset,
+                                                              &reply,
+                                                              &command,
+                                                              &argument);
+                if (request_size <= 0)
+                        break;
+
+                offset += request_size;
+                reply.connection = connection;
+
+                ply_boot_connection_handle_request (connection, &reply,
+                                                    command, argument);
+        }
+
+        if (request_size < 0) {
+                ply_trace ("received malformed request, closing connection");
+                ply_buffer_clear (connection->requests);
+                shutdown (connection->fd, SHUT_RDWR);
+        } else {
+                ply_buffer_remove_bytes (connection->requests, offset);
+        }
+
+        connection->is_batching_replies = false;
+        ply_boot_connection_flush_replies (connection);
+        ply_boot_connection_drop_reference (connection);
+}
+
 static void
 ply_boot_connection_on_hangup (ply_boot_connection_t *connection)
 {
@@ -801,6 +1047,109 @@ ply_boot_server_on_new_connection (ply_boot_server_t *server)
         ply_list_append_data (server->connections, connection);
 }
 
+static void
+ply_boot_server_handle_update_datagram (ply_boot_server_t   *server,
+                                        const struct msghdr *message,
+                                        size_t               size)
+{
+        struct cmsghdr *control_message;
+        struct ucred credentials;
+        bool has_credentials = false;
+        ply_boot_reply_t reply;
+        char *command, *argument;
+
+        if (message->msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+                ply_trace ("ignoring truncated update datagram");
+                return;
+        }
+
+        for (control_message = CMSG_FIRSTHDR ((struct msghdr *) message);
+             control_message != NULL;
+             control_message = CMSG_NXTHDR ((struct msghdr *) message, control_message)) {
+                if (control_message->cmsg_level == SOL_SOCKET &&
+                    control_message->cmsg_type == SCM_CREDENTIALS) {
+                        memcpy (&credentials, CMSG_DATA (control_message), sizeof(credentials));
+                        has_credentials = true;
+                }
+        }
+
+        if (!has_credentials || credentials.uid != 0) {
+                ply_error ("update datagram came from non-root user");
+                return;
+        }
+
+        if (ply_boot_server_parse_request (message->msg_iov[0].iov_base, size,
+                                           &reply, &command, &argument) <= 0) {
+                ply_trace ("ignoring malformed update datagram from pid %ld",
+                           (long) credentials.pid);
+                return;
+        }
+
+        if (argument == NULL)
+                ply_trace ("ignoring update datagram without argument");
+        else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE) == 0)
+                ply_boot_server_handle_update (server, argument);
+        else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_UPDATE) == 0)
+                ply_boot_server_handle_system_update (server, argument);
+        else
+                ply_trace ("ignoring '%s' request sent as a datagram", command);
+
+        free (argument);
+        free (command);
+}
+
+static void
+ply_boot_server_on_update_datagrams (ply_boot_server_t *server)
+{
+        struct mmsghdr messages[UPDATE_DATAGRAMS_PER_READ];
+        struct iovec buffers[UPDATE_DATAGRAMS_PER_READ];
+        uint8_t datagrams[UPDATE_DATAGRAMS_PER_READ][PLY_BOOT_PROTOCOL_MAX_UPDATE_DATAGRAM_SIZE];
+        union
+        {
+                struct cmsghdr header;
+                uint8_t        bytes[CMSG_SPACE (sizeof(struct ucred))];
+        } control_messages[UPDATE_DATAGRAMS_PER_READ];
+        int number_of_datagrams_read = 0;
+
+        assert (server != NULL);
+
+        while (number_of_datagrams_read < MAX_UPDATE_DATAGRAMS_PER_WAKEUP) {
+                int i, count;
+
+                memset (messages, 0, sizeof(messages));
+                for (i = 0; i < UPDATE_DATAGRAMS_PER_READ; i++) {
+                        buffers[i].iov_base = datagrams[i];
+                        buffers[i].iov_len = sizeof(datagrams[i]);
+                        messages[i].msg_hdr.msg_iov = &buffers[i];
+                        messages[i].msg_hdr.msg_iovlen = 1;
+                        messages[i].msg_hdr.msg_control = &control_messages[i];
+                        messages[i].msg_hdr.msg_controllen = sizeof(control_messages[i]);
+                }
+
+                count = recvmmsg (server->update_socket_fd, messages,
+                                  UPDATE_DATAGRAMS_PER_READ, MSG_DONTWAIT, NULL);
+
+                if (count < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                                ply_trace ("could not read update datagrams: %m");
+                        break;
+                }
+
+                for (i = 0; i < count; i++)
+                        ply_boot_server_handle_update_datagram (server,
+                                                                &messages[i].msg_hdr,
+                                                                messages[i].msg_len);
+
+                number_of_datagrams_read += count;
+
+                if (count < UPDATE_DATAGRAMS_PER_READ)
+                        break;
+        }
+}
+
 static void
 ply_boot_server_on_hangup (ply_boot_server_t *server)
 {
@@ -832,6 +1181,15 @@ ply_boot_server_attach_to_event_loop (ply_boot_server_t *server,
                                  (ply_event_handler_t)
                                  ply_boot_server_on_hangup,
                                  server);
+
+        if (server->update_socket_fd >= 0)
+                ply_event_loop_watch_fd (loop, server->update_socket_fd,
+                                         PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                         (ply_event_handler_t)
+                                         ply_boot_server_on_update_datagrams,
+                                         NULL,
+                                         server);
+
         ply_event_loop_watch_for_exit (loop, (ply_event_loop_exit_handler_t)
                                        ply_boot_server_detach_from_event_loop,
                                        server);
@@ -0,0 +1,102 @@
+/* ply-built-in-plugins.c - plugins linked into plymouthd
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "config.h"
+#include "ply-built-in-plugins.h"
+
+#include <stddef.h>
+
+#include "ply-boot-splash-plugin.h"
+#include "ply-label-plugin.h"
+#include "ply-renderer-plugin.h"
+
+/* The built-in copies of the plugins get their entry points renamed at
+ * build time, so they don't clash with each other
+ */
+#ifdef PLY_HAVE_BUILT_IN_TWO_STEP_PLUGIN
+ply_boot_splash_plugin_interface_t *ply_two_step_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_SCRIPT_PLUGIN
+ply_boot_splash_plugin_interface_t *ply_script_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_TEXT_PLUGIN
+ply_boot_splash_plugin_interface_t *ply_text_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_TRIBAR_PLUGIN
+ply_boot_splash_plugin_interface_t *ply_tribar_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_FADE_THROBBER_PLUGIN
+ply_boot_splash_plugin_interface_t *ply_fade_throbber_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_SPACE_FLARES_PLUGIN
+ply_boot_splash_plugin_interface_t *ply_space_flares_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_DRM_PLUGIN
+ply_renderer_plugin_interface_t *ply_drm_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_FRAME_BUFFER_PLUGIN
+ply_renderer_plugin_interface_t *ply_frame_buffer_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_OFFSCREEN_PLUGIN
+ply_renderer_plugin_interface_t *ply_offscreen_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_LABEL_PANGO_PLUGIN
+ply_label_plugin_interface_t *ply_label_pango_plugin_get_interface (void);
+#endif
+#ifdef PLY_HAVE_BUILT_IN_LABEL_FREETYPE_PLUGIN
+ply_label_plugin_interface_t *ply_label_freetype_plugin_get_interface (void);
+#endif
+
+const ply_built_in_module_t ply_built_in_plugins[] =
+{
+#ifdef PLY_HAVE_BUILT_IN_TWO_STEP_PLUGIN
+        { "two-step.so", "ply_boot_splash_plugin_get_interface", (ply_module_function_t) ply_two_step_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_SCRIPT_PLUGIN
+        { "script.so", "ply_boot_splash_plugin_get_interface", (ply_module_function_t) ply_script_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_TEXT_PLUGIN
+        { "text.so", "ply_boot_splash_plugin_get_interface", (ply_module_function_t) ply_text_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_TRIBAR_PLUGIN
+        { "tribar.so", "ply_boot_splash_plugin_get_interface", (ply_module_function_t) ply_tribar_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_FADE_THROBBER_PLUGIN
+        { "fade-throbber.so", "ply_boot_splash_plugin_get_interface", (ply_module_function_t) ply_fade_throbber_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_SPACE_FLARES_PLUGIN
+        { "space-flares.so", "ply_boot_splash_plugin_get_interface", (ply_module_function_t) ply_space_flares_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_DRM_PLUGIN
+        { "renderers/drm.so", "ply_renderer_backend_get_interface", (ply_module_function_t) ply_drm_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_FRAME_BUFFER_PLUGIN
+        { "renderers/frame-buffer.so", "ply_renderer_backend_get_interface", (ply_module_function_t) ply_frame_buffer_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_OFFSCREEN_PLUGIN
+        { "renderers/offscreen.so", "ply_renderer_backend_get_interface", (ply_module_function_t) ply_offscreen_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_LABEL_PANGO_PLUGIN
+        { "label-pango.so", "ply_label_plugin_get_interface", (ply_module_function_t) ply_label_pango_plugin_get_interface },
+#endif
+#ifdef PLY_HAVE_BUILT_IN_LABEL_FREETYPE_PLUGIN
+        { "label-freetype.so", "ply_label_plugin_get_interface", (ply_module_function_t) ply_label_freetype_plugin_get_interface },
+#endif
+        { NULL, NULL, NULL }
+};
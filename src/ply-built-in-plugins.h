@@ -0,0 +1,30 @@
+/* ply-built-in-plugins.h - plugins linked into plymouthd
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_BUILT_IN_PLUGINS_H
+#define PLY_BUILT_IN_PLUGINS_H
+
+#include "ply-utils.h"
+
+/* The plugins picked with the built-in-plugins build option, in the
+ * form ply_set_built_in_modules () takes
+ */
+extern const ply_built_in_module_t ply_built_in_plugins[];
+
+#endif /* PLY_BUILT_IN_PLUGINS_H */